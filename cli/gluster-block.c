@@ -35,6 +35,9 @@
                               "enable-tpg <host> [--json*]"
 # define  GB_INFO_HELP_STR    "gluster-block info <volname/blockname> [--json*]"
 # define  GB_LIST_HELP_STR    "gluster-block list <volname> [--json*]"
+# define  GB_REINDEX_HELP_STR "gluster-block reindex <volname> [--json*]"
+# define  GB_MIGRATE_HELP_STR "gluster-block migrate <volname> <v1|v2> [--json*]"
+# define  GB_REBALANCE_HELP_STR "gluster-block rebalance <volname> [--json*]"
 
 
 # define  GB_ARGCHECK_OR_RETURN(argcount, count, cmd, helpstr)        \
@@ -61,7 +64,10 @@ typedef enum clioperations {
   MODIFY_SIZE_CLI = 6,
   REPLACE_CLI = 7,
   GENCONF_CLI = 8,
-  RELOAD_CLI = 9
+  RELOAD_CLI = 9,
+  REINDEX_CLI = 10,
+  MIGRATE_CLI = 11,
+  REBALANCE_CLI = 12
 } clioperations;
 
 
@@ -115,6 +121,9 @@ glusterBlockCliRPC_1(void *cobj, clioperations opt)
   blockModifySizeCli *modify_size_obj;
   blockReplaceCli *replace_obj;
   blockGenConfigCli *genconfig_obj;
+  blockReindexCli *reindex_obj;
+  blockMigrateCli *migrate_obj;
+  blockRebalanceCli *rebalance_obj;
   blockResponse reply = {0,};
   char          errMsg[2048] = {0};
   gbConfig *conf = NULL;
@@ -257,6 +266,30 @@ glusterBlockCliRPC_1(void *cobj, clioperations opt)
       goto out;
     }
     break;
+  case REINDEX_CLI:
+    reindex_obj = cobj;
+    if (block_reindex_cli_1(reindex_obj, &reply, clnt) != RPC_SUCCESS) {
+      LOG("cli", GB_LOG_ERROR, "%s reindex on volume %s failed",
+          clnt_sperror(clnt, "block_reindex_cli_1"), reindex_obj->volume);
+      goto out;
+    }
+    break;
+  case MIGRATE_CLI:
+    migrate_obj = cobj;
+    if (block_migrate_cli_1(migrate_obj, &reply, clnt) != RPC_SUCCESS) {
+      LOG("cli", GB_LOG_ERROR, "%s migrate on volume %s failed",
+          clnt_sperror(clnt, "block_migrate_cli_1"), migrate_obj->volume);
+      goto out;
+    }
+    break;
+  case REBALANCE_CLI:
+    rebalance_obj = cobj;
+    if (block_rebalance_cli_1(rebalance_obj, &reply, clnt) != RPC_SUCCESS) {
+      LOG("cli", GB_LOG_ERROR, "%s rebalance on volume %s failed",
+          clnt_sperror(clnt, "block_rebalance_cli_1"), rebalance_obj->volume);
+      goto out;
+    }
+    break;
   }
 
  out:
@@ -340,6 +373,17 @@ glusterBlockHelp(void)
       "  genconfig <volname[,volume2,volume3,...]> enable-tpg <host>\n"
       "        generate the block volumes target configuration.\n"
       "\n"
+      "  reindex <volname>\n"
+      "        rebuild the block index and prio path counts of the volume from its\n"
+      "        metadata.\n"
+      "\n"
+      "  migrate <volname> <v1|v2>\n"
+      "        rewrite the block metadata of the volume in the given format.\n"
+      "\n"
+      "  rebalance <volname>\n"
+      "        spread the active/optimized paths of the volume's blocks evenly\n"
+      "        over their nodes.\n"
+      "\n"
       "  help\n"
       "        show this message and exit.\n"
       "\n"
@@ -1113,6 +1157,88 @@ glusterBlockGenConfig(int argcount, char **options, int json)
 }
 
 
+static int
+glusterBlockReindex(int argcount, char **options, int json)
+{
+  blockReindexCli robj = {{0},};
+  int ret = -1;
+
+
+  GB_ARGCHECK_OR_RETURN(argcount, 2, "reindex", GB_REINDEX_HELP_STR);
+  robj.json_resp = json;
+
+  GB_STRCPYSTATIC(robj.volume, options[1]);
+
+  ret = glusterBlockCliRPC_1(&robj, REINDEX_CLI);
+  if (ret) {
+    LOG("cli", GB_LOG_ERROR, "failed rebuilding index of volume %s",
+        robj.volume);
+  }
+
+  return ret;
+}
+
+
+static int
+glusterBlockMigrate(int argcount, char **options, int json)
+{
+  blockMigrateCli mobj = {{0},};
+  int ret = -1;
+
+
+  GB_ARGCHECK_OR_RETURN(argcount, 3, "migrate", GB_MIGRATE_HELP_STR);
+  mobj.json_resp = json;
+
+  GB_STRCPYSTATIC(mobj.volume, options[1]);
+
+  if (!strcmp(options[2], "v1")) {
+    mobj.meta_version = 1;
+  } else if (!strcmp(options[2], "v2")) {
+    mobj.meta_version = 2;
+  } else {
+    MSG(stderr, "unknown metadata format '%s' for migrate:\n%s", options[2],
+        GB_MIGRATE_HELP_STR);
+    return -1;
+  }
+
+  getCommandString(&mobj.cmd, argcount, options);
+
+  ret = glusterBlockCliRPC_1(&mobj, MIGRATE_CLI);
+  if (ret) {
+    LOG("cli", GB_LOG_ERROR, "failed migrating metadata of volume %s",
+        mobj.volume);
+  }
+
+  GB_FREE(mobj.cmd);
+  return ret;
+}
+
+
+static int
+glusterBlockRebalance(int argcount, char **options, int json)
+{
+  blockRebalanceCli robj = {{0},};
+  int ret = -1;
+
+
+  GB_ARGCHECK_OR_RETURN(argcount, 2, "rebalance", GB_REBALANCE_HELP_STR);
+  robj.json_resp = json;
+
+  GB_STRCPYSTATIC(robj.volume, options[1]);
+
+  getCommandString(&robj.cmd, argcount, options);
+
+  ret = glusterBlockCliRPC_1(&robj, REBALANCE_CLI);
+  if (ret) {
+    LOG("cli", GB_LOG_ERROR, "failed rebalancing prio paths of volume %s",
+        robj.volume);
+  }
+
+  GB_FREE(robj.cmd);
+  return ret;
+}
+
+
 static int
 glusterBlockParseArgs(int count, char **options, size_t opt, int json)
 {
@@ -1163,6 +1289,27 @@ glusterBlockParseArgs(int count, char **options, size_t opt, int json)
       }
       goto out;
 
+    case GB_CLI_REINDEX:
+      ret = glusterBlockReindex(count, options, json);
+      if (ret) {
+        LOG("cli", GB_LOG_ERROR, FAILED_REINDEX);
+      }
+      goto out;
+
+    case GB_CLI_MIGRATE:
+      ret = glusterBlockMigrate(count, options, json);
+      if (ret) {
+        LOG("cli", GB_LOG_ERROR, FAILED_MIGRATE);
+      }
+      goto out;
+
+    case GB_CLI_REBALANCE:
+      ret = glusterBlockRebalance(count, options, json);
+      if (ret) {
+        LOG("cli", GB_LOG_ERROR, FAILED_REBALANCE);
+      }
+      goto out;
+
     case GB_CLI_DELETE:
       ret = glusterBlockDelete(count, options, json);
       if (ret) {
@@ -19,12 +19,14 @@
 # include  <sys/utsname.h>
 # include  <linux/version.h>
 # include  <sys/wait.h>
+# include  <poll.h>
 
 # include  "common.h"
 # include  "lru.h"
+# include  "workqueue.h"
 # include  "block.h"
 # include  "block_svc.h"
-# include  "capabilities.h"
+# include  "block_common.h"
 # include  "version.h"
 
 # define   GB_TGCLI_GLOBALS     "targetcli set "                               \
@@ -35,6 +37,15 @@
 
 # define   GB_DISTRO_CHECK      "grep -P '(^ID=)' /etc/os-release"
 
+# define   GB_RPC_WORKERS_DEF   8
+
+#if GFAPI_VERSION760
+# define   GB_CLI_WORKERS_MAX   GB_WQ_THREADS_MAX
+#else
+/* no glfs_fd_set_lkowner(), meta.lock can't tell our own threads apart */
+# define   GB_CLI_WORKERS_MAX   1
+#endif
+
 
 gbProcessCtx gbCtx = GB_DAEMON_MODE; /* set process mode */
 
@@ -50,6 +61,24 @@ typedef struct globalData {
 
 globalData ctx = {0,};
 
+/* the transports this process polls, see glusterBlockSvcRun() */
+typedef struct gbSvcLoop {
+  int wakefd[2];            /* kicks poll() when a worker is done */
+  int maxfd;
+  unsigned char *busy;      /* connections a worker is serving, by fd */
+  volatile sig_atomic_t threaded;  /* else svc_run() is serving */
+  pthread_mutex_t lock;
+} gbSvcLoop;
+
+static gbSvcLoop svcLoop = {
+  .wakefd = {-1, -1},
+  .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+static volatile sig_atomic_t svcStopped;
+
+/* targetcli keeps all of its state in one saveconfig.json */
+static pthread_mutex_t gbTargetLock = PTHREAD_MUTEX_INITIALIZER;
+
 
 void
 glusterBlockCleanGlobals(void)
@@ -70,6 +99,29 @@ glusterBlockCleanGlobals(void)
 }
 
 
+/* svc_exit() for glusterBlockSvcRun(), safe to call from a signal handler */
+static void
+glusterBlockSvcExit(void)
+{
+#ifdef HAVE_LIBTIRPC
+  int saved = errno;
+
+
+  if (!svcLoop.threaded) {
+    svc_exit();
+    return;
+  }
+  svcStopped = 1;
+  if (svcLoop.wakefd[1] != -1 && write(svcLoop.wakefd[1], "", 1) < 0) {
+    /* full pipe, poll() is about to return anyway */
+  }
+  errno = saved;
+#else
+  svc_exit();
+#endif  /* HAVE_LIBTIRPC */
+}
+
+
 void
 onSigServerHandler(int signum)
 {
@@ -77,7 +129,7 @@ onSigServerHandler(int signum)
       "server process with (pid: %u) received (signal: %s)",
       getpid(), strsignal(signum));
 
-  svc_exit();
+  glusterBlockSvcExit();
 
   return;
 }
@@ -92,7 +144,7 @@ onSigCliHandler(int signum)
 
   kill(ctx.chpid, signum);  /* Pass the signal to server process */
 
-  svc_exit();
+  glusterBlockSvcExit();
 
   return;
 }
@@ -125,6 +177,171 @@ glusterBlockDHelp(void)
 }
 
 
+#ifdef HAVE_LIBTIRPC
+static void
+glusterBlockSvcServe(void *data)
+{
+  int fd = (intptr_t)data;
+
+
+  /* reads the request, runs the handler and sends the reply */
+  svc_getreq_common(fd);
+
+  LOCK(svcLoop.lock);
+  svcLoop.busy[fd] = 0;
+  UNLOCK(svcLoop.lock);
+
+  if (write(svcLoop.wakefd[1], "", 1) < 0) {
+    /* full pipe, poll() is about to return anyway */
+  }
+}
+#endif  /* HAVE_LIBTIRPC */
+
+
+/*
+ * svc_run() serving requests on GB_RPC_WORKERS threads. New connections
+ * are accepted here; a connection with a request ready is handed to a
+ * worker and left out of poll() until its reply is sent, so requests on
+ * one connection still run in order, while those on different ones, like
+ * concurrent cli commands or calls from different peers, run in parallel.
+ */
+static void
+glusterBlockSvcRun(const char *name, SVCXPRT *listener, size_t maxWorkers)
+{
+#ifdef HAVE_LIBTIRPC
+  gbWorkQueue *wq = NULL;
+  struct pollfd *pfds = NULL;
+  size_t npfds = 0;
+  size_t nworkers = GB_RPC_WORKERS_DEF;
+  size_t n;
+  size_t j;
+  char drain[64];
+  int i;
+  int fd;
+
+
+  if (gbCfg->GB_RPC_WORKERS > 0) {
+    nworkers = gbCfg->GB_RPC_WORKERS;
+  }
+  if (nworkers > maxWorkers) {
+    if (gbCfg->GB_RPC_WORKERS > 0) {
+      LOG("mgmt", GB_LOG_WARNING, "%s: GB_RPC_WORKERS=%zu is more than %zu, "
+          "using %zu", name, nworkers, maxWorkers, maxWorkers);
+    }
+    nworkers = maxWorkers;
+  }
+
+  svcLoop.maxfd = getdtablesize();
+  if (pipe2(svcLoop.wakefd, O_NONBLOCK | O_CLOEXEC) ||
+      GB_ALLOC_N(svcLoop.busy, svcLoop.maxfd) < 0 ||
+      !(wq = gbWorkQueueCreate(name, nworkers))) {
+    LOG("mgmt", GB_LOG_WARNING,
+        "%s: serving requests one at a time, no workers[%s]",
+        name, strerror(errno));
+    svc_run();
+    goto out;
+  }
+  LOG("mgmt", GB_LOG_INFO, "%s: serving requests with %zu workers",
+      name, nworkers);
+  svcLoop.threaded = 1;
+
+  while (!svcStopped) {
+    LOCK(svcLoop.lock);
+    if ((size_t)svc_max_pollfd + 1 > npfds) {
+      if (GB_REALLOC_N(pfds, svc_max_pollfd + 1) < 0) {
+        UNLOCK(svcLoop.lock);
+        break;
+      }
+      npfds = svc_max_pollfd + 1;
+    }
+    n = 0;
+    pfds[n].fd = svcLoop.wakefd[0];
+    pfds[n].events = POLLIN;
+    pfds[n++].revents = 0;
+    for (i = 0; i < svc_max_pollfd; i++) {
+      fd = svc_pollfd[i].fd;
+      if (fd < 0 || fd >= svcLoop.maxfd || svcLoop.busy[fd]) {
+        continue;
+      }
+      pfds[n].fd = fd;
+      pfds[n].events = POLLIN | POLLPRI | POLLRDNORM | POLLRDBAND;
+      pfds[n++].revents = 0;
+    }
+    UNLOCK(svcLoop.lock);
+
+    if (poll(pfds, n, -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      LOG("mgmt", GB_LOG_ERROR, "%s: poll() failed[%s]",
+          name, strerror(errno));
+      break;
+    }
+
+    if (pfds[0].revents) {
+      while (read(svcLoop.wakefd[0], drain, sizeof(drain)) > 0) {
+        ;
+      }
+    }
+
+    for (j = 1; j < n; j++) {
+      if (!pfds[j].revents) {
+        continue;
+      }
+      fd = pfds[j].fd;
+      if (fd == listener->xp_fd) {
+        svc_getreq_common(fd);  /* accept(), registers the connection */
+        continue;
+      }
+
+      LOCK(svcLoop.lock);
+      svcLoop.busy[fd] = 1;
+      UNLOCK(svcLoop.lock);
+      if (gbWorkQueueAdd(wq, glusterBlockSvcServe, (void *)(intptr_t)fd)) {
+        glusterBlockSvcServe((void *)(intptr_t)fd);
+      }
+    }
+  }
+
+  /* let the requests in flight send their replies */
+  gbWorkQueueDestroy(wq);
+  svcLoop.threaded = 0;
+
+ out:
+  GB_FREE(pfds);
+  GB_FREE(svcLoop.busy);
+  if (svcLoop.wakefd[0] != -1) {
+    close(svcLoop.wakefd[0]);
+    close(svcLoop.wakefd[1]);
+    svcLoop.wakefd[0] = svcLoop.wakefd[1] = -1;
+  }
+#else
+  svc_run();
+#endif  /* HAVE_LIBTIRPC */
+}
+
+
+/*
+ * Peer requests other than the version check reconfigure the target, run
+ * them one at a time like a single threaded server did.
+ */
+static void
+glusterBlockServerDispatch(struct svc_req *rqstp, register SVCXPRT *transp)
+{
+  bool serialize = (rqstp->rq_proc != NULLPROC &&
+                    rqstp->rq_proc != BLOCK_VERSION);
+
+
+  if (serialize) {
+    LOCK(gbTargetLock);
+  }
+  gluster_block_1(rqstp, transp);
+  if (serialize) {
+    UNLOCK(gbTargetLock);
+  }
+}
+
+
 void
 glusterBlockCliProcess(void)
 {
@@ -180,7 +397,7 @@ glusterBlockCliProcess(void)
     goto out;
 	}
 
-  svc_run ();
+  glusterBlockSvcRun("cli", transp, GB_CLI_WORKERS_MAX);
 
  out:
   if (transp) {
@@ -243,13 +460,13 @@ glusterBlockServerProcess(void)
   }
 
   if (!svc_register(transp, GLUSTER_BLOCK, GLUSTER_BLOCK_VERS,
-                    gluster_block_1, IPPROTO_TCP)) {
+                    glusterBlockServerDispatch, IPPROTO_TCP)) {
     snprintf (errMsg, sizeof (errMsg), "%s", "Please check if rpcbind "
               "service is running.");
     goto out;
   }
 
-  svc_run ();
+  glusterBlockSvcRun("server", transp, GB_WQ_THREADS_MAX);
 
  out:
   if (transp) {
@@ -566,6 +783,30 @@ blockNodeSanityCheck(void)
 }
 
 
+static void
+glusterBlockPrewarmCache(void)
+{
+  char *saved = NULL;
+  char *volumes = NULL;
+  const char *conf = gbCfg->GB_GLFS_PREWARM_VOLUMES;
+
+
+  saved = getCacheSavedVolumes();
+  if (GB_ASPRINTF(&volumes, "%s,%s", conf ? conf : "",
+                  saved ? saved : "") == -1) {
+    LOG("mgmt", GB_LOG_WARNING, "skipping glfs cache pre-warm[%s]",
+        strerror(errno));
+    goto out;
+  }
+
+  glusterBlockPrewarmVolumes(volumes);
+
+ out:
+  GB_FREE(saved);
+  GB_FREE(volumes);
+}
+
+
 static int
 initDaemonCapabilities(void)
 {
@@ -667,6 +908,13 @@ main (int argc, char **argv)
     signal(SIGTERM, onSigCliHandler);
     signal(SIGALRM, onSigCliHandler);
 
+    /* only the cli process serves requests out of the glfs cache */
+    startCacheReaper();
+    glusterBlockPrewarmCache();
+    if (!gbConf->noRemoteRpc) {
+      glusterBlockPeerStartHeartbeat();
+    }
+
     glusterBlockCliProcess();
 
     /* wait for server process to exit */
@@ -474,7 +474,16 @@ for BLOCKNAME in $(ls ${DIR}); do
 
     takeLockInit ${fd}
 
-    if [[ ${BLOCKNAME} == "meta.lock" ]]; then
+    # meta.lock, prio.info, blocks.index and such aren't blocks
+    if [[ ${BLOCKNAME} == *.* ]]; then
+        releaseLockExit ${fd}
+        continue;
+    fi
+
+    if head -c 8 "${DIR}/${BLOCKNAME}" | grep -q "GBMETA"; then
+        echo "${BLOCKNAME}: metadata is in v2 format, run 'gluster-block migrate <volname> v1' first"
+        printLog "ERROR: ${BLOCKNAME} has v2 metadata, skipping replace..."
+        releaseLockExit ${fd}
         continue;
     fi
 
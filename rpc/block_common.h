@@ -36,6 +36,12 @@
 # define   GB_TGCLI_GLFS_SAVE   GB_TGCLI_GLFS_PATH "/%s saveconfig"
 # define   GB_TGCLI_ATTRIBUTES  "generate_node_acls=1 demo_mode_write_protect=0"
 # define   GB_TGCLI_IQN_PREFIX  "iqn.2016-12.org.gluster-block:"
+# define   GB_GET_PORTAL_TPG    "targetcli /iscsi/" GB_TGCLI_IQN_PREFIX \
+                                "'%s' ls | grep -F -e tpg -e '%s:3260' | " \
+                                "grep -F -w -B1 '%s:3260' | grep -o 'tpg[0-9]\\+'"
+
+# define   GB_ALUA_AO_TPG_NAME  "glfs_tg_pt_gp_ao"
+# define   GB_ALUA_ANO_TPG_NAME "glfs_tg_pt_gp_ano"
 
 # define   GB_RING_BUFFER_STR   "max_data_area_mb"
 # define   GB_BLOCK_SIZE_STR    "hw_block_size"
@@ -43,6 +49,8 @@
 
 #define    GB_CMD_TIME_OUT      130
 
+# define   GB_VERSION_DEADLINE  30   /* seconds for each capability check call */
+
 # define   GB_JSON_OBJ_TO_STR(x) json_object_new_string(x?x:"")
 # define   GB_DEFAULT_ERRMSG    "Operation failed, please check the log "\
                                 "file to find the reason."
@@ -68,7 +76,10 @@ typedef enum operations {
   INFO_SRV,
   VERSION_SRV,
   GENCONFIG_SRV,
-  RELOAD_SRV
+  RELOAD_SRV,
+  REINDEX_SRV,
+  MIGRATE_SRV,
+  REBALANCE_SRV
 } operations;
 
 
@@ -82,6 +93,9 @@ typedef struct blockRemoteObj {
 } blockRemoteObj;
 
 
+typedef struct gbFanout gbFanout;
+
+
 typedef struct blockRemoteResp {
   char *attempt;
   char *success;
@@ -129,9 +143,6 @@ typedef struct blockRemoteCreateResp {
 } blockRemoteCreateResp;
 
 
-extern pthread_mutex_t lock;
-
-
 int mapJsonFlagToJsonCstring(int jsonflag);
 
 void blockStr2arrayAddToJsonObj(json_object *json_obj,
@@ -148,8 +159,12 @@ int glusterBlockCollectAttemptSuccess(blockRemoteObj *args, MetaInfo *info,
                                       operations opt, size_t count,
                                       char **attempt, char **success);
 
+blockServerDefPtr blockServerParse(char *blkServers);
+
 blockServerDefPtr blockMetaInfoToServerParse(MetaInfo *info);
 
+blockServerDefPtr blockMetaInfoToValidServers(MetaInfo *info, char *skiphost);
+
 blockServerDefPtr glusterBlockGetListFromInfo(MetaInfo *info);
 
 int blockGetHostStatus(MetaInfo *info, char *host);
@@ -165,15 +180,46 @@ char *blockInfoGetCurrentSizeOfNode(char *block_name,
 int glusterBlockCallRPC_1(char *host, void *cobj, operations opt,
                           bool *rpc_sent, char **out);
 
+CLIENT *glusterBlockPeerGetClient(char *addr, bool *reused);
+
+void glusterBlockPeerPutClient(char *addr, CLIENT *clnt, bool healthy);
+
+void glusterBlockPeerFlush(char *addr);
+
+int glusterBlockPeerStartHeartbeat(void);
+
+void glusterBlockPeerSetEpoch(char *addr, uint64_t epoch);
+
+gbCapResp *glusterBlockPeerGetCaps(char *addr);
+
+void glusterBlockPeerSetCaps(char *addr, gbCapResp *caps);
+
+char *glusterBlockPeerListDown(blockServerDefPtr list);
+
+gbFanout *glusterBlockFanoutNew(size_t max, time_t timeout);
+
+void glusterBlockFanoutAdd(gbFanout *fo, void *(*fn)(void *), void *arg);
+
+void glusterBlockFanoutWait(gbFanout *fo);
+
+void glusterBlockFanout(void *(*fn)(void *), blockRemoteObj *args,
+                        size_t count, time_t timeout);
+
+bool glusterBlockFanoutTimeLeft(struct timeval *tv);
+
 void *glusterBlockCreateRemote(void *data);
 
 void *glusterBlockDeleteRemote(void *data);
 
-int glusterBlockCleanUp(struct glfs *glfs, char *blockname, bool forcedel,
-                        bool unlink, blockRemoteDeleteResp *drobj);
+int glusterBlockCleanUp(struct glfs *glfs, char *blockname, MetaInfo *info,
+                        bool forcedel, bool unlink,
+                        blockRemoteDeleteResp *drobj);
 
 int glusterBlockCheckCapabilities(void* blk, operations opt,
                                   blockServerDefPtr list,
                                   bool *resultCaps, char **errMsg);
 
+int glusterBlockCheckMetaVersionCaps(struct glfs *glfs, char *volume,
+                                     blockServerDefPtr list, char **errMsg);
+
 #endif  /* _BLOCK_COMMON_H */
@@ -50,6 +50,7 @@ removeDuplicateSubstr(char **line)
   char *temp = *line;
   char *out;
   char *element;
+  char *saveptr = NULL;
   size_t len;
 
 
@@ -64,13 +65,13 @@ removeDuplicateSubstr(char **line)
   }
 
   /* Split string into tokens */
-  element = strtok(temp, " ");
+  element = strtok_r(temp, " ", &saveptr);
   while (element) {
     if (!strstr(out, element)) {
       GB_STRCAT(out, element, len);
       GB_STRCAT(out, " ", 2);
     }
-    element = strtok(NULL, " ");
+    element = strtok_r(NULL, " ", &saveptr);
   }
 
   GB_FREE(*line);
@@ -78,7 +79,7 @@ removeDuplicateSubstr(char **line)
 }
 
 
-static blockServerDefPtr
+blockServerDefPtr
 blockServerParse(char *blkServers)
 {
   blockServerDefPtr list;
@@ -162,6 +163,7 @@ static int
 blockRemoteCreateRespParse(char *output, blockRemoteCreateResp **savereply)
 {
   char *line;
+  char *saveptr = NULL;
   blockRemoteCreateResp *local = *savereply;
   char *portal = NULL;
   char *errMsg = NULL;
@@ -180,7 +182,7 @@ blockRemoteCreateRespParse(char *output, blockRemoteCreateResp **savereply)
   }
 
   /* get the first line */
-  line = strtok(output, "\n");
+  line = strtok_r(output, "\n", &saveptr);
   while (line)
   {
     switch (blockRemoteCreateRespEnumParse(line)) {
@@ -245,7 +247,7 @@ blockRemoteCreateRespParse(char *output, blockRemoteCreateResp **savereply)
       break;
     }
 
-    line = strtok(NULL, "\n");
+    line = strtok_r(NULL, "\n", &saveptr);
   }
 
   *savereply = local;
@@ -259,12 +261,17 @@ blockRemoteCreateRespParse(char *output, blockRemoteCreateResp **savereply)
 }
 
 
+/*
+ * On success the MetaInfo snapshot used for the audit is handed over in
+ * saveinfo, so the response can be built without reading the metafile again.
+ */
 static int
 glusterBlockAuditRequest(struct glfs *glfs,
                          blockCreateCli *blk,
                          blockCreate2 *cobj,
                          blockServerDefPtr list,
-                         blockRemoteCreateResp **reply)
+                         blockRemoteCreateResp **reply,
+                         MetaInfo **saveinfo)
 {
   int ret = -1;
   size_t i;
@@ -278,11 +285,13 @@ glusterBlockAuditRequest(struct glfs *glfs,
 
   ret = blockGetMetaInfo(glfs, blk->block_name, info, NULL);
   if (ret) {
+    blockFreeMetaInfo(info);
+    info = NULL;
     goto out;
   }
 
   for (i = 0; i < info->nhosts; i++) {
-    switch (blockMetaStatusEnumParse(info->list[i]->status)) {
+    switch (info->list[i]->st) {
     case GB_CONFIG_SUCCESS:
     case GB_AUTH_ENFORCED:
       successcnt++;
@@ -295,12 +304,12 @@ glusterBlockAuditRequest(struct glfs *glfs,
     LOG("mgmt", GB_LOG_INFO, "Block create request satisfied for target:"
         " %s on volume %s with given hosts %s",
           blk->block_name, blk->volume, blk->block_hosts);
-    blockFreeMetaInfo(info);
+    *saveinfo = info;
     return 0;
   }
 
  out:
-  glusterBlockCleanUp(glfs, blk->block_name, FALSE, TRUE, (*reply)->obj);
+  glusterBlockCleanUp(glfs, blk->block_name, info, FALSE, TRUE, (*reply)->obj);
 
   blockFreeMetaInfo(info);
   return ret;
@@ -318,7 +327,7 @@ glusterBlockCreateRemote(void *data)
   bool rpc_sent = FALSE;
 
 
-  GB_METAUPDATE_OR_GOTO(lock, args->glfs, cobj.block_name, cobj.volume,
+  GB_METAUPDATE_OR_GOTO(args->glfs, cobj.block_name, cobj.volume,
                         ret, errMsg, out, "%s: CONFIGINPROGRESS\n", args->addr);
 
   ret = glusterBlockCallRPC_1(args->addr, &cobj, CREATE_SRV, &rpc_sent,
@@ -336,7 +345,7 @@ glusterBlockCreateRemote(void *data)
       args->reply = NULL;
     }
 
-    GB_METAUPDATE_OR_GOTO(lock, args->glfs, cobj.block_name, cobj.volume,
+    GB_METAUPDATE_OR_GOTO(args->glfs, cobj.block_name, cobj.volume,
                           ret, errMsg, out, "%s: CONFIGFAIL\n", args->addr);
     LOG("mgmt", GB_LOG_ERROR, "%s for block %s on host %s volume %s",
         FAILED_REMOTE_CREATE, cobj.block_name, args->addr, args->volume);
@@ -345,10 +354,10 @@ glusterBlockCreateRemote(void *data)
     goto out;
   }
 
-  GB_METAUPDATE_OR_GOTO(lock, args->glfs, cobj.block_name, cobj.volume,
+  GB_METAUPDATE_OR_GOTO(args->glfs, cobj.block_name, cobj.volume,
                         ret, errMsg, out, "%s: CONFIGSUCCESS\n", args->addr);
   if (cobj.auth_mode) {
-    GB_METAUPDATE_OR_GOTO(lock, args->glfs, cobj.block_name, cobj.volume,
+    GB_METAUPDATE_OR_GOTO(args->glfs, cobj.block_name, cobj.volume,
                           ret, errMsg, out, "%s: AUTHENFORCED\n", args->addr);
   }
 
@@ -371,13 +380,12 @@ glusterBlockCreateRemoteAsync(blockServerDefPtr list, size_t mpath,
                             struct glfs *glfs, blockCreate2 *cobj,
                             blockRemoteCreateResp **savereply)
 {
-  pthread_t  *tid = NULL;
   blockRemoteObj *args = NULL;
   int ret = -1;
   size_t i;
 
 
-  if (GB_ALLOC_N(tid, mpath) < 0 || GB_ALLOC_N(args, mpath) < 0) {
+  if (GB_ALLOC_N(args, mpath) < 0) {
     goto out;
   }
 
@@ -388,14 +396,7 @@ glusterBlockCreateRemoteAsync(blockServerDefPtr list, size_t mpath,
     args[i].addr = list->hosts[i];
   }
 
-  for (i = 0; i < mpath; i++) {
-    pthread_create(&tid[i], NULL, glusterBlockCreateRemote, &args[i]);
-  }
-
-  for (i = 0; i < mpath; i++) {
-    /* collect exit code */
-    pthread_join(tid[i], NULL);
-  }
+  glusterBlockFanout(glusterBlockCreateRemote, args, mpath, TIMEOUT.tv_sec);
 
   for (i = 0; i < mpath; i++) {
     /* TODO: use glusterBlockCollectAttemptSuccess */
@@ -420,7 +421,6 @@ glusterBlockCreateRemoteAsync(blockServerDefPtr list, size_t mpath,
     }
   }
   GB_FREE(args);
-  GB_FREE(tid);
 
   return ret;
 }
@@ -785,9 +785,9 @@ static void
 blockCreateCliFormatResponse(struct glfs *glfs, blockCreateCli *blk,
                              blockCreate2 *cobj, int errCode,
                              char *errMsg, blockRemoteCreateResp *savereply,
-                             blockResponse *reply)
+                             MetaInfo *info, blockResponse *reply)
 {
-  MetaInfo *info = NULL;
+  MetaInfo *local = NULL;
   json_object *json_obj = NULL;
   json_object *json_array = NULL;
   char         *tmp      = NULL;
@@ -812,19 +812,23 @@ blockCreateCliFormatResponse(struct glfs *glfs, blockCreateCli *blk,
     return;
   }
 
-  if (GB_ALLOC(info) < 0) {
-    blockFormatErrorResponse(CREATE_SRV, blk->json_resp, ENOMEM,
-                             "Allocatoin Failed\n", reply);
-    return;
-  }
+  /* no snapshot from the audit, the request was rolled back */
+  if (!info) {
+    if (GB_ALLOC(local) < 0) {
+      blockFormatErrorResponse(CREATE_SRV, blk->json_resp, ENOMEM,
+                               "Allocatoin Failed\n", reply);
+      return;
+    }
 
-  if (blockGetMetaInfo(glfs, blk->block_name, info, &infoErrCode)) {
-    if (infoErrCode == ENOENT) {
-      blockFormatErrorResponse(CREATE_SRV, blk->json_resp,
-                               (errCode?errCode:GB_DEFAULT_ERRCODE),
-                               (savereply?savereply->errMsg:NULL), reply);
+    if (blockGetMetaInfo(glfs, blk->block_name, local, &infoErrCode)) {
+      if (infoErrCode == ENOENT) {
+        blockFormatErrorResponse(CREATE_SRV, blk->json_resp,
+                                 (errCode?errCode:GB_DEFAULT_ERRCODE),
+                                 (savereply?savereply->errMsg:NULL), reply);
+      }
+      goto out;
     }
-    goto out;
+    info = local;
   }
 
   if (!savereply)
@@ -832,7 +836,7 @@ blockCreateCliFormatResponse(struct glfs *glfs, blockCreateCli *blk,
 
   for (i = 0; i < info->nhosts; i++) {
     tmp = savereply->obj->d_attempt;
-    if (blockMetaStatusEnumParse(info->list[i]->status) == GB_CONFIG_INPROGRESS) {
+    if (info->list[i]->st == GB_CONFIG_INPROGRESS) {
       if (GB_ASPRINTF(&savereply->obj->d_attempt, "%s %s",
                       (tmp==NULL?"":tmp), info->list[i]->addr) == -1) {
         goto out;
@@ -933,7 +937,7 @@ blockCreateCliFormatResponse(struct glfs *glfs, blockCreateCli *blk,
                              GB_DEFAULT_ERRMSG, reply);
   }
 
-  blockFreeMetaInfo(info);
+  blockFreeMetaInfo(local);
   GB_FREE(tmp);
   GB_FREE(tmp2);
   return;
@@ -951,12 +955,14 @@ block_create_cli_1_svc_st(blockCreateCli *blk, struct svc_req *rqstp)
   blockResponse *reply;
   struct glfs *glfs = NULL;
   struct glfs_fd *lkfd = NULL;
+  struct MetaJournal *journal = NULL;
   blockServerDefPtr list = NULL;
   char *errMsg = NULL;
   blockCreate2 cobj = {{0},};
   bool *resultCaps = NULL;
   struct gbXdata *xdata = NULL;
   char *cmdlog = NULL;
+  MetaInfo *info = NULL;
 
 
   LOG("mgmt", GB_LOG_INFO,
@@ -1012,17 +1018,30 @@ block_create_cli_1_svc_st(blockCreateCli *blk, struct svc_req *rqstp)
     goto optfail;
   }
 
-  lkfd = glusterBlockCreateMetaLockFile(glfs, blk->volume, &errCode, &errMsg);
+  /* not covered by the load balance exception above */
+  errCode = glusterBlockCheckMetaVersionCaps(glfs, blk->volume, list, &errMsg);
+  if (errCode) {
+    LOG("mgmt", GB_LOG_ERROR,
+        "glusterBlockCheckMetaVersionCaps() for block %s on volume %s failed",
+        blk->block_name, blk->volume);
+    goto optfail;
+  }
+
+  lkfd = glusterBlockCreateMetaLockFile(glfs, blk->volume, "create",
+                                        &errCode, &errMsg);
   if (!lkfd) {
     LOG("mgmt", GB_LOG_ERROR, "%s %s for block %s with hosts %s",
         FAILED_CREATING_META, blk->volume, blk->block_name, blk->block_hosts);
     goto optfail;
   }
 
-  GB_METALOCK_OR_GOTO(lkfd, blk->volume, errCode, errMsg, out);
+  GB_METABLKLOCK_OR_GOTO(lkfd, F_WRLCK, blk->volume, blk->block_name,
+                         errCode, errMsg, out);
+  journal = blockMetaJournalHold(glfs, blk->volume, blk->block_name);
+  GB_METANSLOCK_OR_GOTO(lkfd, F_WRLCK, blk->volume, errCode, errMsg, exist);
   LOG("cmdlog", GB_LOG_INFO, "%s", blk->cmd);
 
-  if (!glfs_access(glfs, blk->block_name, F_OK)) {
+  if (!glusterBlockMetaFileAccess(glfs, blk->block_name, F_OK)) {
     LOG("mgmt", GB_LOG_ERROR,
         "block with name %s already exist in the volume %s",
         blk->block_name, blk->volume);
@@ -1036,6 +1055,7 @@ block_create_cli_1_svc_st(blockCreateCli *blk, struct svc_req *rqstp)
   }
 
   if (!resultCaps[GB_CREATE_LOAD_BALANCE_CAP]) {
+    /* counted on prio.info from here on, see exist: for the way back */
     blockGetPrioPath(glfs, blk->volume, list, cobj.prio_path, sizeof(cobj.prio_path));
   }
 
@@ -1043,19 +1063,23 @@ block_create_cli_1_svc_st(blockCreateCli *blk, struct svc_req *rqstp)
   uuid_unparse(uuid, gbid);
 
   if (cobj.prio_path[0]) {
-    GB_METAUPDATE_OR_GOTO(lock, glfs, blk->block_name, blk->volume,
+    GB_METAUPDATE_OR_GOTO(glfs, blk->block_name, blk->volume,
                           errCode, errMsg, exist,
                           "VOLUME: %s\nGBID: %s\n"
                           "HA: %d\nENTRYCREATE: INPROGRESS\nPRIOPATH: %s\n",
                           blk->volume, gbid, blk->mpath, cobj.prio_path);
   } else {
-    GB_METAUPDATE_OR_GOTO(lock, glfs, blk->block_name, blk->volume,
+    GB_METAUPDATE_OR_GOTO(glfs, blk->block_name, blk->volume,
                           errCode, errMsg, exist,
                           "VOLUME: %s\nGBID: %s\n"
                           "HA: %d\nENTRYCREATE: INPROGRESS\n",
                           blk->volume, gbid, blk->mpath);
   }
 
+  /* name and prio path are settled, the rest only concerns this block */
+  GB_METANSUNLOCK(lkfd, blk->volume);
+  GB_METALOCK_DOWNGRADE(lkfd, blk->volume, blk->block_name);
+
   if (glusterBlockCreateEntry(glfs, blk, gbid, &errCode, &errMsg)) {
     LOG("mgmt", GB_LOG_ERROR, "%s volume: %s block: %s file: %s host: %s",
         FAILED_CREATING_FILE, blk->volume, blk->block_name, gbid, blk->block_hosts);
@@ -1063,14 +1087,14 @@ block_create_cli_1_svc_st(blockCreateCli *blk, struct svc_req *rqstp)
   }
 
   if (!resultCaps[GB_CREATE_IO_TIMEOUT_CAP]) {
-    GB_METAUPDATE_OR_GOTO(lock, glfs, blk->block_name, blk->volume,
+    GB_METAUPDATE_OR_GOTO(glfs, blk->block_name, blk->volume,
                           errCode, errMsg, exist,
                           "SIZE: %zu\nRINGBUFFER: %u\nBLKSIZE: %u\n"
                           "IOTIMEOUT: %u\nENTRYCREATE: SUCCESS\n",
                           blk->size, blk->rb_size, blk->blk_size,
                           blk->io_timeout);
   } else {
-    GB_METAUPDATE_OR_GOTO(lock, glfs, blk->block_name, blk->volume,
+    GB_METAUPDATE_OR_GOTO(glfs, blk->block_name, blk->volume,
                           errCode, errMsg, exist,
                           "SIZE: %zu\nRINGBUFFER: %u\nBLKSIZE: %u\n"
                           "ENTRYCREATE: SUCCESS\n",
@@ -1131,7 +1155,7 @@ block_create_cli_1_svc_st(blockCreateCli *blk, struct svc_req *rqstp)
     GB_STRCPYSTATIC(cobj.passwd, passwd);
     cobj.auth_mode = 1;
 
-    GB_METAUPDATE_OR_GOTO(lock, glfs, blk->block_name, blk->volume,
+    GB_METAUPDATE_OR_GOTO(glfs, blk->block_name, blk->volume,
                           errCode, errMsg, exist, "PASSWORD: %s\n", passwd);
   }
 
@@ -1145,16 +1169,24 @@ block_create_cli_1_svc_st(blockCreateCli *blk, struct svc_req *rqstp)
   }
 
   /* Check Point */
-  errCode = glusterBlockAuditRequest(glfs, blk, &cobj, list, &savereply);
+  errCode = glusterBlockAuditRequest(glfs, blk, &cobj, list, &savereply, &info);
   if (errCode) {
     LOG("mgmt", GB_LOG_ERROR, "glusterBlockAuditRequest: return %d"
         " volume: %s hosts: %s blockname %s", errCode,
         blk->volume, blk->block_hosts, blk->block_name);
-  } else if (!resultCaps[GB_CREATE_LOAD_BALANCE_CAP] && cobj.prio_path[0]) {
-    blockIncPrioAttr(glfs, blk->volume, cobj.prio_path);
   }
 
  exist:
+  /* a failed create that took its metafile away holds no prio path */
+  if (errCode && cobj.prio_path[0] &&
+      glusterBlockMetaFileAccess(glfs, blk->block_name, F_OK) &&
+      errno == ENOENT &&
+      !glusterBlockMetaLock(lkfd, F_WRLCK, GB_METALOCK_NS_OFFSET, 1,
+                            blk->volume, NULL, &errMsg)) {
+    blockMovePrioCount(glfs, blk->volume, cobj.prio_path, NULL);
+  }
+  blockIndexCommit(glfs, lkfd, blk->volume, blk->block_name, journal);
+  blockMetaJournalRelease(journal);
   GB_METAUNLOCK(lkfd, blk->volume, errCode, errMsg);
 
  out:
@@ -1169,7 +1201,8 @@ block_create_cli_1_svc_st(blockCreateCli *blk, struct svc_req *rqstp)
       "create cli return %s, volume=%s blockname=%s",
       errCode ? "failure" : "success", blk->volume, blk->block_name);
 
-  blockCreateCliFormatResponse(glfs, blk, &cobj, errCode, errMsg, savereply, reply);
+  blockCreateCliFormatResponse(glfs, blk, &cobj, errCode, errMsg, savereply,
+                               info, reply);
   if (reply) {
     cmdlog = gbClipoffSensitiveDetails(reply->out);
   }
@@ -1178,10 +1211,12 @@ block_create_cli_1_svc_st(blockCreateCli *blk, struct svc_req *rqstp)
   GB_FREE(cmdlog);
   GB_FREE(errMsg);
   blockServerDefFree(list);
+  blockFreeMetaInfo(info);
   blockCreateParsedRespFree(savereply);
   GB_FREE (cobj.block_hosts);
   GB_FREE(resultCaps);
   GB_FREE(xdata);
+  glusterBlockVolumeRelease(glfs);
 
   return reply;
 }
@@ -25,7 +25,7 @@ glusterBlockDeleteRemote(void *data)
   bool rpc_sent = FALSE;
 
 
-  GB_METAUPDATE_OR_GOTO(lock, args->glfs, dobj.block_name, args->volume,
+  GB_METAUPDATE_OR_GOTO(args->glfs, dobj.block_name, args->volume,
                         ret, errMsg, out, "%s: CLEANUPINPROGRESS\n", args->addr);
 
   ret = glusterBlockCallRPC_1(args->addr, &dobj, DELETE_SRV, &rpc_sent,
@@ -43,7 +43,7 @@ glusterBlockDeleteRemote(void *data)
       args->reply = NULL;
     }
 
-    GB_METAUPDATE_OR_GOTO(lock, args->glfs, dobj.block_name, args->volume,
+    GB_METAUPDATE_OR_GOTO(args->glfs, dobj.block_name, args->volume,
                           ret, errMsg, out, "%s: CLEANUPFAIL\n", args->addr);
     LOG("mgmt", GB_LOG_ERROR, "%s for block %s on host %s volume %s",
         FAILED_REMOTE_DELETE, dobj.block_name, args->addr, args->volume);
@@ -51,7 +51,7 @@ glusterBlockDeleteRemote(void *data)
     ret = saveret;;
     goto out;
   }
-  GB_METAUPDATE_OR_GOTO(lock, args->glfs, dobj.block_name, args->volume,
+  GB_METAUPDATE_OR_GOTO(args->glfs, dobj.block_name, args->volume,
                         ret, errMsg, out, "%s: CLEANUPSUCCESS\n", args->addr);
 
  out:
@@ -77,7 +77,7 @@ glusterBlockDeleteFillArgs(MetaInfo *info, blockRemoteObj *args,
   unsigned int status;
 
   for (i = 0, count = 0; i < info->nhosts; i++) {
-    status = blockMetaStatusEnumParse(info->list[i]->status);
+    status = info->list[i]->st;
     if (status == GB_CONFIG_INPROGRESS || status == GB_CLEANUP_SUCCESS) {
       continue;
     }
@@ -101,7 +101,6 @@ glusterBlockDeleteRemoteAsync(char *blockname,
                               size_t count,
                               blockRemoteDeleteResp **savereply)
 {
-  pthread_t  *tid = NULL;
   blockRemoteDeleteResp *local = *savereply;
   blockRemoteObj *args = NULL;
   char *d_attempt = NULL;
@@ -110,23 +109,16 @@ glusterBlockDeleteRemoteAsync(char *blockname,
   char *s_tmp = NULL;
   int ret = -1;
   size_t i;
-  MetaInfo *info_new = NULL;
-  int cleanupsuccess = 0;
+  size_t cleanupsuccess;
 
 
-  if (GB_ALLOC_N(tid, count) < 0  || GB_ALLOC_N(args, count) < 0) {
+  if (GB_ALLOC_N(args, count) < 0) {
     goto out;
   }
 
   count = glusterBlockDeleteFillArgs(info, args, glfs, dobj);
 
-  for (i = 0; i < count; i++) {
-    pthread_create(&tid[i], NULL, glusterBlockDeleteRemote, &args[i]);
-  }
-
-  for (i = 0; i < count; i++) {
-    pthread_join(tid[i], NULL);
-  }
+  glusterBlockFanout(glusterBlockDeleteRemote, args, count, TIMEOUT.tv_sec);
 
   ret = glusterBlockCollectAttemptSuccess(args, info, DELETE_SRV, count,
                                           &d_attempt, &d_success);
@@ -155,26 +147,19 @@ glusterBlockDeleteRemoteAsync(char *blockname,
     s_tmp = local->d_success;
   }
 
+  /*
+   * Nodes skipped by glusterBlockDeleteFillArgs() are either untouched
+   * (CONFIGINPROGRESS) or already cleaned up, and a zero exit means this
+   * round logged CLEANUPSUCCESS for the node; no need to read the metafile
+   * back to find that out.
+   */
+  cleanupsuccess = info->nhosts - count;
   for (i = 0; i < count; i++) {
-    if (args[i].exit && args[i].exit == GB_BLOCK_NOT_FOUND) {
+    if (!args[i].exit || args[i].exit == GB_BLOCK_NOT_FOUND) {
       cleanupsuccess++;
     }
   }
 
-  /* get new MetaInfo and compare */
-  if (GB_ALLOC(info_new) < 0 || blockGetMetaInfo(glfs, blockname, info_new, NULL)) {
-    goto out;
-  }
-
-  for (i = 0; i < info_new->nhosts; i++) {
-    switch (blockMetaStatusEnumParse(info_new->list[i]->status)) {
-      case GB_CONFIG_INPROGRESS:  /* un touched */
-      case GB_CLEANUP_SUCCESS:
-        cleanupsuccess++;
-        break;
-    }
-  }
-
   if (cleanupsuccess == info->nhosts) {
     ret = 0;
   }
@@ -184,8 +169,6 @@ glusterBlockDeleteRemoteAsync(char *blockname,
   GB_FREE(d_attempt);
   GB_FREE(d_success);
   GB_FREE(args);
-  GB_FREE(tid);
-  GB_FREE(info_new);
 
   return ret;
 }
@@ -254,25 +237,32 @@ blockDeleteCliFormatResponse(blockDeleteCli *blk, int errCode, char *errMsg,
 }
 
 
+/*
+ * If the caller already holds a MetaInfo snapshot of the block (taken under
+ * the metalock), pass it in as info, else it is read here.
+ */
 int
-glusterBlockCleanUp(struct glfs *glfs, char *blockname,
+glusterBlockCleanUp(struct glfs *glfs, char *blockname, MetaInfo *info,
                     bool forcedel, bool unlink, blockRemoteDeleteResp *drobj)
 {
   int ret = -1;
   blockDelete dobj;
   size_t count = 0;
-  MetaInfo *info = NULL;
+  MetaInfo *local = NULL;
   int asyncret = 0;
   char *errMsg = NULL;
 
 
-  if (GB_ALLOC(info) < 0) {
-    goto out;
-  }
+  if (!info) {
+    if (GB_ALLOC(local) < 0) {
+      goto out;
+    }
 
-  ret = blockGetMetaInfo(glfs, blockname, info, NULL);
-  if (ret) {
-    goto out;
+    ret = blockGetMetaInfo(glfs, blockname, local, NULL);
+    if (ret) {
+      goto out;
+    }
+    info = local;
   }
 
   GB_STRCPYSTATIC(dobj.block_name, blockname);
@@ -292,17 +282,17 @@ glusterBlockCleanUp(struct glfs *glfs, char *blockname,
 
   /* delete metafile and block file */
   if (forcedel || !asyncret) {
-    GB_METAUPDATE_OR_GOTO(lock, glfs, blockname, info->volume,
+    GB_METAUPDATE_OR_GOTO(glfs, blockname, info->volume,
                           ret, errMsg, out, "ENTRYDELETE: INPROGRESS\n");
     if (unlink && glusterBlockDeleteEntry(glfs, info->volume, info->gbid)) {
-      GB_METAUPDATE_OR_GOTO(lock, glfs, blockname, info->volume,
+      GB_METAUPDATE_OR_GOTO(glfs, blockname, info->volume,
                             ret, errMsg, out, "ENTRYDELETE: FAIL\n");
       LOG("mgmt", GB_LOG_ERROR, "%s %s for block %s", FAILED_DELETING_FILE,
           info->volume, blockname);
       ret = -1;
       goto out;
     }
-    GB_METAUPDATE_OR_GOTO(lock, glfs, blockname, info->volume,
+    GB_METAUPDATE_OR_GOTO(glfs, blockname, info->volume,
                           ret, errMsg, out, "ENTRYDELETE: SUCCESS\n");
     ret = glusterBlockDeleteMetaFile(glfs, info->volume, blockname);
     if (ret) {
@@ -313,7 +303,7 @@ glusterBlockCleanUp(struct glfs *glfs, char *blockname,
   }
 
  out:
-  blockFreeMetaInfo(info);
+  blockFreeMetaInfo(local);
   GB_FREE (errMsg);
 
   /* ignore asyncret if force delete is used */
@@ -331,8 +321,9 @@ block_delete_cli_1_svc_st(blockDeleteCli *blk, struct svc_req *rqstp)
   blockRemoteDeleteResp *savereply = NULL;
   MetaInfo *info = NULL;
   blockResponse *reply = NULL;
-  struct glfs *glfs;
+  struct glfs *glfs = NULL;
   struct glfs_fd *lkfd = NULL;
+  struct MetaJournal *journal = NULL;
   char *errMsg = NULL;
   int errCode = -1;
   int ret;
@@ -360,17 +351,20 @@ block_delete_cli_1_svc_st(blockDeleteCli *blk, struct svc_req *rqstp)
     goto optfail;
   }
 
-  lkfd = glusterBlockCreateMetaLockFile(glfs, blk->volume, &errCode, &errMsg);
+  lkfd = glusterBlockCreateMetaLockFile(glfs, blk->volume, "delete",
+                                        &errCode, &errMsg);
   if (!lkfd) {
     LOG("mgmt", GB_LOG_ERROR, "%s %s for block %s",
         FAILED_CREATING_META, blk->volume, blk->block_name);
     goto optfail;
   }
 
-  GB_METALOCK_OR_GOTO(lkfd, blk->volume, errCode, errMsg, optfail);
+  GB_METABLKLOCK_OR_GOTO(lkfd, F_WRLCK, blk->volume, blk->block_name,
+                         errCode, errMsg, optfail);
+  journal = blockMetaJournalHold(glfs, blk->volume, blk->block_name);
   LOG("cmdlog", GB_LOG_INFO, "%s", blk->cmd);
 
-  if (glfs_access(glfs, blk->block_name, F_OK)) {
+  if (glusterBlockMetaFileAccess(glfs, blk->block_name, F_OK)) {
     errCode = errno;
     if (errCode == ENOENT) {
       GB_ASPRINTF(&errMsg, "block %s/%s doesn't exist",
@@ -414,18 +408,23 @@ block_delete_cli_1_svc_st(blockDeleteCli *blk, struct svc_req *rqstp)
     }
   }
 
-  errCode = glusterBlockCleanUp(glfs, blk->block_name, blk->force, blk->unlink, savereply);
+  GB_METALOCK_DOWNGRADE(lkfd, blk->volume, blk->block_name);
+  errCode = glusterBlockCleanUp(glfs, blk->block_name, info, blk->force,
+                                blk->unlink, savereply);
   if (errCode) {
     LOG("mgmt", GB_LOG_WARNING, "glusterBlockCleanUp: return %d "
         "on block %s for volume %s", errCode, blk->block_name, blk->volume);
   } else if (info->prio_path[0]) {
-    blockDecPrioAttr(glfs, blk->volume, info->prio_path);
+    GB_METANSLOCK_OR_GOTO(lkfd, F_WRLCK, blk->volume, errCode, errMsg, out);
+    blockMovePrioCount(glfs, blk->volume, info->prio_path, NULL);
   }
 
  out:
+  blockIndexCommit(glfs, lkfd, blk->volume, blk->block_name, journal);
+  blockMetaJournalRelease(journal);
   GB_METAUNLOCK(lkfd, blk->volume, errCode, errMsg);
   blockServerDefFree(list);
-  GB_FREE(info);
+  blockFreeMetaInfo(info);
 
  optfail:
   LOG("mgmt", ((!!errCode) ? GB_LOG_ERROR : GB_LOG_INFO),
@@ -437,6 +436,7 @@ block_delete_cli_1_svc_st(blockDeleteCli *blk, struct svc_req *rqstp)
         "glfs_close(%s): for block %s on volume %s failed[%s]",
         GB_TXLOCKFILE, blk->block_name, blk->volume, strerror(errno));
   }
+  glusterBlockVolumeRelease(glfs);
 
   blockDeleteCliFormatResponse(blk, errCode, errMsg, savereply, reply);
   LOG("cmdlog", ((!!errCode) ? GB_LOG_ERROR : GB_LOG_INFO), "%s",
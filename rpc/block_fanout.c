@@ -0,0 +1,198 @@
+/*
+  Copyright (c) 2016 Red Hat, Inc. <http://www.redhat.com>
+  This file is part of gluster-block.
+
+  This file is licensed to you under your choice of the GNU Lesser
+  General Public License, version 3 or any later version (LGPLv3 or
+  later), or the GNU General Public License, version 2 (GPLv2), in all
+  cases as published by the Free Software Foundation.
+*/
+
+
+# include  "block_common.h"
+# include  "workqueue.h"
+
+# define   GB_FANOUT_THREADS    32   /* shared by all fan-outs of the process */
+
+
+typedef struct gbFanoutTask {
+  void *(*fn)(void *);
+  void *arg;
+  time_t timeout;             /* 0 if none */
+  struct timespec deadline;   /* timeout from when the task started */
+  gbWork *work;               /* NULL if it is left to run in the waiter */
+} gbFanoutTask;
+
+struct gbFanout {
+  time_t timeout;
+  size_t ntasks;
+  size_t max;
+  gbFanoutTask *tasks;
+};
+
+
+static gbWorkQueue *fanoutPool;
+static pthread_once_t fanoutOnce = PTHREAD_ONCE_INIT;
+
+/* deadline of the fan-out task the thread is running, for the rpc layer */
+static __thread struct timespec *fanoutDeadline;
+
+
+static void
+fanoutPoolInit(void)
+{
+  fanoutPool = gbWorkQueueCreate("fanout", GB_FANOUT_THREADS);
+  if (!fanoutPool) {
+    LOG("mgmt", GB_LOG_WARNING, "%s",
+        "failed to start fan-out workers, remote calls will run one by one");
+  }
+}
+
+
+static void
+fanoutRun(void *data)
+{
+  gbFanoutTask *task = data;
+  struct timespec *saved = fanoutDeadline;
+
+
+  fanoutDeadline = NULL;
+  if (task->timeout) {
+    clock_gettime(CLOCK_MONOTONIC, &task->deadline);
+    task->deadline.tv_sec += task->timeout;
+    fanoutDeadline = &task->deadline;
+  }
+  task->fn(task->arg);
+  fanoutDeadline = saved;
+}
+
+
+/*
+ * Start a fan-out of up to max remote calls, each of which should be done
+ * within timeout seconds from when it starts, 0 for no deadline; time
+ * spent queued behind other fan-outs doesn't count. On allocation
+ * failure NULL is returned, which the other calls take to mean that the
+ * calls run one after the other in the caller.
+ */
+gbFanout *
+glusterBlockFanoutNew(size_t max, time_t timeout)
+{
+  gbFanout *fo;
+
+
+  pthread_once(&fanoutOnce, fanoutPoolInit);
+
+  if (GB_ALLOC(fo) < 0) {
+    return NULL;
+  }
+  if (GB_ALLOC_N(fo->tasks, max) < 0) {
+    GB_FREE(fo);
+    return NULL;
+  }
+  fo->max = max;
+  fo->timeout = timeout;
+
+  return fo;
+}
+
+
+/* queue fn(arg) on the shared workers, arg must live until the wait */
+void
+glusterBlockFanoutAdd(gbFanout *fo, void *(*fn)(void *), void *arg)
+{
+  gbFanoutTask *task;
+
+
+  if (!fo || fo->ntasks == fo->max) {
+    fn(arg);
+    return;
+  }
+
+  task = &fo->tasks[fo->ntasks++];
+  task->fn = fn;
+  task->arg = arg;
+  task->timeout = fo->timeout;
+
+  if (fanoutPool) {
+    task->work = gbWorkQueueSubmit(fanoutPool, fanoutRun, task);
+  }
+}
+
+
+/* wait for every call of the fan-out to finish, then free it */
+void
+glusterBlockFanoutWait(gbFanout *fo)
+{
+  size_t i;
+
+
+  if (!fo) {
+    return;
+  }
+
+  /*
+   * Everything no worker has picked up yet runs here, the ones we couldn't
+   * queue included, so that only tasks already running are waited for.
+   */
+  for (i = 0; i < fo->ntasks; i++) {
+    if (!fo->tasks[i].work ||
+        gbWorkTake(fanoutPool, fo->tasks[i].work)) {
+      fo->tasks[i].work = NULL;
+      fanoutRun(&fo->tasks[i]);
+    }
+  }
+
+  for (i = 0; i < fo->ntasks; i++) {
+    if (fo->tasks[i].work) {
+      gbWorkWait(fanoutPool, fo->tasks[i].work);
+    }
+  }
+
+  GB_FREE(fo->tasks);
+  GB_FREE(fo);
+}
+
+
+/* run fn on each of args[0..count) in parallel and wait for all of them */
+void
+glusterBlockFanout(void *(*fn)(void *), blockRemoteObj *args, size_t count,
+                   time_t timeout)
+{
+  gbFanout *fo;
+  size_t i;
+
+
+  fo = glusterBlockFanoutNew(count, timeout);
+  for (i = 0; i < count; i++) {
+    glusterBlockFanoutAdd(fo, fn, &args[i]);
+  }
+  glusterBlockFanoutWait(fo);
+}
+
+
+/*
+ * Time left until the deadline of the fan-out task the calling thread is
+ * running, zero once it passed. Returns false outside of a fan-out.
+ */
+bool
+glusterBlockFanoutTimeLeft(struct timeval *tv)
+{
+  struct timespec now;
+  long long left;
+
+
+  if (!fanoutDeadline) {
+    return false;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  left = (fanoutDeadline->tv_sec - now.tv_sec) * 1000000LL +
+         (fanoutDeadline->tv_nsec - now.tv_nsec) / 1000;
+  if (left < 0) {
+    left = 0;
+  }
+  tv->tv_sec = left / 1000000;
+  tv->tv_usec = left % 1000000;
+
+  return true;
+}
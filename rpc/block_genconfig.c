@@ -11,8 +11,6 @@
 
 # include  "block_common.h"
 
-# define   GB_ALUA_AO_TPG_NAME          "glfs_tg_pt_gp_ao"
-# define   GB_ALUA_ANO_TPG_NAME         "glfs_tg_pt_gp_ano"
 
 
 static struct json_object *
@@ -221,22 +219,125 @@ getSoObj(char *block, MetaInfo *info, blockGenConfigCli *blk)
 }
 
 
+/* adds the block to the config if blk->addr is one of its healthy hosts */
+static void
+blockGenConfigAdd(struct soTgObj *obj, blockGenConfigCli *blk, char *block,
+                  MetaInfo *info)
+{
+  bool partOfBlock = false;
+  size_t j;
+
+
+  for (j = 0; j < info->nhosts; j++) {
+    if (blockhostIsValid(info->list[j]->status) && !strcmp(info->list[j]->addr, blk->addr)) {
+      partOfBlock = true;
+    }
+  }
+  if (!partOfBlock) {
+    return;
+  }
+
+  /* storage_objects */
+  json_object_array_add(obj->so_arr, getSoObj(block, info, blk));
+
+  /* targets */
+  json_object_array_add(obj->tg_arr, getTgObj(block, info, blk));
+}
+
+
+/*
+ * Gives a block without a prio path one. Like any op writing to a block,
+ * this takes the block's lock before the namespace lock, so that a delete
+ * or a compaction renaming the metafile can't slip in between the check
+ * and the append. *info gets the block's metadata as of then, NULL if the
+ * block is gone.
+ */
+static int
+blockGenConfigSetPrio(struct glfs *glfs, struct glfs_fd *lkfd, char *volume,
+                      char *block, MetaInfo **info, char **errMsg,
+                      int *errCode)
+{
+  blockServerDefPtr list = NULL;
+  bool locked = false;
+  int err = 0;
+  int ret = -1;
+
+
+  *info = NULL;
+  GB_METABLKLOCK_OR_GOTO(lkfd, F_WRLCK, volume, block, *errCode, *errMsg,
+                         out);
+  locked = true;
+  GB_METANSLOCK_OR_GOTO(lkfd, F_WRLCK, volume, *errCode, *errMsg, out);
+
+  if (GB_ALLOC(*info) < 0) {
+    goto out;
+  }
+  if (blockGetMetaInfoCached(glfs, volume, block, *info, &err)) {
+    if (err == ENOENT) {
+      /* deleted since the scan */
+      blockFreeMetaInfo(*info);
+      *info = NULL;
+      ret = 0;
+    }
+    goto out;
+  }
+  if ((*info)->prio_path[0]) {
+    ret = 0;
+    goto out;
+  }
+
+  /* default as the load balancing is enabled */
+  list = blockMetaInfoToServerParse(*info);
+  if (!list) {
+    goto out;
+  }
+  blockGetPrioPath(glfs, volume, list, (*info)->prio_path,
+                   sizeof((*info)->prio_path));
+  if (!(*info)->prio_path[0]) {
+    ret = 0;
+    goto out;
+  }
+
+  GB_METAUPDATE_OR_GOTO(glfs, block, volume, *errCode, *errMsg, undo,
+                        "PRIOPATH: %s\n", (*info)->prio_path);
+  blockIndexCommit(glfs, NULL, volume, block, NULL);
+  ret = 0;
+  goto out;
+
+ undo:
+  blockMovePrioCount(glfs, volume, (*info)->prio_path, NULL);
+
+ out:
+  if (locked) {
+    GB_METANSUNLOCK(lkfd, volume);
+    glusterBlockMetaUnlock(lkfd, glusterBlockMetaLockOffset(block), 1, volume);
+  }
+  if (ret) {
+    blockFreeMetaInfo(*info);
+    *info = NULL;
+  }
+  blockServerDefFree(list);
+
+  return ret;
+}
+
+
 static int
 getSoTgArraysForAllVolume(struct soTgObj *obj, blockGenConfigCli *blk,
                           char **errMsg, int *errCode)
 {
-  struct glfs *glfs;
+  struct glfs *glfs = NULL;
   struct glfs_fd *lkfd = NULL;
-  struct glfs_fd *tgmdfd = NULL;
-  struct dirent *entry;
   MetaInfo *info = NULL;
+  BlockIndex *index = NULL;
+  BlockIndexEntry *e;
   strToCharArrayDefPtr vols;
-  size_t i, j;
+  char **pending = NULL;
+  size_t npending = 0;
+  size_t i, k;
   int ret = -1;
-  bool partOfBlock;
-  blockServerDefPtr list = NULL;
-  struct json_object *so_obj = NULL;
-  struct json_object *tg_obj = NULL;
+  int err;
+  bool dirty;
 
 
   vols = getCharArrayFromDelimitedStr(blk->volume, GB_DELIMITER);
@@ -254,88 +355,98 @@ getSoTgArraysForAllVolume(struct soTgObj *obj, blockGenConfigCli *blk,
       goto optfail;
     }
 
-    lkfd = glusterBlockCreateMetaLockFile(glfs, vols->data[i], errCode, errMsg);
+    lkfd = glusterBlockCreateMetaLockFile(glfs, vols->data[i], "genconfig",
+                                          errCode, errMsg);
     if (!lkfd) {
       LOG("mgmt", GB_LOG_ERROR, "%s %s", FAILED_CREATING_META, vols->data[i]);
       goto optfail;
     }
 
-    GB_METALOCK_OR_GOTO(lkfd, vols->data[i], *errCode, *errMsg, out);
+    /* exclusive, the index may get written back below */
+    GB_METANSLOCK_OR_GOTO(lkfd, F_WRLCK, vols->data[i], *errCode, *errMsg, out);
 
-    tgmdfd = glfs_opendir(glfs, GB_METADIR);
-    if (!tgmdfd) {
-      *errCode = errno;
-      GB_ASPRINTF(errMsg, "Not able to open metadata directory for volume "
-          "%s[%s]", vols->data[i], strerror(*errCode));
-      LOG("mgmt", GB_LOG_ERROR, "glfs_opendir(%s): on volume %s failed[%s]",
-          GB_METADIR, vols->data[i], strerror(errno));
+    /* blocks the index places on other hosts need not be opened */
+    if (blockIndexLoad(glfs, vols->data[i], &index, &dirty, errCode)) {
+      GB_ASPRINTF(errMsg, "Not able to load index of volume %s[%s]",
+                  vols->data[i], strerror(*errCode));
       ret = -1;
       goto out;
     }
 
-    while ((entry = glfs_readdir(tgmdfd))) {
-      if (!strchr(entry->d_name, '.')) {
-        if (GB_ALLOC(info) < 0) {
-          ret = -1;
-          goto out;
-        }
-        ret = blockGetMetaInfo(glfs, entry->d_name, info, NULL);
-        if (ret) {
-          goto out;
-        }
-
-        if (!info->prio_path[0]) {
-          if (list) {
-            /* if 'list' is set, it means, it came here continuing the loop */
-            blockServerDefFree(list);
-          }
-
-          /* default as the load balancing is enabled */
-          list = blockMetaInfoToServerParse(info);
-          if (!list) {
-            ret = -1;
-            goto out;
-          }
-
-          blockGetPrioPath(glfs, blk->volume, list, info->prio_path, sizeof(info->prio_path));
-          blockIncPrioAttr(glfs, blk->volume, info->prio_path);
+    for (k = 0; k < index->nblocks; k++) {
+      e = index->blocks[k];
+      if (e->prio_path[0] && !blockIndexHasHost(e, blk->addr)) {
+        continue;
+      }
 
-          GB_METAUPDATE_OR_GOTO(lock, glfs, entry->d_name, vols->data[i],
-                                *errCode, *errMsg, out, "PRIOPATH: %s\n", info->prio_path);
+      if (GB_ALLOC(info) < 0) {
+        ret = -1;
+        goto out;
+      }
+      err = 0;
+      ret = blockGetMetaInfoCached(glfs, vols->data[i], e->name, info, &err);
+      if (ret) {
+        if (err != ENOENT) {
+          goto out;
         }
+        /* deleted under us, its block lock is all a delete holds */
+        blockFreeMetaInfo(info);
+        info = NULL;
+        continue;
+      }
 
-        partOfBlock = false;
-        for (j = 0; j < info->nhosts; j++) {
-          if (blockhostIsValid(info->list[j]->status) && !strcmp(info->list[j]->addr, blk->addr)) {
-            partOfBlock = true;
-          }
-        }
-        if (!partOfBlock) {
-          blockFreeMetaInfo(info);
-          continue;
+      /* taken care of once the namespace lock is given up */
+      if (!info->prio_path[0]) {
+        if (GB_REALLOC_N(pending, npending + 1) < 0 ||
+            GB_STRDUP(pending[npending], e->name) < 0) {
+          ret = -1;
+          goto out;
         }
+        npending++;
+        blockFreeMetaInfo(info);
+        info = NULL;
+        continue;
+      }
 
-        /* storage_objects */
-        so_obj = getSoObj(entry->d_name, info, blk);
-        json_object_array_add(obj->so_arr, so_obj);
-
-        /* targets */
-        tg_obj = getTgObj(entry->d_name, info, blk);
-        json_object_array_add(obj->tg_arr, tg_obj);
+      blockGenConfigAdd(obj, blk, e->name, info);
+      blockFreeMetaInfo(info);
+      info = NULL;
+    }
 
+    if (dirty || blockIndexNeedsRewrite(index)) {
+      blockIndexWrite(glfs, vols->data[i], index, &err);
+    }
+    blockIndexFree(index);
+    index = NULL;
+
+    /* block locks come before the namespace lock */
+    GB_METANSUNLOCK(lkfd, vols->data[i]);
+    for (k = 0; k < npending; k++) {
+      ret = blockGenConfigSetPrio(glfs, lkfd, vols->data[i], pending[k],
+                                  &info, errMsg, errCode);
+      if (ret) {
+        goto out;
+      }
+      if (info) {
+        blockGenConfigAdd(obj, blk, pending[k], info);
         blockFreeMetaInfo(info);
+        info = NULL;
       }
     }
+    for (k = 0; k < npending; k++) {
+      GB_FREE(pending[k]);
+    }
+    GB_FREE(pending);
+    npending = 0;
 
     GB_METAUNLOCK(lkfd, vols->data[i], *errCode, *errMsg);
-    if (tgmdfd && glfs_closedir (tgmdfd) != 0) {
-      LOG("mgmt", GB_LOG_ERROR, "glfs_closedir(%s): on volume %s failed[%s]",
-          GB_METADIR, vols->data[i], strerror(errno));
-    }
     if (lkfd && glfs_close(lkfd) != 0) {
       LOG("mgmt", GB_LOG_ERROR, "glfs_close(%s): on volume %s failed[%s]",
           GB_TXLOCKFILE, vols->data[i], strerror(errno));
     }
+    lkfd = NULL;
+    glusterBlockVolumeRelease(glfs);
+    glfs = NULL;
   }
 
   ret = 0;
@@ -343,21 +454,22 @@ getSoTgArraysForAllVolume(struct soTgObj *obj, blockGenConfigCli *blk,
 
  out:
   GB_METAUNLOCK(lkfd, vols->data[i], *errCode, *errMsg);
-  if (tgmdfd && glfs_closedir (tgmdfd) != 0) {
-    LOG("mgmt", GB_LOG_ERROR, "glfs_closedir(%s): on volume %s failed[%s]",
-        GB_METADIR, vols->data[i], strerror(errno));
-  }
   blockFreeMetaInfo(info);
+  blockIndexFree(index);
 
  optfail:
   if (lkfd && glfs_close(lkfd) != 0) {
     LOG("mgmt", GB_LOG_ERROR, "glfs_close(%s): on volume %s failed[%s]",
         GB_TXLOCKFILE, vols->data[i], strerror(errno));
   }
+  glusterBlockVolumeRelease(glfs);
 
  free:
+  for (k = 0; k < npending; k++) {
+    GB_FREE(pending[k]);
+  }
+  GB_FREE(pending);
   strToCharArrayDefFree(vols);
-  blockServerDefFree(list);
 
   return ret;
 }
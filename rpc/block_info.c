@@ -82,7 +82,7 @@ blockInfoCliFormatResponse(blockInfoCli *blk, int errCode,
       if (blockhostIsValid (info->list[i]->status)) {
         json_object_array_add(json_array1, GB_JSON_OBJ_TO_STR(info->list[i]->addr));
       } else {
-        switch (blockMetaStatusEnumParse(info->list[i]->status)) {
+        switch (info->list[i]->st) {
         case GB_CONFIG_FAIL:
         case GB_CLEANUP_FAIL:
           if (!json_array2) {
@@ -92,7 +92,7 @@ blockInfoCliFormatResponse(blockInfoCli *blk, int errCode,
           break;
         }
       }
-      switch (blockMetaStatusEnumParse(info->list[i]->status)) {
+      switch (info->list[i]->st) {
       case GB_RS_FAIL:
       case GB_RS_INPROGRESS:
         GB_FREE(hr_size);
@@ -137,7 +137,7 @@ blockInfoCliFormatResponse(blockInfoCli *blk, int errCode,
         GB_FREE (tmp);
         tmp = out;
       } else {
-        switch (blockMetaStatusEnumParse(info->list[i]->status)) {
+        switch (info->list[i]->st) {
         case GB_CONFIG_FAIL:
         case GB_CLEANUP_FAIL:
           if (GB_ASPRINTF(&tmp2, "%s %s", tmp3?tmp3:"", info->list[i]->addr) == -1) {
@@ -150,7 +150,7 @@ blockInfoCliFormatResponse(blockInfoCli *blk, int errCode,
         }
       }
       tmp4 = rsf_nodes;
-      switch (blockMetaStatusEnumParse(info->list[i]->status)) {
+      switch (info->list[i]->st) {
       case GB_RS_FAIL:
       case GB_RS_INPROGRESS:
         GB_FREE(hr_size);
@@ -210,7 +210,7 @@ static blockResponse *
 block_info_cli_1_svc_st(blockInfoCli *blk, struct svc_req *rqstp)
 {
   blockResponse *reply = NULL;
-  struct glfs *glfs;
+  struct glfs *glfs = NULL;
   struct glfs_fd *lkfd = NULL;
   MetaInfo *info = NULL;
   int errCode = -1;
@@ -236,16 +236,19 @@ block_info_cli_1_svc_st(blockInfoCli *blk, struct svc_req *rqstp)
     goto optfail;
   }
 
-  lkfd = glusterBlockCreateMetaLockFile(glfs, blk->volume, &errCode, &errMsg);
+  lkfd = glusterBlockCreateMetaLockFile(glfs, blk->volume, "info",
+                                        &errCode, &errMsg);
   if (!lkfd) {
     LOG("mgmt", GB_LOG_ERROR, "%s %s for block %s",
         FAILED_CREATING_META, blk->volume, blk->block_name);
     goto optfail;
   }
 
-  GB_METALOCK_OR_GOTO(lkfd, blk->volume, errCode, errMsg, optfail);
+  GB_METABLKLOCK_OR_GOTO(lkfd, F_RDLCK, blk->volume, blk->block_name,
+                         errCode, errMsg, optfail);
 
-  if (blockGetMetaInfo(glfs, blk->block_name, info, &errCode)) {
+  if (blockGetMetaInfoCached(glfs, blk->volume, blk->block_name, info,
+                             &errCode)) {
     if (errCode == ENOENT) {
       GB_ASPRINTF (&errMsg, "block %s/%s doesn't exist", blk->volume,
                    blk->block_name);
@@ -269,7 +272,7 @@ block_info_cli_1_svc_st(blockInfoCli *blk, struct svc_req *rqstp)
         "glfs_close(%s): on volume %s for block %s failed[%s]",
         GB_TXLOCKFILE, blk->volume, blk->block_name, strerror(errno));
   }
-
+  glusterBlockVolumeRelease(glfs);
 
   blockInfoCliFormatResponse(blk, errCode, errMsg, info, reply);
   if (reply) {
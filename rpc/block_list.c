@@ -16,7 +16,7 @@ static blockResponse *
 block_list_cli_1_svc_st(blockListCli *blk, struct svc_req *rqstp)
 {
   blockResponse *reply = NULL;
-  struct glfs *glfs;
+  struct glfs *glfs = NULL;
   struct glfs_fd *lkfd = NULL;
   struct glfs_fd *tgmdfd = NULL;
   struct dirent *entry;
@@ -47,13 +47,14 @@ block_list_cli_1_svc_st(blockListCli *blk, struct svc_req *rqstp)
     goto optfail;
   }
 
-  lkfd = glusterBlockCreateMetaLockFile(glfs, blk->volume, &errCode, &errMsg);
+  lkfd = glusterBlockCreateMetaLockFile(glfs, blk->volume, "list",
+                                        &errCode, &errMsg);
   if (!lkfd) {
     LOG("mgmt", GB_LOG_ERROR, "%s %s", FAILED_CREATING_META, blk->volume);
     goto optfail;
   }
 
-  GB_METALOCK_OR_GOTO(lkfd, blk->volume, errCode, errMsg, optfail);
+  GB_METANSLOCK_OR_GOTO(lkfd, F_RDLCK, blk->volume, errCode, errMsg, optfail);
 
   tgmdfd = glfs_opendir (glfs, GB_METADIR);
   if (!tgmdfd) {
@@ -143,6 +144,7 @@ block_list_cli_1_svc_st(blockListCli *blk, struct svc_req *rqstp)
     LOG("mgmt", GB_LOG_ERROR, "glfs_close(%s): on volume %s failed[%s]",
         GB_TXLOCKFILE, blk->volume, strerror(errno));
   }
+  glusterBlockVolumeRelease(glfs);
 
   GB_FREE(errMsg);
 
@@ -0,0 +1,253 @@
+/*
+  Copyright (c) 2016 Red Hat, Inc. <http://www.redhat.com>
+  This file is part of gluster-block.
+
+  This file is licensed to you under your choice of the GNU Lesser
+  General Public License, version 3 or any later version (LGPLv3 or
+  later), or the GNU General Public License, version 2 (GPLv2), in all
+  cases as published by the Free Software Foundation.
+*/
+
+
+# include  "block_common.h"
+
+
+/* every host with a valid state in any of the volume's metafiles */
+static int
+blockMigrateAddHosts(blockServerDefPtr list, MetaInfo *info)
+{
+  size_t i, j;
+
+
+  for (i = 0; i < info->nhosts; i++) {
+    if (!blockhostIsValid(info->list[i]->status)) {
+      continue;
+    }
+    for (j = 0; j < list->nhosts; j++) {
+      if (!strcmp(list->hosts[j], info->list[i]->addr)) {
+        break;
+      }
+    }
+    if (j < list->nhosts) {
+      continue;
+    }
+    if (GB_REALLOC_N(list->hosts, list->nhosts + 1) < 0 ||
+        GB_STRDUP(list->hosts[list->nhosts], info->list[i]->addr) < 0) {
+      return -1;
+    }
+    list->nhosts++;
+  }
+
+  return 0;
+}
+
+
+static blockResponse *
+block_migrate_cli_1_svc_st(blockMigrateCli *blk, struct svc_req *rqstp)
+{
+  blockResponse *reply = NULL;
+  struct glfs *glfs = NULL;
+  struct glfs_fd *lkfd = NULL;
+  struct glfs_fd *tgmdfd = NULL;
+  struct dirent *entry;
+  blockServerDefPtr list = NULL;
+  MetaInfo *info = NULL;
+  json_object *json_obj = NULL;
+  char **names = NULL;
+  size_t nnames = 0;
+  size_t migrated = 0;
+  size_t failed = 0;
+  bool done;
+  int errCode = -1;
+  char *errMsg = NULL;
+  size_t i;
+
+
+  LOG("mgmt", GB_LOG_INFO, "migrate cli request, volume=%s version=%u",
+      blk->volume, blk->meta_version);
+
+  if (GB_ALLOC(reply) < 0) {
+    return NULL;
+  }
+
+  if (blk->meta_version != GB_METAFILE_V1 && blk->meta_version != GB_METAFILE_V2) {
+    errCode = EINVAL;
+    GB_ASPRINTF(&errMsg, "unknown metadata format v%u", blk->meta_version);
+    goto optfail;
+  }
+
+  errCode = 0;
+  glfs = glusterBlockVolumeInit(blk->volume, &errCode, &errMsg);
+  if (!glfs) {
+    LOG("mgmt", GB_LOG_ERROR,
+        "glusterBlockVolumeInit(%s) failed", blk->volume);
+    goto optfail;
+  }
+
+  lkfd = glusterBlockCreateMetaLockFile(glfs, blk->volume, "migrate",
+                                        &errCode, &errMsg);
+  if (!lkfd) {
+    LOG("mgmt", GB_LOG_ERROR, "%s %s", FAILED_CREATING_META, blk->volume);
+    goto optfail;
+  }
+
+  /* all of meta.lock: no op may append while its metafile gets rewritten */
+  GB_METALOCK_OR_GOTO(lkfd, blk->volume, errCode, errMsg, optfail);
+  LOG("cmdlog", GB_LOG_INFO, "%s", blk->cmd);
+
+  tgmdfd = glfs_opendir(glfs, GB_METADIR);
+  if (!tgmdfd) {
+    errCode = errno;
+    GB_ASPRINTF(&errMsg, "Not able to open metadata directory for volume "
+                "%s[%s]", blk->volume, strerror(errCode));
+    LOG("mgmt", GB_LOG_ERROR, "glfs_opendir(%s): on volume %s failed[%s]",
+        GB_METADIR, blk->volume, strerror(errCode));
+    goto out;
+  }
+
+  while ((entry = glfs_readdir(tgmdfd))) {
+    if (strchr(entry->d_name, '.')) {
+      continue;
+    }
+    if (GB_REALLOC_N(names, nnames + 1) < 0 ||
+        GB_STRDUP(names[nnames], entry->d_name) < 0) {
+      errCode = ENOMEM;
+      goto out;
+    }
+    nnames++;
+  }
+
+  /* v2 metafiles are garbage to a peer without the capability */
+  if (blk->meta_version == GB_METAFILE_V2) {
+    if (GB_ALLOC(list) < 0) {
+      errCode = ENOMEM;
+      goto out;
+    }
+    for (i = 0; i < nnames; i++) {
+      if (GB_ALLOC(info) < 0) {
+        errCode = ENOMEM;
+        goto out;
+      }
+      if (!blockGetMetaInfoCached(glfs, blk->volume, names[i], info, NULL) &&
+          blockMigrateAddHosts(list, info)) {
+        errCode = ENOMEM;
+        goto out;
+      }
+      blockFreeMetaInfo(info);
+      info = NULL;
+    }
+
+    errCode = glusterBlockCheckCapabilities((void *)blk, MIGRATE_SRV, list,
+                                            NULL, &errMsg);
+    if (errCode) {
+      LOG("mgmt", GB_LOG_ERROR,
+          "glusterBlockCheckCapabilities() for volume %s failed",
+          blk->volume);
+      goto out;
+    }
+  }
+
+  if (glusterBlockSetMetaVersion(glfs, blk->volume, blk->meta_version)) {
+    errCode = errno;
+    GB_ASPRINTF(&errMsg, "Not able to set metadata format of volume %s[%s]",
+                blk->volume, strerror(errCode));
+    goto out;
+  }
+
+  for (i = 0; i < nnames; i++) {
+    if (glusterBlockMigrateMetaFile(glfs, blk->volume, names[i], blk->meta_version,
+                                    &done)) {
+      failed++;
+    } else if (done) {
+      migrated++;
+    }
+  }
+
+  /* what wasn't migrated is still readable, a rerun picks it up */
+  if (failed) {
+    errCode = EIO;
+    GB_ASPRINTF(&errMsg, "%zu of %zu metafiles of volume %s failed to "
+                "migrate to v%u, see the logs and retry", failed, nnames,
+                blk->volume, blk->meta_version);
+    goto out;
+  }
+
+  errCode = 0;
+
+ out:
+  GB_METAUNLOCK(lkfd, blk->volume, errCode, errMsg);
+
+ optfail:
+  LOG("mgmt", ((!!errCode) ? GB_LOG_ERROR : GB_LOG_INFO),
+      "migrate cli return %s, volume=%s blocks=%zu migrated=%zu",
+      errCode ? "failure" : "success", blk->volume, nnames, migrated);
+
+  if (tgmdfd && glfs_closedir(tgmdfd) != 0) {
+    LOG("mgmt", GB_LOG_ERROR, "glfs_closedir(%s): on volume %s failed[%s]",
+        GB_METADIR, blk->volume, strerror(errno));
+  }
+
+  if (errCode < 0) {
+    errCode = GB_DEFAULT_ERRCODE;
+  }
+
+  reply->exit = errCode;
+
+  if (blk->json_resp) {
+    json_obj = json_object_new_object();
+    if (errCode) {
+      json_object_object_add(json_obj, "RESULT", GB_JSON_OBJ_TO_STR("FAIL"));
+      json_object_object_add(json_obj, "errCode", json_object_new_int(errCode));
+      json_object_object_add(json_obj, "errMsg",  GB_JSON_OBJ_TO_STR(errMsg));
+    } else {
+      json_object_object_add(json_obj, "BLOCKS", json_object_new_int64(nnames));
+      json_object_object_add(json_obj, "MIGRATED", json_object_new_int64(migrated));
+      json_object_object_add(json_obj, "RESULT", GB_JSON_OBJ_TO_STR("SUCCESS"));
+    }
+    GB_ASPRINTF(&reply->out, "%s\n",
+                json_object_to_json_string_ext(json_obj,
+                                mapJsonFlagToJsonCstring(blk->json_resp)));
+    json_object_put(json_obj);
+  } else {
+    if (errCode) {
+      if (errMsg) {
+        GB_ASPRINTF (&reply->out, "%s\n", errMsg);
+      } else {
+        GB_ASPRINTF (&reply->out, "Not able to complete operation "
+                     "successfully\n");
+      }
+    } else {
+      GB_ASPRINTF(&reply->out, "BLOCKS: %zu\nMIGRATED: %zu\nRESULT: SUCCESS\n",
+                  nnames, migrated);
+    }
+  }
+  LOG("cmdlog", ((!!errCode) ? GB_LOG_ERROR : GB_LOG_INFO), "%s",
+      reply->out ? reply->out : "*Nil*");
+
+  if (lkfd && glfs_close(lkfd) != 0) {
+    LOG("mgmt", GB_LOG_ERROR, "glfs_close(%s): on volume %s failed[%s]",
+        GB_TXLOCKFILE, blk->volume, strerror(errno));
+  }
+  glusterBlockVolumeRelease(glfs);
+
+  for (i = 0; i < nnames; i++) {
+    GB_FREE(names[i]);
+  }
+  GB_FREE(names);
+  blockFreeMetaInfo(info);
+  blockServerDefFree(list);
+  GB_FREE(errMsg);
+
+  return reply;
+}
+
+
+bool_t
+block_migrate_cli_1_svc(blockMigrateCli *blk, blockResponse *reply,
+                        struct svc_req *rqstp)
+{
+  int ret;
+
+  GB_RPC_CALL(migrate_cli, blk, reply, rqstp, ret);
+  return ret;
+}
@@ -23,7 +23,7 @@ glusterBlockModifyRemote(void *data)
   bool rpc_sent = FALSE;
 
 
-  GB_METAUPDATE_OR_GOTO(lock, args->glfs, cobj.block_name, cobj.volume,
+  GB_METAUPDATE_OR_GOTO(args->glfs, cobj.block_name, cobj.volume,
                         ret, errMsg, out, "%s: AUTH%sENFORCEING\n", args->addr,
                         cobj.auth_mode?"":"CLEAR");
 
@@ -42,7 +42,7 @@ glusterBlockModifyRemote(void *data)
       args->reply = NULL;
     }
 
-    GB_METAUPDATE_OR_GOTO(lock, args->glfs, cobj.block_name, cobj.volume,
+    GB_METAUPDATE_OR_GOTO(args->glfs, cobj.block_name, cobj.volume,
                           ret, errMsg, out, "%s: AUTH%sENFORCEFAIL\n",
                           args->addr, cobj.auth_mode?"":"CLEAR");
     LOG("mgmt", GB_LOG_ERROR, "%s for block %s on host %s volume %s",
@@ -52,7 +52,7 @@ glusterBlockModifyRemote(void *data)
     goto out;
   }
 
-  GB_METAUPDATE_OR_GOTO(lock, args->glfs, cobj.block_name, cobj.volume,
+  GB_METAUPDATE_OR_GOTO(args->glfs, cobj.block_name, cobj.volume,
                         ret, errMsg, out, "%s: AUTH%sENFORCED\n", args->addr,
                         cobj.auth_mode?"":"CLEAR");
 
@@ -81,7 +81,7 @@ glusterBlockModifySizeRemote(void *data)
   bool rpc_sent = FALSE;
 
 
-  GB_METAUPDATE_OR_GOTO(lock, args->glfs, mobj.block_name, mobj.volume,
+  GB_METAUPDATE_OR_GOTO(args->glfs, mobj.block_name, mobj.volume,
                         ret, errMsg, out, "%s: RSINPROGRESS-%zu\n",
                         args->addr, mobj.size);
 
@@ -100,7 +100,7 @@ glusterBlockModifySizeRemote(void *data)
       errMsg = args->reply;
       args->reply = NULL;
     }
-    GB_METAUPDATE_OR_GOTO(lock, args->glfs, mobj.block_name, mobj.volume,
+    GB_METAUPDATE_OR_GOTO(args->glfs, mobj.block_name, mobj.volume,
                           ret, errMsg, out, "%s: RSFAIL-%zu\n", args->addr, mobj.size);
 
     LOG("mgmt", GB_LOG_ERROR, "%s for block %s on volume %s for size %zu on host %s",
@@ -110,7 +110,7 @@ glusterBlockModifySizeRemote(void *data)
     goto out;
   }
 
-  GB_METAUPDATE_OR_GOTO(lock, args->glfs, mobj.block_name, mobj.volume,
+  GB_METAUPDATE_OR_GOTO(args->glfs, mobj.block_name, mobj.volume,
                         ret, errMsg, out, "%s: RSSUCCESS-%zu\n",
                         args->addr, mobj.size);
 
@@ -137,7 +137,7 @@ glusterBlockModifyArgsFill(blockModify *mobj, MetaInfo *info,
   bool fill = FALSE;
 
   for (i = 0, count = 0; i < info->nhosts; i++) {
-    switch (blockMetaStatusEnumParse(info->list[i]->status)) {
+    switch (info->list[i]->st) {
       case GB_CONFIG_SUCCESS:
       case GB_CLEANUP_INPROGRESS:
       case GB_AUTH_ENFORCE_FAIL:
@@ -186,7 +186,6 @@ glusterBlockModifyRemoteAsync(MetaInfo *info,
                               blockRemoteModifyResp **savereply,
                               bool rollback)
 {
-  pthread_t  *tid = NULL;
   blockRemoteModifyResp *local = *savereply;
   blockRemoteObj *args = NULL;
   int ret = -1;
@@ -197,24 +196,13 @@ glusterBlockModifyRemoteAsync(MetaInfo *info,
   /* get all (configured - already auth enforced) node count */
   count = glusterBlockModifyArgsFill(mobj, info, NULL, glfs);
 
-  if (GB_ALLOC_N(tid, count) < 0) {
-    goto out;
-  }
-
   if (GB_ALLOC_N(args, count) < 0) {
     goto out;
   }
 
   count = glusterBlockModifyArgsFill(mobj, info, args, glfs);
 
-  for (i = 0; i < count; i++) {
-    pthread_create(&tid[i], NULL, glusterBlockModifyRemote, &args[i]);
-  }
-
-  for (i = 0; i < count; i++) {
-    /* collect exit code */
-    pthread_join(tid[i], NULL);
-  }
+  glusterBlockFanout(glusterBlockModifyRemote, args, count, TIMEOUT.tv_sec);
 
   if (!rollback) {
     /* collect return */
@@ -240,7 +228,6 @@ glusterBlockModifyRemoteAsync(MetaInfo *info,
 
  out:
   GB_FREE(args);
-  GB_FREE(tid);
 
   return ret;
 }
@@ -257,7 +244,7 @@ glusterBlockModifySizeArgsFill(blockModifySize *mobj, MetaInfo *info,
 
   for (i = 0, count = 0; i < info->nhosts; i++) {
     if (skipped && (info->size == mobj->size) &&
-        (blockMetaStatusEnumParse(info->list[i]->status) == GB_RS_SUCCESS)) {
+        (info->list[i]->st == GB_RS_SUCCESS)) {
       saveptr = *skipped;
       GB_ASPRINTF(skipped, "%s %s", (saveptr?saveptr:""), info->list[i]->addr);
       GB_FREE(saveptr);
@@ -282,7 +269,6 @@ glusterBlockModifySizeRemoteAsync(MetaInfo *info,
                                   blockModifySize *mobj,
                                   blockRemoteResp **savereply)
 {
-  pthread_t  *tid = NULL;
   blockRemoteResp *local = *savereply;
   blockRemoteObj *args = NULL;
   int ret = -1;
@@ -292,24 +278,13 @@ glusterBlockModifySizeRemoteAsync(MetaInfo *info,
 
   count = glusterBlockModifySizeArgsFill(mobj, info, NULL, glfs, NULL);
 
-  if (GB_ALLOC_N(tid, count) < 0) {
-    goto out;
-  }
-
   if (GB_ALLOC_N(args, count) < 0) {
     goto out;
   }
 
   count = glusterBlockModifySizeArgsFill(mobj, info, args, glfs, &local->skipped);
 
-  for (i = 0; i < count; i++) {
-    pthread_create(&tid[i], NULL, glusterBlockModifySizeRemote, &args[i]);
-  }
-
-  for (i = 0; i < count; i++) {
-    /* collect exit code */
-    pthread_join(tid[i], NULL);
-  }
+  glusterBlockFanout(glusterBlockModifySizeRemote, args, count, TIMEOUT.tv_sec);
 
   /* collect return */
   ret = glusterBlockCollectAttemptSuccess(args, info, MODIFY_SIZE_SRV, count,
@@ -328,7 +303,6 @@ glusterBlockModifySizeRemoteAsync(MetaInfo *info,
 
  out:
   GB_FREE(args);
-  GB_FREE(tid);
 
   return ret;
 }
@@ -456,8 +430,9 @@ block_modify_cli_1_svc_st(blockModifyCli *blk, struct svc_req *rqstp)
   blockModify mobj = {{0}};
   blockRemoteModifyResp *savereply = NULL;
   blockResponse *reply = NULL;
-  struct glfs *glfs;
+  struct glfs *glfs = NULL;
   struct glfs_fd *lkfd = NULL;
+  struct MetaJournal *journal = NULL;
   MetaInfo *info = NULL;
   uuid_t uuid;
   char passwd[UUID_BUF_SIZE];
@@ -490,17 +465,20 @@ block_modify_cli_1_svc_st(blockModifyCli *blk, struct svc_req *rqstp)
     goto initfail;
   }
 
-  lkfd = glusterBlockCreateMetaLockFile(glfs, blk->volume, &errCode, &errMsg);
+  lkfd = glusterBlockCreateMetaLockFile(glfs, blk->volume, "modify",
+                                        &errCode, &errMsg);
   if (!lkfd) {
     LOG("mgmt", GB_LOG_ERROR, "%s %s for block %s",
         FAILED_CREATING_META, blk->volume, blk->block_name);
     goto nolock;
   }
 
-  GB_METALOCK_OR_GOTO(lkfd, blk->volume, errCode, errMsg, nolock);
+  GB_METABLKLOCK_OR_GOTO(lkfd, F_WRLCK, blk->volume, blk->block_name,
+                         errCode, errMsg, nolock);
+  journal = blockMetaJournalHold(glfs, blk->volume, blk->block_name);
   LOG("cmdlog", GB_LOG_INFO, "%s", blk->cmd);
 
-  if (glfs_access(glfs, blk->block_name, F_OK)) {
+  if (glusterBlockMetaFileAccess(glfs, blk->block_name, F_OK)) {
     errCode = errno;
     if (errCode == ENOENT) {
       GB_ASPRINTF(&errMsg, "block %s/%s doesn't exist",
@@ -523,6 +501,9 @@ block_modify_cli_1_svc_st(blockModifyCli *blk, struct svc_req *rqstp)
     goto out;
   }
 
+  /* still exclusive here, fold old history before adding to it */
+  glusterBlockCompactMetaFile(glfs, blk->volume, blk->block_name, info);
+
   list = glusterBlockGetListFromInfo(info);
   if (!list) {
     errCode = ENOMEM;
@@ -556,7 +537,7 @@ block_modify_cli_1_svc_st(blockModifyCli *blk, struct svc_req *rqstp)
     if(info->passwd[0] == '\0') {
       uuid_generate(uuid);
       uuid_unparse(uuid, passwd);
-      GB_METAUPDATE_OR_GOTO(lock, glfs, blk->block_name, blk->volume,
+      GB_METAUPDATE_OR_GOTO(glfs, blk->block_name, blk->volume,
                             errCode, errMsg, out, "PASSWORD: %s\n", passwd);
       GB_STRCPYSTATIC(mobj.passwd, passwd);
     } else {
@@ -564,11 +545,12 @@ block_modify_cli_1_svc_st(blockModifyCli *blk, struct svc_req *rqstp)
     }
     mobj.auth_mode = 1;
   } else {
-    GB_METAUPDATE_OR_GOTO(lock, glfs, blk->block_name, blk->volume,
+    GB_METAUPDATE_OR_GOTO(glfs, blk->block_name, blk->volume,
                           errCode, errMsg, out, "PASSWORD: \n");
     mobj.auth_mode = 0;
   }
 
+  GB_METALOCK_DOWNGRADE(lkfd, blk->volume, blk->block_name);
   asyncret = glusterBlockModifyRemoteAsync(info, glfs, &mobj,
                                            &savereply, rollback);
   if (asyncret) {   /* asyncret decides result is success/fail */
@@ -579,7 +561,7 @@ block_modify_cli_1_svc_st(blockModifyCli *blk, struct svc_req *rqstp)
 
     /* Unwind by removing authentication */
     if (blk->auth_mode) {
-      GB_METAUPDATE_OR_GOTO(lock, glfs, blk->block_name, blk->volume,
+      GB_METAUPDATE_OR_GOTO(glfs, blk->block_name, blk->volume,
                             errCode, errMsg, out, "PASSWORD: \n");
     }
 
@@ -615,6 +597,8 @@ block_modify_cli_1_svc_st(blockModifyCli *blk, struct svc_req *rqstp)
   }
 
  out:
+  blockIndexCommit(glfs, lkfd, blk->volume, blk->block_name, journal);
+  blockMetaJournalRelease(journal);
   GB_METAUNLOCK(lkfd, blk->volume, errCode, errMsg);
   blockServerDefFree(list);
 
@@ -628,6 +612,7 @@ block_modify_cli_1_svc_st(blockModifyCli *blk, struct svc_req *rqstp)
         "glfs_close(%s): for block %s on volume %s failed[%s]",
         GB_TXLOCKFILE, blk->block_name, blk->volume, strerror(errno));
   }
+  glusterBlockVolumeRelease(glfs);
 
  initfail:
   blockModifyCliFormatResponse (blk, &mobj, asyncret?asyncret:errCode,
@@ -750,7 +735,7 @@ blockModifySizeCliFormatResponse(blockModifySizeCli *blk, blockModifySize *mobj,
   if (errCode && !errMsg) {
     GB_ASPRINTF (&errMsg, "block volume resize failed:");
     for (i = 0; i < info->nhosts; i++) {
-      switch (blockMetaStatusEnumParse(info->list[i]->status)) {
+      switch (info->list[i]->st) {
       case GB_RS_FAIL:
       case GB_RS_INPROGRESS:
         GB_FREE(hr_size);
@@ -792,7 +777,7 @@ glusterBlockIsResizeFailed(MetaInfo *info)
   int i;
 
   for (i = 0; i < info->nhosts; i++) {
-    switch (blockMetaStatusEnumParse(info->list[i]->status)) {
+    switch (info->list[i]->st) {
       case GB_RS_FAIL:
       case GB_RS_INPROGRESS:
         return true;
@@ -810,8 +795,9 @@ block_modify_size_cli_1_svc_st(blockModifySizeCli *blk, struct svc_req *rqstp)
   blockModifySize mobj = {{0},};
   blockRemoteResp *savereply = NULL;
   blockResponse *reply = NULL;
-  struct glfs *glfs;
+  struct glfs *glfs = NULL;
   struct glfs_fd *lkfd = NULL;
+  struct MetaJournal *journal = NULL;
   MetaInfo *info = NULL;
   int asyncret = 0;
   int errCode = -1;
@@ -842,17 +828,20 @@ block_modify_size_cli_1_svc_st(blockModifySizeCli *blk, struct svc_req *rqstp)
     goto initfail;
   }
 
-  lkfd = glusterBlockCreateMetaLockFile(glfs, blk->volume, &errCode, &errMsg);
+  lkfd = glusterBlockCreateMetaLockFile(glfs, blk->volume, "modify-size",
+                                        &errCode, &errMsg);
   if (!lkfd) {
     LOG("mgmt", GB_LOG_ERROR, "%s %s for block %s",
         FAILED_CREATING_META, blk->volume, blk->block_name);
     goto nolock;
   }
 
-  GB_METALOCK_OR_GOTO(lkfd, blk->volume, errCode, errMsg, nolock);
+  GB_METABLKLOCK_OR_GOTO(lkfd, F_WRLCK, blk->volume, blk->block_name,
+                         errCode, errMsg, nolock);
+  journal = blockMetaJournalHold(glfs, blk->volume, blk->block_name);
   LOG("cmdlog", GB_LOG_INFO, "%s",  blk->cmd);
 
-  if (glfs_access(glfs, blk->block_name, F_OK)) {
+  if (glusterBlockMetaFileAccess(glfs, blk->block_name, F_OK)) {
     errCode = errno;
     if (errCode == ENOENT) {
       GB_ASPRINTF(&errMsg, "block %s/%s doesn't exist",
@@ -875,6 +864,9 @@ block_modify_size_cli_1_svc_st(blockModifySizeCli *blk, struct svc_req *rqstp)
     goto out;
   }
 
+  /* still exclusive here, fold old history before adding to it */
+  glusterBlockCompactMetaFile(glfs, blk->volume, blk->block_name, info);
+
   if (info->blk_size && (blk->size % info->blk_size)) {
     GB_ASPRINTF(&errMsg, "size (%lu) is incorrect, it should be aligned to block size (%lu)",
                 blk->size, info->blk_size);
@@ -932,6 +924,7 @@ block_modify_size_cli_1_svc_st(blockModifySizeCli *blk, struct svc_req *rqstp)
   GB_STRCPYSTATIC(mobj.gbid, info->gbid);
   mobj.size = blk->size;
 
+  GB_METALOCK_DOWNGRADE(lkfd, blk->volume, blk->block_name);
   ret = glusterBlockResizeEntry(glfs, &mobj, &errCode, &errMsg);
   if (ret) {
     errCode = ret;
@@ -940,7 +933,7 @@ block_modify_size_cli_1_svc_st(blockModifySizeCli *blk, struct svc_req *rqstp)
     goto out;
   }
 
-  GB_METAUPDATE_OR_GOTO(lock, glfs, mobj.block_name, mobj.volume,
+  GB_METAUPDATE_OR_GOTO(glfs, mobj.block_name, mobj.volume,
                         errCode, errMsg, out, "SIZE: %zu\n",  mobj.size);
 
   asyncret = glusterBlockModifySizeRemoteAsync(info, glfs, &mobj, &savereply);
@@ -960,6 +953,8 @@ block_modify_size_cli_1_svc_st(blockModifySizeCli *blk, struct svc_req *rqstp)
   }
 
  out:
+  blockIndexCommit(glfs, lkfd, blk->volume, blk->block_name, journal);
+  blockMetaJournalRelease(journal);
   GB_METAUNLOCK(lkfd, blk->volume, errCode, errMsg);
   blockServerDefFree(list);
 
@@ -973,6 +968,7 @@ block_modify_size_cli_1_svc_st(blockModifySizeCli *blk, struct svc_req *rqstp)
         "glfs_close(%s): for block %s on volume %s failed[%s]",
         GB_TXLOCKFILE, blk->block_name, blk->volume, strerror(errno));
   }
+  glusterBlockVolumeRelease(glfs);
 
  initfail:
   blockModifySizeCliFormatResponse(blk, &mobj, asyncret?asyncret:errCode,
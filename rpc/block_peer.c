@@ -0,0 +1,797 @@
+/*
+  Copyright (c) 2016 Red Hat, Inc. <http://www.redhat.com>
+  This file is part of gluster-block.
+
+  This file is licensed to you under your choice of the GNU Lesser
+  General Public License, version 3 or any later version (LGPLv3 or
+  later), or the GNU General Public License, version 2 (GPLv2), in all
+  cases as published by the Free Software Foundation.
+*/
+
+
+# include  "block_common.h"
+
+# include  <poll.h>
+# include  <fcntl.h>
+# include  <signal.h>
+# include  <sys/socket.h>
+
+# define   GB_PEER_HASH_SIZE      64   /* must be power of 2 */
+# define   GB_PEER_IDLE_MAX       8    /* pooled connections kept per peer */
+# define   GB_PEER_IDLE_TIMEOUT   120  /* seconds an unused connection lives */
+# define   GB_PEER_SWEEP_INTERVAL 30   /* seconds between idle sweeps */
+# define   GB_PEER_CAPS_TTL       300  /* seconds a version reply is trusted */
+# define   GB_PEER_CONNECT_TIMEOUT 5   /* seconds to wait for a connect */
+
+# define   GB_PEER_HEARTBEAT_INTERVAL 5   /* seconds between probes of a peer */
+# define   GB_PEER_PROBE_TIMEOUT      3   /* seconds a probe may take */
+# define   GB_PEER_WATCH_TIME         600 /* probe peers used this recently */
+/* a peer found down fails calls this long unless a probe says otherwise */
+# define   GB_PEER_DOWN_HOLD          (3 * GB_PEER_HEARTBEAT_INTERVAL)
+
+
+typedef struct gbPeerConn {
+  CLIENT *clnt;
+  time_t lastUsed;
+  struct list_head list;    /* linked on gbPeer->idle, most recent first */
+} gbPeerConn;
+
+/* one per remote gluster-blockd we talked to, never freed */
+typedef struct gbPeer {
+  char addr[255];
+  struct sockaddr_in sin;
+  bool resolved;            /* sin is valid */
+  size_t nidle;
+  struct list_head idle;    /* gbPeerConn */
+  uint64_t epoch;           /* boot epoch the daemon last replied with */
+  gbCapResp *caps;          /* its last version reply, NULL if not cached */
+  time_t capsTime;
+  time_t lastUsed;          /* last request to it, watched for a while */
+  bool down;                /* last connect or probe failed */
+  time_t checked;           /* when down was last found out */
+  struct list_head hnode;   /* hash chain, linked on PeerHash[] */
+} gbPeer;
+
+
+static struct list_head PeerHash[GB_PEER_HASH_SIZE];
+static bool peerInit;
+static time_t peerLastSweep;
+static pthread_mutex_t peer_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+static time_t
+peerTimeNow(void)
+{
+  struct timespec ts;
+
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec;
+}
+
+
+static unsigned int
+peerHash(const char *addr)
+{
+  unsigned int hash = 5381;
+
+
+  while (*addr) {
+    hash = ((hash << 5) + hash) + (unsigned char)*addr++;
+  }
+
+  return hash & (GB_PEER_HASH_SIZE - 1);
+}
+
+
+/* must be called with peer_lock held */
+static gbPeer *
+peerLookup(const char *addr, bool create)
+{
+  gbPeer *peer;
+  unsigned int hash = peerHash(addr);
+  size_t i;
+
+
+  if (!peerInit) {
+    for (i = 0; i < GB_PEER_HASH_SIZE; i++) {
+      INIT_LIST_HEAD(&PeerHash[i]);
+    }
+    peerInit = true;
+  }
+
+  list_for_each_entry(peer, &PeerHash[hash], hnode) {
+    if (!strcmp(peer->addr, addr)) {
+      return peer;
+    }
+  }
+
+  if (!create || GB_ALLOC(peer) < 0) {
+    return NULL;
+  }
+  GB_STRCPYSTATIC(peer->addr, addr);
+  INIT_LIST_HEAD(&peer->idle);
+  list_add(&peer->hnode, &PeerHash[hash]);
+
+  return peer;
+}
+
+
+/* must be called with peer_lock held, moves expired connections on reap */
+static void
+peerSweep(time_t now, struct list_head *reap)
+{
+  gbPeer *peer;
+  gbPeerConn *conn, *next;
+  size_t i;
+
+
+  if (!peerInit || now - peerLastSweep < GB_PEER_SWEEP_INTERVAL) {
+    return;
+  }
+  peerLastSweep = now;
+
+  for (i = 0; i < GB_PEER_HASH_SIZE; i++) {
+    list_for_each_entry(peer, &PeerHash[i], hnode) {
+      list_for_each_entry_safe(conn, next, &peer->idle, list) {
+        if (now - conn->lastUsed >= GB_PEER_IDLE_TIMEOUT) {
+          list_move(&conn->list, reap);
+          peer->nidle--;
+        }
+      }
+    }
+  }
+}
+
+
+static void
+peerCapsFree(gbCapResp *caps)
+{
+  if (caps) {
+    GB_FREE(caps->response);
+    GB_FREE(caps);
+  }
+}
+
+
+static gbCapResp *
+peerCapsDup(gbCapResp *caps)
+{
+  gbCapResp *dup = NULL;
+
+
+  if (GB_ALLOC(dup) < 0) {
+    return NULL;
+  }
+  if (GB_ALLOC_N(dup->response, caps->capMax) < 0) {
+    GB_FREE(dup);
+    return NULL;
+  }
+  memcpy(dup->response, caps->response, caps->capMax * sizeof(gbCapObj));
+  dup->capMax = caps->capMax;
+
+  return dup;
+}
+
+
+/*
+ * Must be called with peer_lock held. A peer we have trouble talking to
+ * may be restarting with another version, ask it again next time.
+ */
+static gbCapResp *
+peerCapsDrop(gbPeer *peer)
+{
+  gbCapResp *caps = peer->caps;
+
+
+  peer->caps = NULL;
+
+  return caps;
+}
+
+
+static void
+peerConnDestroy(gbPeerConn *conn)
+{
+  if (conn->clnt) {
+    clnt_destroy(conn->clnt);
+  }
+  GB_FREE(conn);
+}
+
+
+static void
+peerReap(struct list_head *reap)
+{
+  gbPeerConn *conn, *next;
+
+
+  list_for_each_entry_safe(conn, next, reap, list) {
+    list_del(&conn->list);
+    peerConnDestroy(conn);
+  }
+}
+
+
+/*
+ * An idle connection has nothing to read; if it is readable the peer
+ * closed or reset it, most likely because its daemon restarted.
+ */
+static bool
+peerConnAlive(CLIENT *clnt)
+{
+  struct pollfd pfd = {0, };
+  int fd;
+
+
+  if (!clnt_control(clnt, CLGET_FD, (char *)&fd)) {
+    return false;
+  }
+
+  pfd.fd = fd;
+  pfd.events = POLLIN;
+  if (poll(&pfd, 1, 0) != 0) {
+    return false;
+  }
+
+  return true;
+}
+
+
+static int
+peerResolve(const char *addr, struct sockaddr_in *sin)
+{
+  int ret;
+  struct addrinfo hints, *res;
+
+
+  memset(&hints, 0, sizeof hints);
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+
+  ret = getaddrinfo(addr, GB_TCP_PORT_STR, &hints, &res);
+  if (ret) {
+    LOG("mgmt", GB_LOG_ERROR, "getaddrinfo(%s) failed (%s)",
+        addr, gai_strerror(ret));
+    return -1;
+  }
+  memcpy(sin, res->ai_addr, sizeof(*sin));
+  freeaddrinfo(res);
+
+  return 0;
+}
+
+
+/*
+ * connect() to a host that is down can block for minutes retrying SYNs,
+ * give up after GB_PEER_CONNECT_TIMEOUT instead.
+ */
+static int
+peerSocketConnect(const char *addr, struct sockaddr_in *sin)
+{
+  struct pollfd pfd = {0, };
+  int sockfd;
+  int flags;
+  int err = 0;
+  socklen_t len = sizeof(err);
+
+
+  /* the connection outlives this call, don't hand it to our children */
+  sockfd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, IPPROTO_TCP);
+  if (sockfd < 0) {
+    LOG("mgmt", GB_LOG_ERROR, "socket() for host %s failed[%s]",
+        addr, strerror(errno));
+    return -1;
+  }
+
+  flags = fcntl(sockfd, F_GETFL);
+  fcntl(sockfd, F_SETFL, flags | O_NONBLOCK);
+
+  if (connect(sockfd, (struct sockaddr *)sin, sizeof(*sin)) < 0) {
+    if (errno != EINPROGRESS) {
+      err = errno;
+    } else {
+      pfd.fd = sockfd;
+      pfd.events = POLLOUT;
+      if (poll(&pfd, 1, GB_PEER_CONNECT_TIMEOUT * 1000) <= 0) {
+        err = ETIMEDOUT;
+      } else if (getsockopt(sockfd, SOL_SOCKET, SO_ERROR, &err, &len)) {
+        err = errno;
+      }
+    }
+  }
+  if (err) {
+    LOG("mgmt", GB_LOG_ERROR, "connect to host %s failed[%s]",
+        addr, strerror(err));
+    close(sockfd);
+    errno = err;
+    return -1;
+  }
+
+  fcntl(sockfd, F_SETFL, flags);
+
+  return sockfd;
+}
+
+
+static CLIENT *
+peerConnect(const char *addr, struct sockaddr_in *sin)
+{
+  CLIENT *clnt;
+  int sockfd;
+  int on = 1;
+
+
+  sockfd = peerSocketConnect(addr, sin);
+  if (sockfd < 0) {
+    return NULL;
+  }
+
+  clnt = clnttcp_create(sin, GLUSTER_BLOCK, GLUSTER_BLOCK_VERS, &sockfd, 0, 0);
+  if (!clnt) {
+    LOG("mgmt", GB_LOG_ERROR, "%son inet host %s",
+        clnt_spcreateerror("client create failed"), addr);
+    close(sockfd);
+    return NULL;
+  }
+  /* we made the socket, so clnt_destroy() doesn't close it unless told */
+  clnt_control(clnt, CLSET_FD_CLOSE, NULL);
+
+  if (setsockopt(sockfd, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on))) {
+    LOG("mgmt", GB_LOG_WARNING, "setting SO_KEEPALIVE on connection to %s "
+        "failed[%s]", addr, strerror(errno));
+  }
+
+  return clnt;
+}
+
+
+/* must be called with peer_lock held, returns the caps to free if down */
+static gbCapResp *
+peerSetState(gbPeer *peer, bool up)
+{
+  if (up) {
+    if (peer->down) {
+      LOG("mgmt", GB_LOG_INFO, "gluster-blockd on %s is back up", peer->addr);
+      peer->down = false;
+    }
+    return NULL;
+  }
+
+  if (!peer->down) {
+    LOG("mgmt", GB_LOG_WARNING, "gluster-blockd on %s is down", peer->addr);
+    peer->down = true;
+  }
+  peer->checked = peerTimeNow();
+
+  return peerCapsDrop(peer);
+}
+
+
+/* must be called with peer_lock held */
+static bool
+peerIsDown(gbPeer *peer, time_t now)
+{
+  return peer->down && now - peer->checked < GB_PEER_DOWN_HOLD;
+}
+
+
+static CLIENT *
+peerGetClient(char *addr, bool *reused, bool probe)
+{
+  gbPeer *peer;
+  gbPeerConn *conn;
+  CLIENT *clnt = NULL;
+  struct sockaddr_in sin;
+  bool resolved = false;
+  size_t stale = 0;
+  gbCapResp *caps = NULL;
+  time_t now = peerTimeNow();
+  LIST_HEAD(reap);
+
+
+  *reused = false;
+
+  LOCK(peer_lock);
+  peerSweep(now, &reap);
+  peer = peerLookup(addr, true);
+  if (peer && !probe) {
+    peer->lastUsed = now;
+    if (peerIsDown(peer, now)) {
+      UNLOCK(peer_lock);
+      peerReap(&reap);
+      LOG("mgmt", GB_LOG_ERROR, "gluster-blockd on %s is down, not calling it",
+          addr);
+      errno = EHOSTDOWN;
+      return NULL;
+    }
+  }
+  while (peer && !list_empty(&peer->idle)) {
+    conn = list_entry(peer->idle.next, gbPeerConn, list);
+    list_del(&conn->list);
+    peer->nidle--;
+    if (peerConnAlive(conn->clnt)) {
+      clnt = conn->clnt;
+      conn->clnt = NULL;
+      GB_FREE(conn);
+      break;
+    }
+    list_add(&conn->list, &reap);
+    stale++;
+  }
+  if (!clnt && peer && peer->resolved) {
+    sin = peer->sin;
+    resolved = true;
+  }
+  if (stale && peer) {
+    caps = peerCapsDrop(peer);
+  }
+  UNLOCK(peer_lock);
+
+  peerReap(&reap);
+  peerCapsFree(caps);
+  if (stale) {
+    LOG("mgmt", GB_LOG_DEBUG, "dropped %zu stale connection(s) to %s",
+        stale, addr);
+  }
+
+  if (clnt) {
+    *reused = true;
+    return clnt;
+  }
+
+  if (!resolved) {
+    if (peerResolve(addr, &sin)) {
+      return NULL;
+    }
+  }
+
+  clnt = peerConnect(addr, &sin);
+
+  LOCK(peer_lock);
+  peer = peerLookup(addr, true);
+  if (peer) {
+    /* resolve again next time if the address we had doesn't answer */
+    peer->resolved = !!clnt;
+    peer->sin = sin;
+    if (!clnt) {
+      caps = peerSetState(peer, false);
+    }
+  }
+  UNLOCK(peer_lock);
+
+  peerCapsFree(caps);
+
+  return clnt;
+}
+
+
+/*
+ * Hand out a connection to the gluster-blockd on addr, an idle pooled one
+ * if there is a healthy one, else a new one. *reused tells which. Give it
+ * back with glusterBlockPeerPutClient(). Fails right away with EHOSTDOWN
+ * while the peer is known to be down.
+ */
+CLIENT *
+glusterBlockPeerGetClient(char *addr, bool *reused)
+{
+  return peerGetClient(addr, reused, false);
+}
+
+
+/*
+ * Return a connection taken with glusterBlockPeerGetClient(). Connections
+ * whose last call failed are closed rather than pooled, the next call to
+ * the peer connects afresh.
+ */
+void
+glusterBlockPeerPutClient(char *addr, CLIENT *clnt, bool healthy)
+{
+  gbPeer *peer;
+  gbPeerConn *conn = NULL;
+  gbCapResp *caps = NULL;
+
+
+  if (!clnt) {
+    return;
+  }
+
+  if (!healthy) {
+    LOCK(peer_lock);
+    peer = peerLookup(addr, false);
+    if (peer) {
+      caps = peerCapsDrop(peer);
+    }
+    UNLOCK(peer_lock);
+
+    peerCapsFree(caps);
+    clnt_destroy(clnt);
+    return;
+  }
+
+  if (GB_ALLOC(conn) < 0) {
+    clnt_destroy(clnt);
+    return;
+  }
+  conn->clnt = clnt;
+  conn->lastUsed = peerTimeNow();
+
+  LOCK(peer_lock);
+  peer = peerLookup(addr, true);
+  if (peer) {
+    peerSetState(peer, true);
+  }
+  if (peer && peer->nidle < GB_PEER_IDLE_MAX) {
+    list_add(&conn->list, &peer->idle);
+    peer->nidle++;
+    conn = NULL;
+  }
+  UNLOCK(peer_lock);
+
+  if (conn) {
+    peerConnDestroy(conn);
+  }
+}
+
+
+/* close every pooled connection to addr, after its daemon went away */
+void
+glusterBlockPeerFlush(char *addr)
+{
+  gbPeer *peer;
+  gbCapResp *caps = NULL;
+  LIST_HEAD(reap);
+
+
+  LOCK(peer_lock);
+  peer = peerLookup(addr, false);
+  if (peer) {
+    list_splice_init(&peer->idle, &reap);
+    peer->nidle = 0;
+    caps = peerCapsDrop(peer);
+  }
+  UNLOCK(peer_lock);
+
+  peerReap(&reap);
+  peerCapsFree(caps);
+}
+
+
+/*
+ * Every reply of a peer daemon carries the epoch it booted in; a new one
+ * means it restarted, maybe upgraded, since we cached its capabilities.
+ * Older daemons send 0.
+ */
+void
+glusterBlockPeerSetEpoch(char *addr, uint64_t epoch)
+{
+  gbPeer *peer;
+  gbCapResp *caps = NULL;
+
+
+  if (!epoch) {
+    return;
+  }
+
+  LOCK(peer_lock);
+  peer = peerLookup(addr, true);
+  if (peer && peer->epoch != epoch) {
+    if (peer->epoch) {
+      LOG("mgmt", GB_LOG_INFO, "gluster-blockd on %s restarted", addr);
+    }
+    peer->epoch = epoch;
+    caps = peerCapsDrop(peer);
+  }
+  UNLOCK(peer_lock);
+
+  peerCapsFree(caps);
+}
+
+
+/* a copy of the capabilities addr replied with lately, NULL if none */
+gbCapResp *
+glusterBlockPeerGetCaps(char *addr)
+{
+  gbPeer *peer;
+  gbCapResp *caps = NULL;
+  gbCapResp *expired = NULL;
+
+
+  LOCK(peer_lock);
+  peer = peerLookup(addr, false);
+  if (peer && peer->caps) {
+    if (peerTimeNow() - peer->capsTime < GB_PEER_CAPS_TTL) {
+      caps = peerCapsDup(peer->caps);
+    } else {
+      expired = peerCapsDrop(peer);
+    }
+  }
+  UNLOCK(peer_lock);
+
+  peerCapsFree(expired);
+
+  return caps;
+}
+
+
+/* remember the capabilities addr replied with, only daemons with an epoch */
+void
+glusterBlockPeerSetCaps(char *addr, gbCapResp *caps)
+{
+  gbPeer *peer;
+  gbCapResp *dup = NULL;
+  gbCapResp *old = NULL;
+
+
+  if (!caps || !(dup = peerCapsDup(caps))) {
+    return;
+  }
+
+  LOCK(peer_lock);
+  peer = peerLookup(addr, false);
+  if (peer && peer->epoch) {
+    old = peerCapsDrop(peer);
+    peer->caps = dup;
+    peer->capsTime = peerTimeNow();
+    dup = NULL;
+  }
+  UNLOCK(peer_lock);
+
+  peerCapsFree(old);
+  peerCapsFree(dup);
+}
+
+
+/*
+ * The hosts of list whose gluster-blockd is known to be down, space
+ * separated, or NULL if all of them look alive.
+ */
+char *
+glusterBlockPeerListDown(blockServerDefPtr list)
+{
+  gbPeer *peer;
+  char *down = NULL;
+  char *tmp;
+  time_t now = peerTimeNow();
+  size_t i;
+
+
+  LOCK(peer_lock);
+  for (i = 0; list && i < list->nhosts; i++) {
+    peer = peerLookup(list->hosts[i], false);
+    if (!peer || !peerIsDown(peer, now)) {
+      continue;
+    }
+    tmp = down;
+    if (GB_ASPRINTF(&down, "%s%s%s", tmp ? tmp : "", tmp ? " " : "",
+                    list->hosts[i]) == -1) {
+      down = tmp;
+      break;
+    }
+    GB_FREE(tmp);
+  }
+  UNLOCK(peer_lock);
+
+  return down;
+}
+
+
+/* ping the gluster-blockd on args->addr with the null procedure */
+static void *
+peerProbe(void *data)
+{
+  blockRemoteObj *args = data;
+  struct timeval tv = {GB_PEER_PROBE_TIMEOUT, 0};
+  enum clnt_stat stat = RPC_FAILED;
+  CLIENT *clnt;
+  gbPeer *peer;
+  gbCapResp *caps = NULL;
+  bool reused;
+
+
+  clnt = peerGetClient(args->addr, &reused, true);
+  if (!clnt) {
+    return NULL;  /* marked down already */
+  }
+
+  clnt_control(clnt, CLSET_TIMEOUT, (char *)&tv);
+  stat = clnt_call(clnt, NULLPROC, (xdrproc_t)xdr_void, NULL,
+                   (xdrproc_t)xdr_void, NULL, tv);
+  if (stat != RPC_SUCCESS && reused) {
+    /* the pooled connection may be what's broken, not the daemon */
+    clnt_destroy(clnt);
+    clnt = peerGetClient(args->addr, &reused, true);
+    if (!clnt) {
+      return NULL;
+    }
+    clnt_control(clnt, CLSET_TIMEOUT, (char *)&tv);
+    stat = clnt_call(clnt, NULLPROC, (xdrproc_t)xdr_void, NULL,
+                     (xdrproc_t)xdr_void, NULL, tv);
+  }
+
+  if (stat != RPC_SUCCESS) {
+    LOG("mgmt", GB_LOG_DEBUG, "%son host %s",
+        clnt_sperror(clnt, "heartbeat failed"), args->addr);
+    LOCK(peer_lock);
+    peer = peerLookup(args->addr, false);
+    if (peer) {
+      caps = peerSetState(peer, false);
+    }
+    UNLOCK(peer_lock);
+    peerCapsFree(caps);
+  }
+
+  /* a healthy connection goes back to the pool and marks the peer up */
+  glusterBlockPeerPutClient(args->addr, clnt, stat == RPC_SUCCESS);
+
+  return NULL;
+}
+
+
+static void *
+peerHeartbeat(void *arg)
+{
+  gbPeer *peer;
+  blockRemoteObj *args = NULL;
+  size_t count, max = 0;
+  time_t now;
+  size_t i;
+
+
+  while (1) {
+    sleep(GB_PEER_HEARTBEAT_INTERVAL);
+
+    now = peerTimeNow();
+    count = 0;
+    LOCK(peer_lock);
+    for (i = 0; peerInit && i < GB_PEER_HASH_SIZE; i++) {
+      list_for_each_entry(peer, &PeerHash[i], hnode) {
+        if (now - peer->lastUsed >= GB_PEER_WATCH_TIME) {
+          continue;
+        }
+        if (count == max) {
+          if (GB_REALLOC_N(args, max + GB_PEER_HASH_SIZE) < 0) {
+            break;
+          }
+          max += GB_PEER_HASH_SIZE;
+        }
+        /* peers are never freed, their addr stays valid */
+        memset(&args[count], 0, sizeof(*args));
+        args[count++].addr = peer->addr;
+      }
+    }
+    UNLOCK(peer_lock);
+
+    glusterBlockFanout(peerProbe, args, count, 0);
+  }
+
+  return NULL;
+}
+
+
+/*
+ * Probe the peers we have been talking to every few seconds, so requests
+ * to a peer that went down fail right away rather than after timing out.
+ */
+int
+glusterBlockPeerStartHeartbeat(void)
+{
+  pthread_t tid;
+  sigset_t all, old;
+  int ret;
+
+
+  sigfillset(&all);
+  pthread_sigmask(SIG_SETMASK, &all, &old);
+  ret = pthread_create(&tid, NULL, peerHeartbeat, NULL);
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+  if (ret) {
+    LOG("mgmt", GB_LOG_ERROR, "failed to start peer heartbeat[%s]",
+        strerror(ret));
+    return -1;
+  }
+  pthread_detach(tid);
+
+  return 0;
+}
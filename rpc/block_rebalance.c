@@ -0,0 +1,738 @@
+/*
+  Copyright (c) 2016 Red Hat, Inc. <http://www.redhat.com>
+  This file is part of gluster-block.
+
+  This file is licensed to you under your choice of the GNU Lesser
+  General Public License, version 3 or any later version (LGPLv3 or
+  later), or the GNU General Public License, version 2 (GPLv2), in all
+  cases as published by the Free Software Foundation.
+*/
+
+
+# include  "block_common.h"
+
+# define   GB_REBALANCE_BATCH   8   /* blocks reconfigured at a time */
+
+
+typedef struct blockRebalanceMove {
+  BlockIndexEntry *e;
+  blockServerDefPtr hosts;    /* the block's healthy hosts, per the index */
+  char prio_path[255];        /* planned AO path */
+  MetaInfo *info;
+  blockServerDefPtr list;     /* nodes to reconfigure */
+  blockRebalance robj;
+  blockRebalance undo;
+  size_t first;               /* its calls in the batch's args */
+  bool locked;
+  bool skipped;               /* changed since planned, left as it is */
+  bool failed;
+} blockRebalanceMove;
+
+
+static void *
+glusterBlockRebalanceRemote(void *data)
+{
+  int ret;
+  blockRemoteObj *args = (blockRemoteObj *)data;
+  blockRebalance robj = *(blockRebalance *)args->obj;
+  bool rpc_sent = FALSE;
+
+
+  ret = glusterBlockCallRPC_1(args->addr, &robj, REBALANCE_SRV, &rpc_sent,
+                              &args->reply);
+  if (ret) {
+    LOG("mgmt", GB_LOG_ERROR, "%s for block %s on host %s volume %s[%s]",
+        FAILED_REMOTE_REBALANCE, robj.block_name, args->addr, args->volume,
+        rpc_sent ? (args->reply ? args->reply : "") : strerror(errno));
+  }
+  args->exit = ret;
+
+  return NULL;
+}
+
+
+static void
+glusterBlockRebalanceRemoteAsync(blockRemoteObj *args, size_t count)
+{
+  glusterBlockFanout(glusterBlockRebalanceRemote, args, count, TIMEOUT.tv_sec);
+}
+
+
+/*
+ * Plans an AO path for every created block which has one: as long as a
+ * block's AO host carries two blocks more than another of its healthy
+ * hosts, the block moves there, and an AO path off its healthy hosts moves
+ * in any case. Each move lowers the sum of the squared counts, so this
+ * ends. load gets the resulting counts.
+ */
+static int
+blockRebalancePlan(BlockIndex *index, BlockPrioTable *load,
+                   blockRebalanceMove **moves, size_t *nmoves)
+{
+  blockRebalanceMove *m = NULL;
+  BlockIndexEntry *e;
+  BlockPrioCount *cur;
+  BlockPrioCount *min;
+  BlockPrioCount *c;
+  bool moved = true;
+  size_t n = 0;
+  size_t i, j;
+
+
+  for (i = 0; i < index->nblocks; i++) {
+    e = index->blocks[i];
+    if (!e->prio_path[0] || !e->hosts || strcmp(e->entry, "SUCCESS")) {
+      continue;
+    }
+    if (GB_REALLOC_N(m, n + 1) < 0) {
+      goto fail;
+    }
+    memset(&m[n], 0, sizeof(*m));
+    m[n].e = e;
+    GB_STRCPYSTATIC(m[n].prio_path, e->prio_path);
+    m[n].hosts = blockServerParse(e->hosts);
+    if (!m[n++].hosts) {
+      goto fail;
+    }
+
+    /* every host is in load from here on, so its entries stay put */
+    for (j = 0; j < m[n - 1].hosts->nhosts; j++) {
+      if (!blockPrioTableGet(NULL, load, m[n - 1].hosts->hosts[j])) {
+        goto fail;
+      }
+    }
+    c = blockPrioTableGet(NULL, load, e->prio_path);
+    if (!c) {
+      goto fail;
+    }
+    c->count++;
+  }
+
+  while (moved) {
+    moved = false;
+    for (i = 0; i < n; i++) {
+      cur = blockPrioTableGet(NULL, load, m[i].prio_path);
+      min = NULL;
+      for (j = 0; j < m[i].hosts->nhosts; j++) {
+        c = blockPrioTableGet(NULL, load, m[i].hosts->hosts[j]);
+        if (!min || c->count < min->count) {
+          min = c;
+        }
+      }
+      if (min == cur ||
+          (blockIndexHasHost(m[i].e, cur->addr) &&
+           min->count + 1 >= cur->count)) {
+        continue;
+      }
+      cur->count--;
+      min->count++;
+      GB_STRCPYSTATIC(m[i].prio_path, min->addr);
+      moved = true;
+    }
+  }
+
+  *moves = m;
+  *nmoves = n;
+  return 0;
+
+ fail:
+  for (i = 0; i < n; i++) {
+    blockServerDefFree(m[i].hosts);
+  }
+  GB_FREE(m);
+  return -1;
+}
+
+
+/* every host any of the moving blocks lives on */
+static int
+blockRebalanceAddHosts(blockServerDefPtr list, blockServerDefPtr hosts)
+{
+  size_t i, j;
+
+
+  for (i = 0; i < hosts->nhosts; i++) {
+    for (j = 0; j < list->nhosts; j++) {
+      if (!strcmp(list->hosts[j], hosts->hosts[i])) {
+        break;
+      }
+    }
+    if (j < list->nhosts) {
+      continue;
+    }
+    if (GB_REALLOC_N(list->hosts, list->nhosts + 1) < 0 ||
+        GB_STRDUP(list->hosts[list->nhosts], hosts->hosts[i]) < 0) {
+      return -1;
+    }
+    list->nhosts++;
+  }
+
+  return 0;
+}
+
+
+/* batches lock their blocks in this order, so rebalances can't deadlock */
+static int
+blockRebalanceCmp(const void *a, const void *b)
+{
+  off_t x = glusterBlockMetaLockOffset((*(blockRebalanceMove **)a)->e->name);
+  off_t y = glusterBlockMetaLockOffset((*(blockRebalanceMove **)b)->e->name);
+
+
+  return (x > y) - (x < y);
+}
+
+
+/*
+ * Takes the block's lock and reads its metafile, to check the block is
+ * still where the plan found it: the plan was made under the namespace
+ * lock only, and the block may have been deleted, modified or moved since.
+ */
+static int
+blockRebalanceLock(struct glfs *glfs, struct glfs_fd *lkfd, char *volume,
+                   blockRebalanceMove *m)
+{
+  NodeInfo *n;
+  char *errMsg = NULL;
+  int errCode = 0;
+
+
+  GB_METABLKLOCK_OR_GOTO(lkfd, F_WRLCK, volume, m->e->name, errCode, errMsg,
+                         fail);
+  m->locked = true;
+
+  if (GB_ALLOC(m->info) < 0) {
+    goto fail;
+  }
+  if (blockGetMetaInfo(glfs, m->e->name, m->info, &errCode)) {
+    if (errCode == ENOENT) {
+      goto skip;
+    }
+    goto fail;
+  }
+
+  n = blockMetaInfoGetNode(m->info, m->prio_path);
+  if (strcmp(m->info->prio_path, m->e->prio_path) ||
+      strcmp(m->info->entry, "SUCCESS") || !n ||
+      !blockhostIsValid(n->status)) {
+    goto skip;
+  }
+
+  return 0;
+
+ skip:
+  LOG("mgmt", GB_LOG_INFO, "block %s of volume %s changed since the "
+      "rebalance was planned, leaving it", m->e->name, volume);
+  m->skipped = true;
+  return -1;
+
+ fail:
+  LOG("mgmt", GB_LOG_ERROR, "%s for block %s of volume %s[%s]",
+      FAILED_REBALANCE, m->e->name, volume, errMsg ? errMsg : "");
+  GB_FREE(errMsg);
+  m->failed = true;
+  return -1;
+}
+
+
+static int
+blockRebalanceCommit(struct glfs *glfs, struct glfs_fd *lkfd, char *volume,
+                     blockRebalanceMove *m)
+{
+  char *errMsg = NULL;
+  int ret = 0;
+
+
+  GB_METAUPDATE_OR_GOTO(glfs, m->e->name, volume, ret, errMsg, out,
+                        "PRIOPATH: %s\n", m->prio_path);
+  blockIndexCommit(glfs, lkfd, volume, m->e->name, NULL);
+
+ out:
+  if (ret) {
+    LOG("mgmt", GB_LOG_ERROR, "%s", errMsg ? errMsg : FAILED_REBALANCE);
+  }
+  GB_FREE(errMsg);
+  return ret;
+}
+
+
+/*
+ * Moves the AO path of a batch of blocks: all nodes of all of them are told
+ * at once, and a block is only committed to its new PRIOPATH when each of
+ * its nodes took it. The nodes that did are put back otherwise. The blocks
+ * are locked from their check to their commit.
+ */
+static void
+blockRebalanceBatch(struct glfs *glfs, struct glfs_fd *lkfd, char *volume,
+                    blockRebalanceMove **batch, size_t nbatch)
+{
+  blockRebalanceMove *m;
+  blockRemoteObj *args = NULL;
+  blockRemoteObj *undo = NULL;
+  size_t count = 0;
+  size_t nundo = 0;
+  size_t i, j, n;
+
+
+  qsort(batch, nbatch, sizeof(*batch), blockRebalanceCmp);
+  for (i = 0; i < nbatch; i++) {
+    m = batch[i];
+    if (blockRebalanceLock(glfs, lkfd, volume, m)) {
+      continue;
+    }
+    if (!(m->list = glusterBlockGetListFromInfo(m->info))) {
+      m->failed = true;
+      continue;
+    }
+
+    GB_STRCPYSTATIC(m->robj.volume, volume);
+    GB_STRCPYSTATIC(m->robj.block_name, m->e->name);
+    GB_STRCPYSTATIC(m->robj.gbid, m->info->gbid);
+    GB_STRCPYSTATIC(m->robj.old_prio, m->info->prio_path);
+    GB_STRCPYSTATIC(m->robj.prio_path, m->prio_path);
+
+    m->undo = m->robj;
+    GB_STRCPYSTATIC(m->undo.old_prio, m->prio_path);
+    GB_STRCPYSTATIC(m->undo.prio_path, m->info->prio_path);
+
+    count += m->list->nhosts;
+  }
+
+  if (count && GB_ALLOC_N(args, count) < 0) {
+    for (i = 0; i < nbatch; i++) {
+      batch[i]->failed = !batch[i]->skipped;
+    }
+    goto unlock;
+  }
+
+  for (i = 0, n = 0; i < nbatch; i++) {
+    m = batch[i];
+    if (m->failed || m->skipped) {
+      continue;
+    }
+    m->first = n;
+    for (j = 0; j < m->list->nhosts; j++, n++) {
+      args[n].glfs = glfs;
+      args[n].obj = (void *)&m->robj;
+      args[n].volume = volume;
+      args[n].addr = m->list->hosts[j];
+    }
+  }
+
+  glusterBlockRebalanceRemoteAsync(args, n);
+
+  for (i = 0; i < nbatch; i++) {
+    m = batch[i];
+    if (m->failed || m->skipped) {
+      continue;
+    }
+    for (j = 0; j < m->list->nhosts; j++) {
+      if (args[m->first + j].exit) {
+        m->failed = true;
+      }
+    }
+    if (!m->failed && blockRebalanceCommit(glfs, lkfd, volume, m)) {
+      m->failed = true;
+    }
+    if (m->failed) {
+      for (j = 0; j < m->list->nhosts; j++) {
+        nundo += !args[m->first + j].exit;
+      }
+    }
+  }
+
+  /* nodes left with the new AO path go back to the one in the metafile */
+  if (nundo && GB_ALLOC_N(undo, nundo) == 0) {
+    for (i = 0, n = 0; i < nbatch; i++) {
+      m = batch[i];
+      if (!m->failed || !m->list) {
+        continue;
+      }
+      for (j = 0; j < m->list->nhosts; j++) {
+        if (!args[m->first + j].exit) {
+          undo[n] = args[m->first + j];
+          undo[n].obj = (void *)&m->undo;
+          undo[n].reply = NULL;
+          n++;
+        }
+      }
+    }
+    glusterBlockRebalanceRemoteAsync(undo, n);
+    for (i = 0; i < n; i++) {
+      if (undo[i].exit) {
+        LOG("mgmt", GB_LOG_ERROR, "putting back the AO path of block %s on "
+            "host %s volume %s failed, run 'gluster-block reload' on it",
+            ((blockRebalance *)undo[i].obj)->block_name, undo[i].addr,
+            volume);
+      }
+      GB_FREE(undo[i].reply);
+    }
+  }
+
+  for (i = 0; i < count; i++) {
+    GB_FREE(args[i].reply);
+  }
+  GB_FREE(args);
+  GB_FREE(undo);
+
+ unlock:
+  for (i = 0; i < nbatch; i++) {
+    m = batch[i];
+    if (m->locked) {
+      glusterBlockMetaUnlock(lkfd, glusterBlockMetaLockOffset(m->e->name), 1,
+                             volume);
+      m->locked = false;
+    }
+  }
+}
+
+
+static blockResponse *
+block_rebalance_cli_1_svc_st(blockRebalanceCli *blk, struct svc_req *rqstp)
+{
+  blockResponse *reply = NULL;
+  struct glfs *glfs = NULL;
+  struct glfs_fd *lkfd = NULL;
+  blockServerDefPtr list = NULL;
+  BlockIndex *index = NULL;
+  BlockPrioTable load = {0, };
+  BlockPrioTable prio = {0, };
+  blockRebalanceMove *moves = NULL;
+  blockRebalanceMove **batch = NULL;
+  json_object *json_obj = NULL;
+  json_object *json_prio = NULL;
+  char *prio_out = NULL;
+  char *failed_on = NULL;
+  char *tmp;
+  size_t nblocks = 0;
+  size_t nmoves = 0;
+  size_t moved = 0;
+  size_t failed = 0;
+  size_t skipped = 0;
+  size_t nbatch = 0;
+  bool dirty;
+  int err = 0;
+  int errCode = -1;
+  char *errMsg = NULL;
+  size_t i;
+
+
+  LOG("mgmt", GB_LOG_INFO, "rebalance cli request, volume=%s", blk->volume);
+
+  if (GB_ALLOC(reply) < 0) {
+    return NULL;
+  }
+
+  errCode = 0;
+  glfs = glusterBlockVolumeInit(blk->volume, &errCode, &errMsg);
+  if (!glfs) {
+    LOG("mgmt", GB_LOG_ERROR,
+        "glusterBlockVolumeInit(%s) failed", blk->volume);
+    goto optfail;
+  }
+
+  lkfd = glusterBlockCreateMetaLockFile(glfs, blk->volume, "rebalance",
+                                        &errCode, &errMsg);
+  if (!lkfd) {
+    LOG("mgmt", GB_LOG_ERROR, "%s %s", FAILED_CREATING_META, blk->volume);
+    goto optfail;
+  }
+
+  /*
+   * The plan is made under the namespace lock only, each block is checked
+   * again under its own lock before it moves, see blockRebalanceLock().
+   */
+  GB_METANSLOCK_OR_GOTO(lkfd, F_WRLCK, blk->volume, errCode, errMsg, optfail);
+  LOG("cmdlog", GB_LOG_INFO, "%s", blk->cmd);
+
+  if (blockIndexLoad(glfs, blk->volume, &index, &dirty, &errCode)) {
+    LOG("mgmt", GB_LOG_ERROR, "%s %s", FAILED_REBALANCE, blk->volume);
+    goto out;
+  }
+  if (dirty) {
+    blockIndexWrite(glfs, blk->volume, index, &err);
+  }
+  nblocks = index->nblocks;
+
+  if (blockRebalancePlan(index, &load, &moves, &nmoves)) {
+    errCode = ENOMEM;
+    goto out;
+  }
+  /* block locks come before the namespace lock */
+  GB_METANSUNLOCK(lkfd, blk->volume);
+
+  if (GB_ALLOC(list) < 0 || GB_ALLOC_N(batch, GB_REBALANCE_BATCH) < 0) {
+    errCode = ENOMEM;
+    goto out;
+  }
+  for (i = 0; i < nmoves; i++) {
+    if (strcmp(moves[i].prio_path, moves[i].e->prio_path) &&
+        blockRebalanceAddHosts(list, moves[i].hosts)) {
+      errCode = ENOMEM;
+      goto out;
+    }
+  }
+
+  if (list->nhosts) {
+    errCode = glusterBlockCheckCapabilities((void *)blk, REBALANCE_SRV, list,
+                                            NULL, &errMsg);
+    if (errCode) {
+      LOG("mgmt", GB_LOG_ERROR,
+          "glusterBlockCheckCapabilities() for volume %s failed",
+          blk->volume);
+      goto out;
+    }
+  }
+
+  for (i = 0; i < nmoves; i++) {
+    if (!strcmp(moves[i].prio_path, moves[i].e->prio_path)) {
+      continue;
+    }
+    batch[nbatch++] = &moves[i];
+    if (nbatch == GB_REBALANCE_BATCH) {
+      blockRebalanceBatch(glfs, lkfd, blk->volume, batch, nbatch);
+      nbatch = 0;
+    }
+  }
+  if (nbatch) {
+    blockRebalanceBatch(glfs, lkfd, blk->volume, batch, nbatch);
+  }
+
+  for (i = 0; i < nmoves; i++) {
+    if (!strcmp(moves[i].prio_path, moves[i].e->prio_path)) {
+      continue;
+    }
+    if (moves[i].skipped) {
+      skipped++;
+      continue;
+    }
+    if (!moves[i].failed) {
+      moved++;
+      continue;
+    }
+    failed++;
+    if (GB_ASPRINTF(&tmp, "%s%s%s", failed_on ? failed_on : "",
+                    failed_on ? " " : "", moves[i].e->name) != -1) {
+      GB_FREE(failed_on);
+      failed_on = tmp;
+    }
+  }
+
+  /* prio.info follows what the metafiles say now */
+  GB_METANSLOCK_OR_GOTO(lkfd, F_WRLCK, blk->volume, errCode, errMsg, out);
+  if (glusterBlockRecountPrio(glfs, blk->volume, &prio, &errCode, &errMsg)) {
+    LOG("mgmt", GB_LOG_ERROR, "%s %s", FAILED_REBALANCE, blk->volume);
+    goto out;
+  }
+
+  /* the blocks that didn't move still have their old, working AO path */
+  if (failed) {
+    errCode = EIO;
+    GB_ASPRINTF(&errMsg, "moving the prio path of %zu blocks of volume %s "
+                "failed (%s), see the logs and retry", failed, blk->volume,
+                failed_on ? failed_on : "");
+    goto out;
+  }
+
+  errCode = 0;
+
+ out:
+  GB_METAUNLOCK(lkfd, blk->volume, errCode, errMsg);
+
+ optfail:
+  LOG("mgmt", ((!!errCode) ? GB_LOG_ERROR : GB_LOG_INFO),
+      "rebalance cli return %s, volume=%s blocks=%zu moved=%zu failed=%zu "
+      "skipped=%zu", errCode ? "failure" : "success", blk->volume, nblocks,
+      moved, failed, skipped);
+
+  if (errCode < 0) {
+    errCode = GB_DEFAULT_ERRCODE;
+  }
+
+  reply->exit = errCode;
+
+  if (blk->json_resp) {
+    json_obj = json_object_new_object();
+    if (errCode) {
+      json_object_object_add(json_obj, "RESULT", GB_JSON_OBJ_TO_STR("FAIL"));
+      json_object_object_add(json_obj, "errCode", json_object_new_int(errCode));
+      json_object_object_add(json_obj, "errMsg",  GB_JSON_OBJ_TO_STR(errMsg));
+    } else {
+      json_object_object_add(json_obj, "BLOCKS", json_object_new_int64(nblocks));
+      json_object_object_add(json_obj, "MOVED", json_object_new_int64(moved));
+      json_prio = json_object_new_object();
+      for (i = 0; i < prio.nhosts; i++) {
+        json_object_object_add(json_prio, prio.hosts[i].addr,
+                               json_object_new_int64(prio.hosts[i].count));
+      }
+      json_object_object_add(json_obj, "PRIOPATHS", json_prio);
+      json_object_object_add(json_obj, "RESULT", GB_JSON_OBJ_TO_STR("SUCCESS"));
+    }
+    GB_ASPRINTF(&reply->out, "%s\n",
+                json_object_to_json_string_ext(json_obj,
+                                mapJsonFlagToJsonCstring(blk->json_resp)));
+    json_object_put(json_obj);
+  } else {
+    if (errCode) {
+      if (errMsg) {
+        GB_ASPRINTF (&reply->out, "%s\n", errMsg);
+      } else {
+        GB_ASPRINTF (&reply->out, "Not able to complete operation "
+                     "successfully\n");
+      }
+    } else {
+      for (i = 0; i < prio.nhosts; i++) {
+        if (GB_ASPRINTF(&tmp, "%s%s%s=%zu", prio_out ? prio_out : "",
+                        prio_out ? " " : "", prio.hosts[i].addr,
+                        prio.hosts[i].count) == -1) {
+          break;
+        }
+        GB_FREE(prio_out);
+        prio_out = tmp;
+      }
+      GB_ASPRINTF(&reply->out, "BLOCKS: %zu\nMOVED: %zu\nPRIOPATHS: %s\n"
+                  "RESULT: SUCCESS\n", nblocks, moved,
+                  prio_out ? prio_out : "");
+    }
+  }
+  LOG("cmdlog", ((!!errCode) ? GB_LOG_ERROR : GB_LOG_INFO), "%s",
+      reply->out ? reply->out : "*Nil*");
+
+  if (lkfd && glfs_close(lkfd) != 0) {
+    LOG("mgmt", GB_LOG_ERROR, "glfs_close(%s): on volume %s failed[%s]",
+        GB_TXLOCKFILE, blk->volume, strerror(errno));
+  }
+  glusterBlockVolumeRelease(glfs);
+
+  for (i = 0; i < nmoves; i++) {
+    blockServerDefFree(moves[i].hosts);
+    blockServerDefFree(moves[i].list);
+    blockFreeMetaInfo(moves[i].info);
+  }
+  GB_FREE(moves);
+  GB_FREE(batch);
+  blockServerDefFree(list);
+  blockIndexFree(index);
+  blockPrioTableFree(&load);
+  blockPrioTableFree(&prio);
+  GB_FREE(prio_out);
+  GB_FREE(failed_on);
+  GB_FREE(errMsg);
+
+  return reply;
+}
+
+
+/* the first line of targetcli's listing of the tpg serving portal addr */
+static char *
+blockRebalancePortalTpg(char *gbid, char *addr)
+{
+  char *exec = NULL;
+  char *tpg = NULL;
+
+
+  if (GB_ASPRINTF(&exec, GB_GET_PORTAL_TPG, gbid, addr, addr) == -1) {
+    return NULL;
+  }
+
+  tpg = gbRunnerGetOutput(exec);
+  if (tpg && strncmp(tpg, "tpg", 3)) {
+    GB_FREE(tpg);
+  }
+  GB_FREE(exec);
+
+  return tpg;
+}
+
+
+static blockResponse *
+block_rebalance_1_svc_st(blockRebalance *blk, struct svc_req *rqstp)
+{
+  blockResponse *reply = NULL;
+  char *ao_tpg = NULL;
+  char *ano_tpg = NULL;
+  char *ano = NULL;
+  char *save = NULL;
+  char *exec = NULL;
+
+
+  LOG("mgmt", GB_LOG_INFO,
+      "rebalance request, volume=%s blockname=%s iqn=%s old_prio=%s "
+      "prio_path=%s", blk->volume, blk->block_name, blk->gbid,
+      blk->old_prio, blk->prio_path);
+
+  if (GB_ALLOC(reply) < 0) {
+    goto out;
+  }
+  reply->exit = -1;
+
+  if (GB_ALLOC_N(reply->out, 8192) < 0) {
+    GB_FREE(reply);
+    goto out;
+  }
+
+  ao_tpg = blockRebalancePortalTpg(blk->gbid, blk->prio_path);
+  if (!ao_tpg) {
+    snprintf(reply->out, 8192, "failed to get tpg of portal %s", blk->prio_path);
+    goto out;
+  }
+
+  /* a replaced node took its portal along, nothing to leave the AO group */
+  if (blk->old_prio[0] && strcmp(blk->old_prio, blk->prio_path)) {
+    ano_tpg = blockRebalancePortalTpg(blk->gbid, blk->old_prio);
+    if (ano_tpg &&
+        GB_ASPRINTF(&ano, "%s/%s%s/%s/luns/lun0 set alua alua_tg_pt_gp_name=%s\n",
+                    GB_TGCLI_ISCSI_PATH, GB_TGCLI_IQN_PREFIX, blk->gbid,
+                    ano_tpg, GB_ALUA_ANO_TPG_NAME) == -1) {
+      goto out;
+    }
+  }
+
+  if (GB_ASPRINTF(&save, GB_TGCLI_GLFS_SAVE, blk->block_name) == -1) {
+    goto out;
+  }
+
+  if (GB_ASPRINTF(&exec,
+                  "targetcli <<EOF\n%s%s/%s%s/%s/luns/lun0 set alua "
+                  "alua_tg_pt_gp_name=%s\n%s\nexit\nEOF",
+                  ano ? ano : "", GB_TGCLI_ISCSI_PATH, GB_TGCLI_IQN_PREFIX,
+                  blk->gbid, ao_tpg, GB_ALUA_AO_TPG_NAME, save) == -1) {
+    goto out;
+  }
+
+  GB_CMD_EXEC_AND_VALIDATE(exec, reply, blk, blk->volume, REBALANCE_SRV);
+  if (reply->exit) {
+    snprintf(reply->out, 8192, "prio path change failed");
+    goto out;
+  }
+
+ out:
+  GB_FREE(ao_tpg);
+  GB_FREE(ano_tpg);
+  GB_FREE(ano);
+  GB_FREE(save);
+  GB_FREE(exec);
+  return reply;
+}
+
+
+bool_t
+block_rebalance_1_svc(blockRebalance *blk, blockResponse *reply,
+                      struct svc_req *rqstp)
+{
+  int ret;
+
+  GB_RPC_CALL(rebalance, blk, reply, rqstp, ret);
+  return ret;
+}
+
+
+bool_t
+block_rebalance_cli_1_svc(blockRebalanceCli *blk, blockResponse *reply,
+                          struct svc_req *rqstp)
+{
+  int ret;
+
+  GB_RPC_CALL(rebalance_cli, blk, reply, rqstp, ret);
+  return ret;
+}
@@ -0,0 +1,151 @@
+/*
+  Copyright (c) 2016 Red Hat, Inc. <http://www.redhat.com>
+  This file is part of gluster-block.
+
+  This file is licensed to you under your choice of the GNU Lesser
+  General Public License, version 3 or any later version (LGPLv3 or
+  later), or the GNU General Public License, version 2 (GPLv2), in all
+  cases as published by the Free Software Foundation.
+*/
+
+
+# include  "block_common.h"
+
+
+static blockResponse *
+block_reindex_cli_1_svc_st(blockReindexCli *blk, struct svc_req *rqstp)
+{
+  blockResponse *reply = NULL;
+  struct glfs *glfs = NULL;
+  struct glfs_fd *lkfd = NULL;
+  json_object *json_obj = NULL;
+  json_object *json_prio = NULL;
+  BlockPrioTable prio = {0, };
+  char *prio_out = NULL;
+  char *tmp;
+  size_t nblocks = 0;
+  size_t i;
+  int errCode = -1;
+  char *errMsg = NULL;
+
+
+  LOG("mgmt", GB_LOG_INFO, "reindex cli request, volume=%s", blk->volume);
+
+  if (GB_ALLOC(reply) < 0) {
+    return NULL;
+  }
+
+  errCode = 0;
+  glfs = glusterBlockVolumeInit(blk->volume, &errCode, &errMsg);
+  if (!glfs) {
+    LOG("mgmt", GB_LOG_ERROR,
+        "glusterBlockVolumeInit(%s) failed", blk->volume);
+    goto optfail;
+  }
+
+  lkfd = glusterBlockCreateMetaLockFile(glfs, blk->volume, "reindex",
+                                        &errCode, &errMsg);
+  if (!lkfd) {
+    LOG("mgmt", GB_LOG_ERROR, "%s %s", FAILED_CREATING_META, blk->volume);
+    goto optfail;
+  }
+
+  /* exclusive, so no create/delete/modify appends while we rewrite */
+  GB_METANSLOCK_OR_GOTO(lkfd, F_WRLCK, blk->volume, errCode, errMsg, optfail);
+
+  if (glusterBlockRebuildIndex(glfs, blk->volume, &nblocks,
+                               &errCode, &errMsg)) {
+    LOG("mgmt", GB_LOG_ERROR, "%s %s", FAILED_REINDEX, blk->volume);
+    goto out;
+  }
+
+  /* prio.info counts follow from the PRIOPATHs just indexed */
+  if (glusterBlockRecountPrio(glfs, blk->volume, &prio, &errCode, &errMsg)) {
+    LOG("mgmt", GB_LOG_ERROR, "%s %s", FAILED_REINDEX, blk->volume);
+    goto out;
+  }
+
+  errCode = 0;
+
+ out:
+  GB_METAUNLOCK(lkfd, blk->volume, errCode, errMsg);
+
+ optfail:
+  LOG("mgmt", ((!!errCode) ? GB_LOG_ERROR : GB_LOG_INFO),
+      "reindex cli return %s, volume=%s blocks=%zu",
+      errCode ? "failure" : "success", blk->volume, nblocks);
+
+  if (errCode < 0) {
+    errCode = GB_DEFAULT_ERRCODE;
+  }
+
+  reply->exit = errCode;
+
+  if (blk->json_resp) {
+    json_obj = json_object_new_object();
+    if (errCode) {
+      json_object_object_add(json_obj, "RESULT", GB_JSON_OBJ_TO_STR("FAIL"));
+      json_object_object_add(json_obj, "errCode", json_object_new_int(errCode));
+      json_object_object_add(json_obj, "errMsg",  GB_JSON_OBJ_TO_STR(errMsg));
+    } else {
+      json_object_object_add(json_obj, "BLOCKS", json_object_new_int64(nblocks));
+      json_prio = json_object_new_object();
+      for (i = 0; i < prio.nhosts; i++) {
+        json_object_object_add(json_prio, prio.hosts[i].addr,
+                               json_object_new_int64(prio.hosts[i].count));
+      }
+      json_object_object_add(json_obj, "PRIOPATHS", json_prio);
+      json_object_object_add(json_obj, "RESULT", GB_JSON_OBJ_TO_STR("SUCCESS"));
+    }
+    GB_ASPRINTF(&reply->out, "%s\n",
+                json_object_to_json_string_ext(json_obj,
+                                mapJsonFlagToJsonCstring(blk->json_resp)));
+    json_object_put(json_obj);
+  } else {
+    if (errCode) {
+      if (errMsg) {
+        GB_ASPRINTF (&reply->out, "%s\n", errMsg);
+      } else {
+        GB_ASPRINTF (&reply->out, "Not able to complete operation "
+                     "successfully\n");
+      }
+    } else {
+      for (i = 0; i < prio.nhosts; i++) {
+        if (GB_ASPRINTF(&tmp, "%s%s%s=%zu", prio_out ? prio_out : "",
+                        prio_out ? " " : "", prio.hosts[i].addr,
+                        prio.hosts[i].count) == -1) {
+          break;
+        }
+        GB_FREE(prio_out);
+        prio_out = tmp;
+      }
+      GB_ASPRINTF(&reply->out, "BLOCKS: %zu\nPRIOPATHS: %s\nRESULT: SUCCESS\n",
+                  nblocks, prio_out ? prio_out : "");
+    }
+  }
+  LOG("cmdlog", ((!!errCode) ? GB_LOG_ERROR : GB_LOG_INFO), "%s",
+      reply->out ? reply->out : "*Nil*");
+
+  if (lkfd && glfs_close(lkfd) != 0) {
+    LOG("mgmt", GB_LOG_ERROR, "glfs_close(%s): on volume %s failed[%s]",
+        GB_TXLOCKFILE, blk->volume, strerror(errno));
+  }
+  glusterBlockVolumeRelease(glfs);
+
+  blockPrioTableFree(&prio);
+  GB_FREE(prio_out);
+  GB_FREE(errMsg);
+
+  return reply;
+}
+
+
+bool_t
+block_reindex_cli_1_svc(blockReindexCli *blk, blockResponse *reply,
+                        struct svc_req *rqstp)
+{
+  int ret;
+
+  GB_RPC_CALL(reindex_cli, blk, reply, rqstp, ret);
+  return ret;
+}
@@ -90,7 +90,6 @@ glusterBlockReloadRemoteAsync(MetaInfo *info,
                               bool force,
                               blockRemoteDeleteResp **savereply)
 {
-  pthread_t  *tid = NULL;
   blockRemoteDeleteResp *local = *savereply;
   blockRemoteObj *args = NULL;
   char *d_attempt = NULL;
@@ -103,19 +102,13 @@ glusterBlockReloadRemoteAsync(MetaInfo *info,
 
 
   count = glusterBlockReloadFillArgs(info, NULL, NULL, NULL);
-  if (GB_ALLOC_N(tid, count) < 0  || GB_ALLOC_N(args, count) < 0) {
+  if (GB_ALLOC_N(args, count) < 0) {
     goto out;
   }
 
   count = glusterBlockReloadFillArgs(info, args, glfs, robj);
 
-  for (i = 0; i < count; i++) {
-    pthread_create(&tid[i], NULL, glusterBlockReloadRemote, &args[i]);
-  }
-
-  for (i = 0; i < count; i++) {
-    pthread_join(tid[i], NULL);
-  }
+  glusterBlockFanout(glusterBlockReloadRemote, args, count, TIMEOUT.tv_sec);
 
   ret = glusterBlockCollectAttemptSuccess(args, info, RELOAD_SRV, count,
                                           &d_attempt, &d_success);
@@ -163,7 +156,6 @@ glusterBlockReloadRemoteAsync(MetaInfo *info,
   GB_FREE(d_attempt);
   GB_FREE(d_success);
   GB_FREE(args);
-  GB_FREE(tid);
 
   return ret;
 }
@@ -238,7 +230,7 @@ block_reload_cli_1_svc_st(blockReloadCli *blk, struct svc_req *rqstp)
   blockRemoteDeleteResp *savereply = NULL;
   MetaInfo *info = NULL;
   blockResponse *reply = NULL;
-  struct glfs *glfs;
+  struct glfs *glfs = NULL;
   struct glfs_fd *lkfd = NULL;
   char *errMsg = NULL;
   int errCode = -1;
@@ -267,17 +259,19 @@ block_reload_cli_1_svc_st(blockReloadCli *blk, struct svc_req *rqstp)
     goto optfail;
   }
 
-  lkfd = glusterBlockCreateMetaLockFile(glfs, blk->volume, &errCode, &errMsg);
+  lkfd = glusterBlockCreateMetaLockFile(glfs, blk->volume, "reload",
+                                        &errCode, &errMsg);
   if (!lkfd) {
     LOG("mgmt", GB_LOG_ERROR, "%s %s for block %s",
         FAILED_CREATING_META, blk->volume, blk->block_name);
     goto optfail;
   }
 
-  GB_METALOCK_OR_GOTO(lkfd, blk->volume, errCode, errMsg, optfail);
+  GB_METABLKLOCK_OR_GOTO(lkfd, F_WRLCK, blk->volume, blk->block_name,
+                         errCode, errMsg, optfail);
   LOG("cmdlog", GB_LOG_INFO, "%s", blk->cmd);
 
-  if (glfs_access(glfs, blk->block_name, F_OK)) {
+  if (glusterBlockMetaFileAccess(glfs, blk->block_name, F_OK)) {
     errCode = errno;
     if (errCode == ENOENT) {
       GB_ASPRINTF(&errMsg, "block %s/%s doesn't exist",
@@ -345,6 +339,7 @@ block_reload_cli_1_svc_st(blockReloadCli *blk, struct svc_req *rqstp)
         "glfs_close(%s): for block %s on volume %s failed[%s]",
         GB_TXLOCKFILE, blk->block_name, blk->volume, strerror(errno));
   }
+  glusterBlockVolumeRelease(glfs);
 
   blockReloadCliFormatResponse(blk, errCode, errMsg, savereply, reply);
   LOG("cmdlog", ((!!errCode) ? GB_LOG_ERROR : GB_LOG_INFO), "%s",
@@ -11,8 +11,6 @@
 
 # include  "block_common.h"
 
-# define   GB_GET_PORTAL_TPG    "targetcli /iscsi/" GB_TGCLI_IQN_PREFIX \
-                                "'%s' ls | grep -e tpg -e '%s' | grep -B1 '%s' | grep -o 'tpg\\w'"
 # define   GB_CHECK_PORTAL      "targetcli /iscsi/" GB_TGCLI_IQN_PREFIX \
                                 "'%s' ls | grep '%s' > " DEVNULLPATH
 
@@ -42,7 +40,7 @@ glusterBlockReplacePortalRemote(void *data)
   bool rpc_sent = FALSE;
 
 
-  GB_METAUPDATE_OR_GOTO(lock, args->glfs, robj.block_name, robj.volume,
+  GB_METAUPDATE_OR_GOTO(args->glfs, robj.block_name, robj.volume,
                         ret, errMsg, out, "%s: RPINPROGRESS\n", args->addr);
 
   ret = glusterBlockCallRPC_1(args->addr, &robj, REPLACE_SRV, &rpc_sent,
@@ -60,7 +58,7 @@ glusterBlockReplacePortalRemote(void *data)
       args->reply = NULL;
     }
 
-    GB_METAUPDATE_OR_GOTO(lock, args->glfs, robj.block_name, robj.volume,
+    GB_METAUPDATE_OR_GOTO(args->glfs, robj.block_name, robj.volume,
                           ret, errMsg, out, "%s: RPFAIL\n", args->addr);
     LOG("mgmt", GB_LOG_ERROR, "%s for block %s on host %s volume %s",
         FAILED_REMOTE_CREATE, robj.block_name, args->addr, args->volume);
@@ -69,7 +67,7 @@ glusterBlockReplacePortalRemote(void *data)
     goto out;
   }
 
-  GB_METAUPDATE_OR_GOTO(lock, args->glfs, robj.block_name, robj.volume,
+  GB_METAUPDATE_OR_GOTO(args->glfs, robj.block_name, robj.volume,
                         ret, errMsg, out, "%s: RPSUCCESS\n", args->addr);
 
 out:
@@ -92,7 +90,7 @@ glusterBlockReplaceNodeRemoteAsync(struct glfs *glfs, blockReplaceCli *blk,
                                     blockRemoteReplaceResp **savereply)
 {
   blockRemoteReplaceResp *reply = NULL;
-  pthread_t  *tid = NULL;
+  gbFanout *fo = NULL;
   blockRemoteObj *args = NULL;
   blockCreate2 *cobj = NULL;
   blockDelete *dobj = NULL;
@@ -103,6 +101,7 @@ glusterBlockReplaceNodeRemoteAsync(struct glfs *glfs, blockReplaceCli *blk,
   bool dCheck = false;
   bool rCheck = false;
   bool newNodeInUse = false;
+  NodeInfo *node = NULL;
   char *tmp = NULL;
   size_t i = 0, j = 1;
   int ret = -1;
@@ -222,24 +221,22 @@ glusterBlockReplaceNodeRemoteAsync(struct glfs *glfs, blockReplaceCli *blk,
   args[info->mpath].volume = blk->volume;
 
   /* -> Make Sure Old Node is currenly in use */
-  if (blockGetHostStatus(info, blk->old_node) == GB_METASTATUS_MAX) {
+  status = blockGetHostStatus(info, blk->old_node);
+  if (status == GB_METASTATUS_MAX) {
     ret = GB_NODE_NOT_EXIST;
     LOG("mgmt", GB_LOG_WARNING, "block %s is not configured on node %s for volume %s",
         blk->block_name,  blk->old_node, blk->volume);
     goto out;
-  } else if (blockGetHostStatus(info, blk->old_node) == GB_CLEANUP_SUCCESS) {
+  } else if (status == GB_CLEANUP_SUCCESS) {
     dCheck = true; /* Old node deleted, but we are not sure when though */
   }
 
   /* -> Make Sure New Node is not already consumed by this block */
-  for (i = 0; i < info->nhosts; i++) {
-    if (!strcmp(info->list[i]->addr, blk->new_node) && blockhostIsValid(info->list[i]->status)) {
-      newNodeInUse = true;  /* New node in use */
-      status = blockMetaStatusEnumParse(info->list[i]->status);
-      if (status == GB_AUTH_ENFORCED || status == GB_CONFIG_SUCCESS) {
-        cCheck = true;  /* New node is freshly configured */
-      }
-      break;
+  node = blockMetaInfoGetNode(info, blk->new_node);
+  if (node && blockhostIsValid(node->status)) {
+    newNodeInUse = true;  /* New node in use */
+    if (node->st == GB_AUTH_ENFORCED || node->st == GB_CONFIG_SUCCESS) {
+      cCheck = true;  /* New node is freshly configured */
     }
   }
 
@@ -291,13 +288,11 @@ glusterBlockReplaceNodeRemoteAsync(struct glfs *glfs, blockReplaceCli *blk,
     }
   }
 
-  if (GB_ALLOC_N(tid, info->mpath + 1) < 0) {
-    goto out;
-  }
+  fo = glusterBlockFanoutNew(info->mpath + 1, TIMEOUT.tv_sec);
 
   /* Create */
   if (!cCheck) {
-    pthread_create(&tid[0], NULL, glusterBlockCreateRemote, &args[0]);
+    glusterBlockFanoutAdd(fo, glusterBlockCreateRemote, &args[0]);
   } else {
     reply->cop->status = GB_OP_SKIPPED; /* skip */
     if (GB_STRDUP(reply->cop->skipped, args[0].addr) < 0) {
@@ -308,7 +303,7 @@ glusterBlockReplaceNodeRemoteAsync(struct glfs *glfs, blockReplaceCli *blk,
   /* Replace Portal */
   if (rCheck) {
     for (i = 1; i < info->mpath; i++) {
-      pthread_create(&tid[i], NULL, glusterBlockReplacePortalRemote, &args[i]);
+      glusterBlockFanoutAdd(fo, glusterBlockReplacePortalRemote, &args[i]);
     }
   } else {
     reply->rop->status = GB_OP_SKIPPED; /* skip */
@@ -325,7 +320,7 @@ glusterBlockReplaceNodeRemoteAsync(struct glfs *glfs, blockReplaceCli *blk,
 
   /* Delete */
   if (!dCheck) {
-    pthread_create(&tid[info->mpath], NULL, glusterBlockDeleteRemote, &args[info->mpath]);
+    glusterBlockFanoutAdd(fo, glusterBlockDeleteRemote, &args[info->mpath]);
   } else {
     reply->dop->status = GB_OP_SKIPPED; /* skip */
     if (GB_STRDUP(reply->dop->skipped, args[info->mpath].addr) < 0) {
@@ -333,17 +328,8 @@ glusterBlockReplaceNodeRemoteAsync(struct glfs *glfs, blockReplaceCli *blk,
     }
   }
 
-  if (!cCheck) {
-    pthread_join(tid[0], NULL);
-  }
-  if (rCheck) {
-    for (i = 1; i < info->mpath; i++) {
-      pthread_join(tid[i], NULL);
-    }
-  }
-  if (!dCheck) {
-    pthread_join(tid[info->mpath], NULL);
-  }
+  glusterBlockFanoutWait(fo);
+  fo = NULL;
 
   /* Collect results */
   if (!cCheck) {
@@ -405,7 +391,8 @@ glusterBlockReplaceNodeRemoteAsync(struct glfs *glfs, blockReplaceCli *blk,
     *savereply = reply;
     reply = NULL;
   }
-  GB_FREE(tid);
+  /* the calls still use args */
+  glusterBlockFanoutWait(fo);
   GB_FREE(xdata);
   GB_FREE(cobj);
   GB_FREE(dobj);
@@ -646,8 +633,9 @@ block_replace_cli_1_svc_st(blockReplaceCli *blk, struct svc_req *rqstp)
 {
   blockRemoteReplaceResp *savereply = NULL;
   blockResponse *reply = NULL;
-  struct glfs *glfs;
+  struct glfs *glfs = NULL;
   struct glfs_fd *lkfd = NULL;
+  struct MetaJournal *journal = NULL;
   int errCode = -1;
   char *errMsg = NULL;
   int ret;
@@ -672,16 +660,19 @@ block_replace_cli_1_svc_st(blockReplaceCli *blk, struct svc_req *rqstp)
     goto optfail;
   }
 
-  lkfd = glusterBlockCreateMetaLockFile(glfs, blk->volume, &errCode, &errMsg);
+  lkfd = glusterBlockCreateMetaLockFile(glfs, blk->volume, "replace",
+                                        &errCode, &errMsg);
   if (!lkfd) {
     LOG("mgmt", GB_LOG_ERROR, "%s %s", FAILED_CREATING_META, blk->volume);
     goto optfail;
   }
 
-  GB_METALOCK_OR_GOTO(lkfd, blk->volume, errCode, errMsg, optfail);
+  GB_METABLKLOCK_OR_GOTO(lkfd, F_WRLCK, blk->volume, blk->block_name,
+                         errCode, errMsg, optfail);
+  journal = blockMetaJournalHold(glfs, blk->volume, blk->block_name);
   LOG("cmdlog", GB_LOG_INFO, "%s", blk->cmd);
 
-  if (glfs_access(glfs, blk->block_name, F_OK)) {
+  if (glusterBlockMetaFileAccess(glfs, blk->block_name, F_OK)) {
     errCode = errno;
     if (errCode == ENOENT) {
       GB_ASPRINTF(&errMsg, "block %s/%s doesn't exist",
@@ -698,11 +689,22 @@ block_replace_cli_1_svc_st(blockReplaceCli *blk, struct svc_req *rqstp)
     goto out;
   }
 
-  ret = blockParseValidServers(glfs, blk->block_name, &errCode, &list,
-                               blk->force?blk->old_node:NULL);
+  if (GB_ALLOC(info) < 0) {
+    errCode = ENOMEM;
+    goto out;
+  }
+  ret = blockGetMetaInfo(glfs, blk->block_name, info, NULL);
   if (ret) {
-    LOG("mgmt", GB_LOG_ERROR, "blockParseValidServers(%s): on volume %s failed[%s]",
-        blk->block_name, blk->volume, strerror(errno));
+    errCode = ret;
+    goto out;
+  }
+
+  /* still exclusive here, fold old history before adding to it */
+  glusterBlockCompactMetaFile(glfs, blk->volume, blk->block_name, info);
+
+  list = blockMetaInfoToValidServers(info, blk->force?blk->old_node:NULL);
+  if (!list) {
+    errCode = ENOMEM;
     goto out;
   }
 
@@ -714,16 +716,23 @@ block_replace_cli_1_svc_st(blockReplaceCli *blk, struct svc_req *rqstp)
     goto out;
   }
 
-  if (GB_ALLOC(info) < 0) {
+  /* the new node will read and log to this block's metafile */
+  blockServerDefFree(list);
+  list = blockServerParse(blk->new_node);
+  if (!list) {
     errCode = ENOMEM;
     goto out;
   }
-  ret = blockGetMetaInfo(glfs, blk->block_name, info, NULL);
-  if (ret) {
-    errCode = ret;
+
+  errCode = glusterBlockCheckMetaVersionCaps(glfs, blk->volume, list, &errMsg);
+  if (errCode) {
+    LOG("mgmt", GB_LOG_ERROR,
+        "glusterBlockCheckMetaVersionCaps() for block %s on volume %s failed",
+        blk->block_name, blk->volume);
     goto out;
   }
 
+  GB_METALOCK_DOWNGRADE(lkfd, blk->volume, blk->block_name);
   ret = glusterBlockReplaceNodeRemoteAsync(glfs, blk, info, blk->block_name, &savereply);
   if (ret) {
     LOG("mgmt", GB_LOG_WARNING, "glusterBlockReplaceNodeRemoteAsync: return"
@@ -742,15 +751,19 @@ block_replace_cli_1_svc_st(blockReplaceCli *blk, struct svc_req *rqstp)
     }
   }
   if (savereply && savereply->force && savereply->dop->status) {
-    GB_METAUPDATE_OR_GOTO(lock, glfs,  blk->block_name,  blk->volume,
+    GB_METAUPDATE_OR_GOTO(glfs,  blk->block_name,  blk->volume,
                           errCode, errMsg, out, "%s: CLEANUPSUCCESS\n", blk->old_node);
   }
   if (info->prio_path[0] && !strcmp(info->prio_path, blk->old_node)) {
-    GB_METAUPDATE_OR_GOTO(lock, glfs, blk->block_name, blk->volume,
+    GB_METANSLOCK_OR_GOTO(lkfd, F_WRLCK, blk->volume, errCode, errMsg, out);
+    GB_METAUPDATE_OR_GOTO(glfs, blk->block_name, blk->volume,
         errCode, errMsg, out, "PRIOPATH: %s\n", blk->new_node);
+    blockMovePrioCount(glfs, blk->volume, blk->old_node, blk->new_node);
   }
 
  out:
+  blockIndexCommit(glfs, lkfd, blk->volume, blk->block_name, journal);
+  blockMetaJournalRelease(journal);
   GB_METAUNLOCK(lkfd, blk->volume, errCode, errMsg);
   blockReplaceNodeCliFormatResponse(blk, errCode, errMsg, savereply, reply);
   LOG("cmdlog", ((!!errCode) ? GB_LOG_ERROR : GB_LOG_INFO), "%s",
@@ -769,6 +782,7 @@ optfail:
         "glfs_close(%s): on volume %s for block %s failed[%s]",
         GB_TXLOCKFILE, blk->volume, blk->block_name, strerror(errno));
   }
+  glusterBlockVolumeRelease(glfs);
 
   GB_FREE(errMsg);
 
@@ -784,6 +798,7 @@ block_replace_1_svc_st(blockReplace *blk, struct svc_req *rqstp)
   char *save = NULL;
   char *exec = NULL;
   char *tpg;
+  char *saveptr = NULL;
 
 
   LOG("mgmt", GB_LOG_INFO,
@@ -823,7 +838,7 @@ block_replace_1_svc_st(blockReplace *blk, struct svc_req *rqstp)
     goto out;
   }
   GB_FREE(exec);
-  tpg = strtok(reply->out, "\n");
+  tpg = strtok_r(reply->out, "\n", &saveptr);
 
   if (GB_ASPRINTF(&path, "%s/%s%s/%s/portals", GB_TGCLI_ISCSI_PATH,
                   GB_TGCLI_IQN_PREFIX, blk->gbid, tpg) == -1) {
@@ -14,9 +14,6 @@
 # define   GB_SAVECFG_GBID_CHECK "grep -m 1 '\"config\":.*/block-store/%s\",' " GB_SAVECONFIG " > " DEVNULLPATH
 
 
-pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
-
-
 int
 mapJsonFlagToJsonCstring(int jsonflag)
 {
@@ -71,17 +68,18 @@ void
 blockStr2arrayAddToJsonObj(json_object *json_obj, char *string, char *label)
 {
   char *tmp = NULL;
+  char *saveptr = NULL;
   json_object *json_array = NULL;
 
   if (!string)
     return;
 
   json_array = json_object_new_array();
-  tmp = strtok (string, " ");
+  tmp = strtok_r(string, " ", &saveptr);
   while (tmp != NULL)
   {
     json_object_array_add(json_array, GB_JSON_OBJ_TO_STR(tmp));
-    tmp = strtok (NULL, " ");
+    tmp = strtok_r(NULL, " ", &saveptr);
   }
   json_object_object_add(json_obj, label, json_array);
 }
@@ -175,76 +173,34 @@ blockCheckBlockLoadedStatus(char *block_name, char *gbid, blockResponse *reply)
 char*
 blockInfoGetCurrentSizeOfNode(char *block_name, MetaInfo *info, char *host)
 {
-  int i, j;
-  char *tok;
+  NodeInfo *node;
   char *hr_size = NULL;
-  size_t size = 0;
-  bool noRsSuccess = true;
+  size_t size;
 
   if (!host)
     return NULL;
 
-  for (i = 0; i < info->nhosts; i++) {
-    if(strcmp(info->list[i]->addr, host)) {
-      continue;
+  node = blockMetaInfoGetNode(info, host);
+  if (node && node->rs_seen) {
+    if (node->rs_size < 0) {
+      return NULL;
     }
-    for (j = info->list[i]->nenties-1; j >= 0; j--) {
-      if (!strstr(info->list[i]->st_journal[j], MetaStatusLookup[GB_RS_SUCCESS])) {
-        continue;
-      }
-      noRsSuccess = false;
-      tok = strstr(info->list[i]->st_journal[j], "-");
-      if (!tok) {
-        return NULL;
-      }
-      sscanf(tok+1, "%zu", &size);
-      goto success;
-    }
-  }
-
-  if (noRsSuccess) {
+    size = node->rs_size;
+  } else {
     size = info->initial_size;
-    goto success;
   }
 
-  return NULL;
-
- success:
   hr_size = glusterBlockFormatSize("mgmt", size);
   if (!hr_size) {
     LOG("mgmt", GB_LOG_WARNING,
         "failed to get previous size of portal %s for blockname=%s",
-        info->list[i]->addr, block_name);
+        host, block_name);
     return NULL;
   }
   return hr_size;
 }
 
 
-static struct addrinfo *
-glusterBlockGetSockaddr(char *host)
-{
-  int ret;
-  struct addrinfo hints, *res;
-
-  memset(&hints, 0, sizeof hints);
-  hints.ai_family = AF_INET;
-  hints.ai_socktype = SOCK_STREAM;
-
-  ret = getaddrinfo(host, GB_TCP_PORT_STR, &hints, &res);
-  if (ret) {
-    LOG("mgmt", GB_LOG_ERROR, "getaddrinfo(%s) failed (%s)",
-        host, gai_strerror(ret));
-    goto out;
-  }
-
-  return res;
-
- out:
-  return NULL;
-}
-
-
 void
 convertTypeCreate2ToCreate(blockCreate2 *blk_v2, blockCreate *blk_v1)
 {
@@ -272,27 +228,38 @@ glusterBlockCallRPC_1(char *host, void *cobj,
 {
   CLIENT *clnt = NULL;
   int ret = -1;
-  int sockfd = RPC_ANYSOCK;
   size_t i;
   blockResponse reply = {0,};
-  struct addrinfo *res = NULL;
+  struct rpc_err rpcerr = {0, };
   gbCapResp *obj = NULL;
   blockCreate cblk_v1 = {{0},};
   blockCreate2 *cblk_v2 = NULL;
+  bool reused = false;
+  bool retried = false;
+  struct timeval wait = TIMEOUT;
 
 
+ again:
   *rpc_sent = FALSE;
 
-  if (!(res = glusterBlockGetSockaddr(host))) {
-    goto out;
+  /* calls made from a fan-out task get what is left of its deadline */
+  if (glusterBlockFanoutTimeLeft(&wait)) {
+    if (!wait.tv_sec && !wait.tv_usec) {
+      LOG("mgmt", GB_LOG_ERROR, "deadline passed before calling host %s",
+          host);
+      errno = ETIMEDOUT;
+      goto out;
+    }
+    if (wait.tv_sec >= TIMEOUT.tv_sec) {
+      wait = TIMEOUT;
+    }
   }
 
-  clnt = clnttcp_create ((struct sockaddr_in *)res->ai_addr, GLUSTER_BLOCK, GLUSTER_BLOCK_VERS, &sockfd, 0, 0);
+  clnt = glusterBlockPeerGetClient(host, &reused);
   if (!clnt) {
-    LOG("mgmt", GB_LOG_ERROR, "%son inet host %s",
-        clnt_spcreateerror("client create failed"), host);
     goto out;
   }
+  clnt_control(clnt, CLSET_TIMEOUT, (char *)&wait);
 
   switch(opt) {
   case CREATE_SRV:
@@ -363,6 +330,8 @@ glusterBlockCallRPC_1(char *host, void *cobj,
   case INFO_SRV:
   case REPLACE_GET_PORTAL_TPG_SRV:
   case GENCONFIG_SRV:
+  case REINDEX_SRV:
+  case MIGRATE_SRV:
       goto out;
   case REPLACE_SRV:
       *rpc_sent = TRUE;
@@ -372,9 +341,20 @@ glusterBlockCallRPC_1(char *host, void *cobj,
         goto out;
       }
       break;
+  case REBALANCE_SRV:
+      *rpc_sent = TRUE;
+      if (block_rebalance_1((blockRebalance *)cobj, &reply, clnt) != RPC_SUCCESS) {
+        LOG("mgmt", GB_LOG_ERROR, "%son host %s",
+            clnt_sperror(clnt, "block remote rebalance call failed"), host);
+        goto out;
+      }
+      break;
   }
   ret = -1;
 
+  /* peer daemons stamp their replies with the epoch they booted in */
+  glusterBlockPeerSetEpoch(host, reply.offset);
+
   if (opt != VERSION_SRV) {
     if (GB_STRDUP(*out, reply.out) < 0) {
       goto out;
@@ -405,11 +385,25 @@ glusterBlockCallRPC_1(char *host, void *cobj,
           clnt_sperror(clnt, "clnt_freeres failed"));
 
     }
-    clnt_destroy (clnt);
-  }
-
-  if (res) {
-    freeaddrinfo(res);
+    clnt_geterr(clnt, &rpcerr);
+    glusterBlockPeerPutClient(host, clnt, rpcerr.re_status == RPC_SUCCESS);
+    clnt = NULL;
+
+    /*
+     * A pooled connection can die between the health check and the call,
+     * say the peer daemon restarted; try once more on a new connection.
+     * Only if the request never got out: after RPC_CANTRECV the peer may
+     * have run it, and create or delete must not run twice.
+     */
+    if (reused && !retried && rpcerr.re_status == RPC_CANTSEND) {
+      LOG("mgmt", GB_LOG_INFO,
+          "pooled connection to %s broke, retrying on a new one", host);
+      glusterBlockPeerFlush(host);
+      memset(&reply, 0, sizeof(reply));
+      retried = true;
+      ret = -1;
+      goto again;
+    }
   }
 
   return ret;
@@ -463,6 +457,56 @@ blockMetaInfoToServerParse(MetaInfo *info)
 }
 
 
+/*
+ * Hosts which were valid at any point in their state journal, except
+ * skiphost. Unlike blockMetaInfoToServerParse() this doesn't just look at
+ * the latest status, so a node with a failed or in progress operation on
+ * top of a good config is still part of the list.
+ */
+blockServerDefPtr
+blockMetaInfoToValidServers(MetaInfo *info, char *skiphost)
+{
+  blockServerDefPtr list;
+  size_t i, j;
+
+
+  if (!info) {
+    return NULL;
+  }
+
+  if (GB_ALLOC(list) < 0) {
+    return NULL;
+  }
+
+  if (GB_ALLOC_N(list->hosts, info->nhosts) < 0) {
+    goto out;
+  }
+
+  for (i = 0; i < info->nhosts; i++) {
+    if (skiphost && !strcmp(info->list[i]->addr, skiphost)) {
+      continue;
+    }
+    for (j = 0; j < info->list[i]->nenties; j++) {
+      if (blockhostIsValid(info->list[i]->st_journal[j])) {
+        break;
+      }
+    }
+    if (j == info->list[i]->nenties) {
+      continue;
+    }
+    if (GB_STRDUP(list->hosts[list->nhosts++], info->list[i]->addr) < 0) {
+      goto out;
+    }
+  }
+
+  return list;
+
+ out:
+  blockServerDefFree(list);
+  return NULL;
+}
+
+
 int
 glusterBlockCollectAttemptSuccess(blockRemoteObj *args, MetaInfo *info,
                                   operations opt, size_t count,
@@ -545,19 +589,10 @@ glusterBlockGetListFromInfo(MetaInfo *info)
 int
 blockGetHostStatus(MetaInfo *info, char *host)
 {
-  size_t i;
-
+  NodeInfo *node = blockMetaInfoGetNode(info, host);
 
-  if (!info || !host)
-    return GB_METASTATUS_MAX;
-
-  for (i = 0; i < info->nhosts; i++) {
-    if (!strcmp(info->list[i]->addr, host)) {
-      return blockMetaStatusEnumParse(info->list[i]->status);
-    }
-  }
 
-  return GB_METASTATUS_MAX;
+  return node ? node->st : GB_METASTATUS_MAX;
 }
 
 
@@ -584,6 +619,7 @@ blockValidateCommandOutput(const char *out, int opt, void *data)
   blockModifySize *msblk = data;
   blockReplace *rblk = data;
   blockReload *rlblk = data;
+  blockRebalance *rbblk = data;
   int ret = -1;
 
 
@@ -724,6 +760,15 @@ blockValidateCommandOutput(const char *out, int opt, void *data)
                             rlblk, rlblk->block_name, "Configuration restored");
     ret = 0;
     break;
+
+  case REBALANCE_SRV:
+    /* lun0 of the new prio path's tpg joined the AO group */
+    GB_OUT_VALIDATE_OR_GOTO(out, out, "AO group set failed for: %s",
+                            rbblk, rbblk->volume,
+                            "Parameter alua_tg_pt_gp_name is now '%s'.",
+                            GB_ALUA_AO_TPG_NAME);
+    ret = 0;
+    break;
   }
 
 out:
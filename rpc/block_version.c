@@ -21,6 +21,8 @@ glusterBlockBuildMinCaps(void *data, operations opt)
   blockModifySizeCli *msblk = NULL;
   blockReplaceCli *rblk = NULL;
   blockReloadCli *rlblk = NULL;
+  blockMigrateCli *mgblk = NULL;
+  blockRebalanceCli *rbblk = NULL;
   bool *minCaps = NULL;
 
 
@@ -101,12 +103,31 @@ glusterBlockBuildMinCaps(void *data, operations opt)
       minCaps[GB_JSON_CAP] = true;
     }
     break;
+  case MIGRATE_SRV:
+    mgblk = (blockMigrateCli *)data;
+
+    if (mgblk->meta_version == GB_METAFILE_V2) {
+      minCaps[GB_METAFILE_V2_CAP] = true;
+    }
+    if (mgblk->json_resp) {
+      minCaps[GB_JSON_CAP] = true;
+    }
+    break;
+  case REBALANCE_SRV:
+    rbblk = (blockRebalanceCli *)data;
+
+    minCaps[GB_REBALANCE_CAP] = true;
+    if (rbblk->json_resp) {
+      minCaps[GB_JSON_CAP] = true;
+    }
+    break;
   case MODIFY_TPGC_SRV:
   case REPLACE_GET_PORTAL_TPG_SRV:
   case LIST_SRV:
   case INFO_SRV:
   case VERSION_SRV:
   case GENCONFIG_SRV:
+  case REINDEX_SRV:
     break;
   }
 
@@ -133,6 +154,8 @@ glusterBlockCapabilitiesRemote(void *data)
       LOG("mgmt", GB_LOG_ERROR, "%s for on host %s",
           FAILED_REMOTE_CAPS, args->addr);
     }
+  } else if (!ret) {
+    glusterBlockPeerSetCaps(args->addr, (gbCapResp *)args->reply);
   }
 
   args->exit = ret;
@@ -260,19 +283,23 @@ blockRemoteCapabilitiesRespParse(size_t count, blockRemoteObj *args,
 }
 
 
+/*
+ * With useCache, hosts whose capabilities are cached from an earlier
+ * check of the same daemon instance aren't asked again; *cached tells
+ * how many answers came from the cache.
+ */
 static int
 glusterBlockCapabilityRemoteAsync(blockServerDef *servers, bool *minCaps,
-                                  bool *resultCaps, char **errMsg)
+                                  bool *resultCaps, bool useCache,
+                                  size_t *cached, char **errMsg)
 {
   blockRemoteObj *args = NULL;
-  pthread_t  *tid = NULL;
+  gbFanout *fo = NULL;
   int ret = -1;
   size_t i;
 
 
-  if (GB_ALLOC_N(tid, servers->nhosts) < 0) {
-    goto out;
-  }
+  *cached = 0;
 
   if (GB_ALLOC_N(args, servers->nhosts) < 0) {
     goto out;
@@ -280,15 +307,22 @@ glusterBlockCapabilityRemoteAsync(blockServerDef *servers, bool *minCaps,
 
   for (i = 0; i < servers->nhosts; i++) {
     args[i].addr = servers->hosts[i];
+    if (useCache) {
+      args[i].reply = (char *)glusterBlockPeerGetCaps(args[i].addr);
+      if (args[i].reply) {
+        (*cached)++;
+      }
+    }
   }
 
-  for (i = 0; i < servers->nhosts; i++) {
-    pthread_create(&tid[i], NULL, glusterBlockCapabilitiesRemote, &args[i]);
-  }
-
-  for (i = 0; i < servers->nhosts; i++) {
-    /* collect exit code */
-    pthread_join(tid[i], NULL);
+  if (*cached < servers->nhosts) {
+    fo = glusterBlockFanoutNew(servers->nhosts - *cached, GB_VERSION_DEADLINE);
+    for (i = 0; i < servers->nhosts; i++) {
+      if (!args[i].reply) {
+        glusterBlockFanoutAdd(fo, glusterBlockCapabilitiesRemote, &args[i]);
+      }
+    }
+    glusterBlockFanoutWait(fo);
   }
 
   /* Verify the capabilities */
@@ -296,33 +330,49 @@ glusterBlockCapabilityRemoteAsync(blockServerDef *servers, bool *minCaps,
 
  out:
   GB_FREE(args);
-  GB_FREE(tid);
 
   return ret;
 }
 
 
 
-int
-glusterBlockCheckCapabilities(void* blk, operations opt, blockServerDefPtr list,
-                              bool *resultCaps, char **errMsg)
+static int
+glusterBlockCheckMinCaps(blockServerDefPtr list, bool *minCaps,
+                         bool *resultCaps, char **errMsg)
 {
   int errCode = 0;
-  bool *minCaps = NULL;
   char *localErrMsg = NULL;
-
-
-  if (!list) {
-    return 0;
-  }
-
-  minCaps = glusterBlockBuildMinCaps(blk, opt);
-  if (!minCaps) {
-    errCode = GB_DEFAULT_ERRCODE;
+  char *down = NULL;
+  size_t cached = 0;
+
+
+  /* don't wait for hosts the heartbeat already found down to time out */
+  down = glusterBlockPeerListDown(list);
+  if (down) {
+    LOG("mgmt", GB_LOG_ERROR, "gluster-blockd is down on %s", down);
+    if (GB_ASPRINTF(errMsg, "gluster-blockd is not responding on host(s) %s "
+                    "(Hint: See if all servers are up and running "
+                    "gluster-blockd daemon)", down) == -1) {
+      errCode = ENOMEM;
+    } else {
+      errCode = ENOTCONN;
+    }
     goto out;
   }
 
-  errCode = glusterBlockCapabilityRemoteAsync(list, minCaps, resultCaps, &localErrMsg);
+  errCode = glusterBlockCapabilityRemoteAsync(list, minCaps, resultCaps, true,
+                                              &cached, &localErrMsg);
+  if (errCode && cached) {
+    /* a cached answer may be out of date, ask everyone before failing */
+    LOG("mgmt", GB_LOG_DEBUG, "version check on cached capabilities failed "
+        "(%s), checking with the servers", localErrMsg);
+    GB_FREE(localErrMsg);
+    if (resultCaps) {
+      memset(resultCaps, 0, GB_CAP_MAX * sizeof(*resultCaps));
+    }
+    errCode = glusterBlockCapabilityRemoteAsync(list, minCaps, resultCaps, false,
+                                                &cached, &localErrMsg);
+  }
   if (errCode) {
     LOG("mgmt", GB_LOG_WARNING, "glusterBlockCapabilityRemoteAsync() failed (%s)",
                                 localErrMsg);
@@ -342,8 +392,61 @@ glusterBlockCheckCapabilities(void* blk, operations opt, blockServerDefPtr list,
   }
 
  out:
-  GB_FREE(minCaps);
   GB_FREE(localErrMsg);
+  GB_FREE(down);
+  return errCode;
+}
+
+
+int
+glusterBlockCheckCapabilities(void* blk, operations opt, blockServerDefPtr list,
+                              bool *resultCaps, char **errMsg)
+{
+  int errCode = 0;
+  bool *minCaps = NULL;
+
+
+  if (!list) {
+    return 0;
+  }
+
+  minCaps = glusterBlockBuildMinCaps(blk, opt);
+  if (!minCaps) {
+    return GB_DEFAULT_ERRCODE;
+  }
+
+  errCode = glusterBlockCheckMinCaps(list, minCaps, resultCaps, errMsg);
+
+  GB_FREE(minCaps);
+  return errCode;
+}
+
+
+/*
+ * Once a volume is migrated to v2 its new metafiles are binary records,
+ * so any node that creates a block there or replaces into one has to be
+ * able to read them, whatever the op otherwise asks of it.
+ */
+int
+glusterBlockCheckMetaVersionCaps(struct glfs *glfs, char *volume,
+                                 blockServerDefPtr list, char **errMsg)
+{
+  int errCode = 0;
+  bool *minCaps = NULL;
+
+
+  if (!list || glusterBlockGetMetaVersion(glfs, volume) != GB_METAFILE_V2) {
+    return 0;
+  }
+
+  if (GB_ALLOC_N(minCaps, GB_CAP_MAX) < 0) {
+    return ENOMEM;
+  }
+  minCaps[GB_METAFILE_V2_CAP] = true;
+
+  errCode = glusterBlockCheckMinCaps(list, minCaps, NULL, errMsg);
+
+  GB_FREE(minCaps);
   return errCode;
 }
 
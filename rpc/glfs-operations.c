@@ -15,17 +15,156 @@
 
 # define  GB_LB_ATTR_PREFIX  "user.block"
 # define  GB_ZEROS_BUF_SIZE  4194304  /* 4MiB */
+# define  GB_METAFILE_READ_SIZE  16384  /* grows if the metafile is larger */
+
+# define  GB_META_ARENA_CHUNK  4096  /* first chunk, later ones double */
+# define  GB_META_ARENA_CHUNK_MAX  (1024 * 1024)
+# define  GB_META_ARENA_ALIGN  sizeof(void *)
+# define  GB_META_ARRAY_MIN    4     /* first slots of list/st_journal */
+
+# define  GB_META_CACHE_HASH_SIZE  1024  /* must be power of 2 */
+# define  GB_META_CACHE_MAX        4096  /* cached MetaInfo snapshots */
+
+# define  GB_META_JOURNAL_HASH_SIZE  64  /* must be power of 2 */
+# define  GB_META_JOURNAL_BUF       4096  /* first size of the pending batch */
+
+# define  GB_META_COMPACT_ENTRIES  64   /* journal lines over what it keeps */
+# define  GB_META_COMPACT_KEEP     4    /* most lines compaction keeps a host */
+# define  GB_META_COMPACT_SUFFIX   ".compact"
+
+# define  GB_INDEX_SLACK  256  /* superseded index records tolerated */
+
+# define  GB_METAVERSION_ATTR  GB_LB_ATTR_PREFIX ".metaversion"  /* meta.lock */
+# define  GB_METAV2_MAGIC      "\177GBMETA\n"
+# define  GB_METAV2_REC        0x80  /* set in MetaRecord.key, never in text */
+# define  GB_METAV2_HOST       0xff  /* MetaRecord.key of a host's state */
+# define  GB_METAV2_NUM        0x01  /* MetaRecord.num carries the value */
+
+# define  GB_PRIO_TABLE_ATTR       GB_LB_ATTR_PREFIX "-prio.table"  /* prio.info */
+# define  GB_PRIO_TABLE_READ_SIZE  4096  /* grows if the table is larger */
+
+# define  GB_METALOCK_POLL_MIN  10   /* ms, first retry of a timed lock */
+# define  GB_METALOCK_POLL_MAX  500
+# define  GB_METALOCK_HOLDERS   4    /* exclusive ranges one op advertises */
+
+
+/*
+ * Parsed MetaInfo of recently read metafiles, keyed by volume and block
+ * name. An entry is only served after a glfs_stat() of the metafile still
+ * matches the one taken when it was parsed; metafiles are append only, so
+ * any transaction logged since, by us or by a peer, changes at least the
+ * size. Writes made through GB_METAUPDATE_OR_GOTO() drop the entry right
+ * away. MetaCache is the recency list, the coldest entries are dropped once
+ * there are more than GB_META_CACHE_MAX of them.
+ */
+typedef struct MetaCacheEntry {
+  char volume[255];
+  char block[255];
+  unsigned int hash;
+  struct stat st;           /* of the metafile, when info was parsed */
+  MetaInfo *info;
+
+  struct list_head list;    /* recency list, linked on MetaCache */
+  struct list_head hnode;   /* hash chain, linked on MetaCacheHash[hash] */
+} MetaCacheEntry;
+
+static LIST_HEAD(MetaCache);
+static struct list_head MetaCacheHash[GB_META_CACHE_HASH_SIZE];
+static size_t metaCacheCount;
+static bool metaCacheInit;
+static pthread_mutex_t meta_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+/*
+ * Appends to a metafile go through its MetaJournal, which lives as long as
+ * somebody holds it (blockMetaJournalHold()) or has an append in flight.
+ * The fd is opened on the first append and kept until the last reference
+ * goes, so an operation holding the journal pays a single open for all of
+ * its transactions.
+ *
+ * Appenders queue their record on 'pending' and wait. The first one to find
+ * no flush in progress becomes the leader: it takes the whole batch, writes
+ * it with one O_SYNC glfs_write() and hands the result to every waiter of
+ * that batch (group commit). Records land in the order they were queued and
+ * an append only returns once its record is on disk, same as with an
+ * open/write/close per record.
+ */
+typedef struct MetaJournalWaiter {
+  bool done;
+  int err;                  /* errno of the flush that carried the record */
+  struct list_head list;    /* linked on MetaJournal->waiters, or a batch */
+} MetaJournalWaiter;
+
+typedef struct MetaJournal {
+  struct glfs *glfs;
+  char volume[255];
+  char block[255];
+  unsigned int hash;
+  size_t refs;              /* holders and appenders in flight */
+  struct glfs_fd *fd;       /* used by the leader only */
+  bool flushing;            /* a leader is writing a batch */
+  bool stale;               /* metafile got unlinked, reopen before writing */
+  bool dirty;               /* appended to since blockIndexCommit() looked */
+  int version;              /* GB_METAFILE_V*, of the file fd is open on */
+  bool fresh;               /* that file is empty, v2 starts with a header */
+
+  char *pending;            /* records queued for the next flush */
+  size_t plen;
+  size_t pcap;
+  struct list_head waiters; /* MetaJournalWaiter of the pending records */
+
+  pthread_cond_t cond;      /* signalled whenever a batch is done */
+  struct list_head hnode;   /* hash chain, linked on MetaJournalHash[hash] */
+} MetaJournal;
+
+/* each hash chain, and the journals on it, is guarded by its own lock */
+static struct list_head MetaJournalHash[GB_META_JOURNAL_HASH_SIZE];
+static pthread_mutex_t meta_journal_lock[GB_META_JOURNAL_HASH_SIZE] = {
+  [0 ... GB_META_JOURNAL_HASH_SIZE - 1] = PTHREAD_MUTEX_INITIALIZER
+};
+
+
+/*
+ * What the running op holds on meta.lock, for the wait/hold accounting and
+ * to advertise it to whoever is kept waiting. One op uses one lkfd from one
+ * thread, from glusterBlockCreateMetaLockFile() to its GB_METAUNLOCK().
+ */
+typedef struct MetaLockSession {
+  char volume[255];
+  char op[32];
+  bool held;
+  struct timespec since;    /* first range granted */
+  size_t waited;            /* ms, over all ranges taken */
+  off_t owned[GB_METALOCK_HOLDERS];  /* exclusive ranges advertised */
+  size_t nowned;
+} MetaLockSession;
+
+static __thread MetaLockSession metaLockSession;
+static gbMetaLockStats metaLockStats;
+static time_t metaLockStatsSaved;
+static pthread_mutex_t meta_lock_stats_lock = PTHREAD_MUTEX_INITIALIZER;
 
 
 struct glfs *
 glusterBlockVolumeInit(char *volume, int *errCode, char **errMsg)
 {
   struct glfs *glfs;
+  bool owner;
   int ret;
 
-  glfs = queryCache(volume);
+
+  glfs = queryCache(volume, &owner, errCode, errMsg);
   if (glfs) {
     return glfs;
+  } else if (!owner) {
+    /* a concurrent or recent glfs_init() of this volume failed */
+    if (!*errMsg) {
+      GB_ASPRINTF (errMsg, "Not able to Initialize volume %s [%s]", volume,
+                   strerror(*errCode));
+    }
+    LOG("gfapi", GB_LOG_ERROR, "initialization of volume %s failed[%s]",
+        volume, strerror(*errCode));
+    return NULL;
   }
 
   glfs = glfs_new(volume);
@@ -35,6 +174,7 @@ glusterBlockVolumeInit(char *volume, int *errCode, char **errMsg)
                  strerror(*errCode));
     LOG("gfapi", GB_LOG_ERROR, "glfs_new(%s) from %s failed[%s]", volume,
         gbConf->volServer, strerror(*errCode));
+    failNewEntry(volume, *errCode, *errMsg);
     return NULL;
   }
 
@@ -83,12 +223,111 @@ glusterBlockVolumeInit(char *volume, int *errCode, char **errMsg)
   return glfs;
 
  out:
+  failNewEntry(volume, *errCode, *errMsg);
   glfs_fini(glfs);
 
   return NULL;
 }
 
 
+void
+glusterBlockVolumeRelease(struct glfs *glfs)
+{
+  releaseCacheEntry(glfs);
+}
+
+
+static void *
+glusterBlockPrewarmVolume(void *data)
+{
+  char *volume = data;
+  struct glfs *glfs;
+  int errCode = 0;
+  char *errMsg = NULL;
+
+
+  glfs = glusterBlockVolumeInit(volume, &errCode, &errMsg);
+  if (glfs) {
+    LOG("gfapi", GB_LOG_INFO, "pre-warmed glfs object of volume %s", volume);
+    glusterBlockVolumeRelease(glfs);
+  } else {
+    LOG("gfapi", GB_LOG_WARNING, "pre-warming volume %s failed[%s]",
+        volume, errMsg ? errMsg : strerror(errCode));
+  }
+
+  GB_FREE(errMsg);
+  GB_FREE(volume);
+  return NULL;
+}
+
+
+/*
+ * Initialize the glfs objects of the given comma separated volumes in the
+ * background, one detached thread each, up to the cache capacity. Requests
+ * that come in meanwhile wait on the in-flight init through queryCache().
+ */
+void
+glusterBlockPrewarmVolumes(const char *volumes)
+{
+  pthread_attr_t attr;
+  pthread_t tid;
+  char **started = NULL;
+  char *tmp = NULL;
+  char *save = NULL;
+  char *vol;
+  char *arg;
+  size_t count;
+  size_t n = 0;
+  size_t i;
+
+
+  if (!volumes || !volumes[0]) {
+    return;
+  }
+
+  LOCK(gbConf->lock);
+  count = gbConf->glfsLruCount;
+  UNLOCK(gbConf->lock);
+
+  if (GB_STRDUP(tmp, volumes) < 0 || GB_ALLOC_N(started, count) < 0) {
+    goto out;
+  }
+
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+  for (vol = strtok_r(tmp, ", \t", &save); vol && n < count;
+       vol = strtok_r(NULL, ", \t", &save)) {
+    for (i = 0; i < n; i++) {
+      if (!strcmp(started[i], vol)) {
+        break;
+      }
+    }
+    if (i < n) {
+      continue;
+    }
+
+    if (GB_STRDUP(arg, vol) < 0) {
+      break;
+    }
+    if (pthread_create(&tid, &attr, glusterBlockPrewarmVolume, arg)) {
+      LOG("gfapi", GB_LOG_WARNING, "failed to start pre-warming of volume %s",
+          vol);
+      GB_FREE(arg);
+      continue;
+    }
+    started[n++] = vol;
+    LOG("gfapi", GB_LOG_DEBUG, "pre-warming glfs object of volume %s", vol);
+  }
+
+  pthread_attr_destroy(&attr);
+
+ out:
+  GB_FREE(started);
+  GB_FREE(tmp);
+}
+
+
 int
 glusterBlockCheckAvailableSpace(struct glfs *glfs,
                                 char *volume, size_t blockSize, char **errMsg)
@@ -188,6 +427,8 @@ int
 glusterBlockCreateEntry(struct glfs *glfs, blockCreateCli *blk, char *gbid,
                         int *errCode, char **errMsg)
 {
+  char fpath[PATH_MAX] = {0};
+  char spath[PATH_MAX] = {0};
   struct glfs_fd *tgfd;
   struct stat st;
   char *tmp;
@@ -208,17 +449,11 @@ glusterBlockCreateEntry(struct glfs *glfs, blockCreateCli *blk, char *gbid,
     goto out;
   }
 
-  ret = glfs_chdir (glfs, GB_STOREDIR);
-  if (ret) {
-    *errCode = errno;
-    LOG("gfapi", GB_LOG_ERROR,
-        "glfs_chdir(%s) on volume %s for block %s failed[%s]",
-        GB_STOREDIR, blk->volume, blk->block_name, strerror(errno));
-    goto out;
-  }
+  snprintf(fpath, sizeof fpath, "%s/%s", GB_STOREDIR, gbid);
 
   if (strlen(blk->storage)) {
-    ret = glfs_stat(glfs, blk->storage, &st);
+    snprintf(spath, sizeof spath, "%s/%s", GB_STOREDIR, blk->storage);
+    ret = glfs_stat(glfs, spath, &st);
     if (ret) {
       *errCode = errno;
       if (*errCode == ENOENT) {
@@ -241,7 +476,7 @@ glusterBlockCreateEntry(struct glfs *glfs, blockCreateCli *blk, char *gbid,
     blk->size = st.st_size;
 
     if (st.st_nlink == 1) {
-      ret = glfs_link(glfs, blk->storage, gbid);
+      ret = glfs_link(glfs, spath, fpath);
       if (ret) {
         *errCode=errno;
         LOG("mgmt", GB_LOG_ERROR,
@@ -267,7 +502,7 @@ glusterBlockCreateEntry(struct glfs *glfs, blockCreateCli *blk, char *gbid,
     return 0;
   }
 
-  tgfd = glfs_creat(glfs, gbid,
+  tgfd = glfs_creat(glfs, fpath,
                     O_WRONLY | O_CREAT | O_EXCL | O_SYNC,
                     S_IRUSR | S_IWUSR);
   if (!tgfd) {
@@ -325,7 +560,7 @@ unlink:
     ret = -1;
   }
 
-  if (ret && glfs_unlink(glfs, gbid) && errno != ENOENT) {
+  if (ret && glfs_unlink(glfs, fpath) && errno != ENOENT) {
     *errCode = errno;
     LOG("gfapi", GB_LOG_ERROR,
         "glfs_unlink(%s) on volume %s for block %s failed[%s]",
@@ -460,17 +695,12 @@ glusterBlockResizeEntry(struct glfs *glfs, blockModifySize *blk,
 int
 glusterBlockDeleteEntry(struct glfs *glfs, char *volume, char *gbid)
 {
+  char fpath[PATH_MAX] = {0};
   int ret;
 
 
-  ret = glfs_chdir (glfs, GB_STOREDIR);
-  if (ret) {
-    LOG("gfapi", GB_LOG_ERROR, "glfs_chdir(%s) on volume %s failed[%s]",
-        GB_STOREDIR, volume, strerror(errno));
-    goto out;
-  }
-
-  ret = glfs_unlink(glfs, gbid);
+  snprintf(fpath, sizeof fpath, "%s/%s", GB_STOREDIR, gbid);
+  ret = glfs_unlink(glfs, fpath);
   if (ret) {
     LOG("gfapi", GB_LOG_WARNING, "glfs_unlink(%s) on volume %s failed[%s]",
         gbid, volume, strerror(errno));
@@ -483,19 +713,22 @@ glusterBlockDeleteEntry(struct glfs *glfs, char *volume, char *gbid)
     }
   }
 
- out:
   return ret;
 }
 
 
 struct glfs_fd *
-glusterBlockCreateMetaLockFile(struct glfs *glfs, char *volume, int *errCode,
-                               char **errMsg)
+glusterBlockCreateMetaLockFile(struct glfs *glfs, char *volume,
+                               const char *op, int *errCode, char **errMsg)
 {
   struct glfs_fd *lkfd;
   int ret;
 
 
+  memset(&metaLockSession, 0, sizeof(metaLockSession));
+  GB_STRCPYSTATIC(metaLockSession.volume, volume);
+  GB_STRCPYSTATIC(metaLockSession.op, op);
+
   ret = glfs_mkdir (glfs, GB_METADIR, 0);
   if (ret && errno != EEXIST) {
     *errCode = errno;
@@ -504,21 +737,29 @@ glusterBlockCreateMetaLockFile(struct glfs *glfs, char *volume, int *errCode,
     goto out;
   }
 
-  ret = glfs_chdir (glfs, GB_METADIR);
-  if (ret) {
+  lkfd = glfs_creat(glfs, GB_METADIR "/" GB_TXLOCKFILE, O_RDWR,
+                    S_IRUSR | S_IWUSR);
+  if (!lkfd) {
     *errCode = errno;
-    LOG("gfapi", GB_LOG_ERROR, "glfs_chdir(%s) on volume %s failed[%s]",
-        GB_METADIR, volume, strerror(*errCode));
+    LOG("gfapi", GB_LOG_ERROR, "glfs_creat(%s) on volume %s failed[%s]",
+        GB_TXLOCKFILE, volume, strerror(*errCode));
     goto out;
   }
 
-  lkfd = glfs_creat(glfs, GB_TXLOCKFILE, O_RDWR, S_IRUSR | S_IWUSR);
-  if (!lkfd) {
+#if GFAPI_VERSION760
+  /*
+   * By default all fds of this process share one lock owner, give this one
+   * its own so ops served by other threads contend for meta.lock ranges
+   * just like ops from other nodes do.
+   */
+  if (glfs_fd_set_lkowner(lkfd, &lkfd, sizeof(lkfd))) {
     *errCode = errno;
-    LOG("gfapi", GB_LOG_ERROR, "glfs_creat(%s) on volume %s failed[%s]",
-        GB_TXLOCKFILE, volume, strerror(*errCode));
+    LOG("gfapi", GB_LOG_ERROR, "glfs_fd_set_lkowner(%s) on volume %s "
+        "failed[%s]", GB_TXLOCKFILE, volume, strerror(*errCode));
+    glfs_close(lkfd);
     goto out;
   }
+#endif
 
   return lkfd;
 
@@ -532,487 +773,3374 @@ int
 glusterBlockDeleteMetaFile(struct glfs *glfs,
                                char *volume, char *blockname)
 {
+  char fpath[PATH_MAX] = {0};
   int ret;
 
 
-  ret = glfs_chdir (glfs, GB_METADIR);
-  if (ret) {
-    LOG("gfapi", GB_LOG_ERROR,
-        "glfs_chdir(%s) on volume %s for block %s failed[%s]",
-        GB_METADIR, volume, blockname, strerror(errno));
-    goto out;
-  }
-
-  ret = glfs_unlink(glfs, blockname);
+  snprintf(fpath, sizeof fpath, "%s/%s", GB_METADIR, blockname);
+  blockMetaCacheInvalidate(volume, blockname);
+  blockMetaJournalInvalidate(glfs, volume, blockname);
+  ret = glfs_unlink(glfs, fpath);
   if (ret && errno != ENOENT) {
     LOG("gfapi", GB_LOG_ERROR, "glfs_unlink(%s) on volume %s failed[%s]",
         blockname, volume, strerror(errno));
-    goto out;
   }
 
- out:
+  /* copy of a compaction cut short by a crash, if any */
+  snprintf(fpath, sizeof fpath, "%s/%s%s", GB_METADIR, blockname,
+           GB_META_COMPACT_SUFFIX);
+  glfs_unlink(glfs, fpath);
+
   return ret;
 }
 
 
-void
-blockFreeMetaInfo(MetaInfo *info)
+/*
+ * Byte of meta.lock guarding the block. Every node must agree on it, so this
+ * is a plain djb2 of the name; blocks colliding merely serialize.
+ */
+off_t
+glusterBlockMetaLockOffset(const char *blockname)
 {
-  int i, j;
-
+  uint32_t hash = 5381;
 
-  if (!info)
-    return;
 
-  for (i = 0; i < info->nhosts; i++) {
-    if (info->list[i]) {
-      for (j = 0; j < info->list[i]->nenties; j++) {
-        GB_FREE(info->list[i]->st_journal[j]);
-      }
-      GB_FREE(info->list[i]->st_journal);
-      GB_FREE(info->list[i]);
-    }
+  while (*blockname) {
+    hash = ((hash << 5) + hash) + (unsigned char)*blockname++;
   }
 
-  GB_FREE(info->list);
-  GB_FREE(info);
+  return GB_METALOCK_NS_OFFSET + 1 + (off_t)hash;
 }
 
 
-static void
-blockParseRSstatus(MetaInfo *info)
+static size_t
+metaLockElapsed(struct timespec *from)
 {
-  size_t i;
-  char *s;
+  struct timespec now;
 
 
-  for (i = 0; i < info->nhosts; i++) {
-    if ( (s = strchr(info->list[i]->status, '-')) ) {
-      *s = '\0';
-      s++;
-      sscanf(s, "%zu", &info->list[i]->size);
-    }
-  }
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return (now.tv_sec - from->tv_sec) * 1000 +
+         (now.tv_nsec - from->tv_nsec) / 1000000;
 }
 
 
-static int
-blockStuffMetaInfo(MetaInfo *info, char *line)
+/* log2 buckets: 0 is under 1ms, i covers [2^(i-1), 2^i) ms */
+static size_t
+metaLockHistIndex(size_t ms)
 {
-  char *tmp = strdup(line);
-  char *opt = strtok(tmp, ":");
-  bool flag = 0;
-  int  ret = -1;
-  size_t i;
-
-
-  if (!opt) {
-    goto out;
-  }
-
-  switch (blockMetaKeyEnumParse(opt)) {
-  case GB_META_VOLUME:
-    GB_STRCPYSTATIC(info->volume, strchr(line, ' ') + 1);
-    break;
-  case GB_META_GBID:
-     GB_STRCPYSTATIC(info->gbid, strchr(line, ' ') + 1);
-    break;
-  case GB_META_SIZE:
-    sscanf(strchr(line, ' '), "%zu", &info->size);
-    if (!info->initial_size)
-      info->initial_size = info->size;
-    break;
-  case GB_META_RINGBUFFER:
-    sscanf(strchr(line, ' '), "%zu", &info->rb_size);
-    break;
-  case GB_META_IO_TIMEOUT:
-    sscanf(strchr(line, ' '), "%lu", &info->io_timeout);
-    break;
-  case GB_META_BLKSIZE:
-    sscanf(strchr(line, ' '), "%zu", &info->blk_size);
-    break;
-  case GB_META_HA:
-    sscanf(strchr(line, ' '), "%zu", &info->mpath);
-    break;
-  case GB_META_ENTRYCREATE:
-    GB_STRCPYSTATIC(info->entry, strchr(line, ' ') + 1);
-    break;
-  case GB_META_PASSWD:
-    GB_STRCPYSTATIC(info->passwd, strchr(line, ' ') + 1);
-    break;
-  case GB_META_PRIOPATH:
-    GB_STRCPYSTATIC(info->prio_path, strchr(line, ' ') + 1);
-    break;
+  size_t i = 0;
 
-  default:
-    if (info->list) {
-      if(GB_REALLOC_N(info->list, info->nhosts+1) < 0)
-        goto out;
-      for (i = 0; i < info->nhosts; i++) {
-        if(!strcmp(info->list[i]->addr, opt)) {
-          GB_STRCPYSTATIC(info->list[i]->status, strchr(line, ' ') + 1);
-          if (GB_REALLOC_N(info->list[i]->st_journal, info->list[i]->nenties + 1) < 0)
-            goto out;
-          if (GB_STRDUP(info->list[i]->st_journal[info->list[i]->nenties], strchr(line, ' ') + 1) < 0)
-            goto out;
-          info->list[i]->nenties++;
-          flag = 1;
-          break;
-        }
-      }
-    } else {
-      if(GB_ALLOC(info->list) < 0)
-        goto out;
-    }
 
-    if (!flag) {
-      i = info->nhosts;
-      if(GB_ALLOC(info->list[i]) < 0)
-        goto out;
-      GB_STRCPYSTATIC(info->list[i]->addr, opt);
-      GB_STRCPYSTATIC(info->list[i]->status, strchr(line, ' ') + 1);
-      if(GB_ALLOC(info->list[i]->st_journal) < 0)
-        goto out;
-      if (GB_STRDUP(info->list[i]->st_journal[info->list[i]->nenties], strchr(line, ' ') + 1) < 0)
-        goto out;
-      info->list[i]->nenties++;
-      info->nhosts++;
-    }
-    break;
+  while (ms && i < GB_METALOCK_HIST_SIZE - 1) {
+    ms >>= 1;
+    i++;
   }
 
-  ret = 0;
+  return i;
+}
 
- out:
-  GB_FREE(tmp);
 
-  return ret;
+void
+glusterBlockMetaLockStats(gbMetaLockStats *st)
+{
+  LOCK(meta_lock_stats_lock);
+  *st = metaLockStats;
+  UNLOCK(meta_lock_stats_lock);
 }
 
 
-int
-blockParseValidServers(struct glfs* glfs, char *metafile,
-                       int *errCode, blockServerDefPtr *savelist, char *skiphost)
+static void
+metaLockSaveStats(void)
 {
-  blockServerDefPtr list = *savelist;
-  char fpath[PATH_MAX] = {0};
-  struct glfs_fd *tgmfd = NULL;
-  char line[1024];
+  gbMetaLockStats st;
+  FILE *fp;
+  size_t i;
   int ret = -1;
-  char *h, *s, *sep;
-  size_t i, count = 0;
-  bool match;
 
 
-  snprintf(fpath, sizeof fpath, "%s/%s", GB_METADIR, metafile);
-  tgmfd = glfs_open(glfs, fpath, O_RDONLY);
-  if (!tgmfd) {
-    if (errCode) {
-      *errCode = errno;
-    }
-    LOG("gfapi", GB_LOG_ERROR, "glfs_open(%s) failed[%s]", metafile,
-                               strerror(errno));
+  glusterBlockMetaLockStats(&st);
+
+  fp = fopen(GB_METALOCK_STATS_FILE ".tmp", "w");
+  if (!fp) {
     goto out;
   }
+  fprintf(fp, "ACQUIRED: %zu\nBUSY: %zu\nWAITTIMEMAX: %zu\nHOLDTIMEMAX: %zu\n",
+          st.acquired, st.busy, st.waitMax, st.holdMax);
+  for (i = 0; i < GB_METALOCK_HIST_SIZE - 1; i++) {
+    fprintf(fp, "WAIT_LT_%zuMS: %zu\n", (size_t)1 << i, st.wait[i]);
+  }
+  fprintf(fp, "WAIT_GE_%zuMS: %zu\n", (size_t)1 << (i - 1), st.wait[i]);
+  for (i = 0; i < GB_METALOCK_HIST_SIZE - 1; i++) {
+    fprintf(fp, "HOLD_LT_%zuMS: %zu\n", (size_t)1 << i, st.hold[i]);
+  }
+  fprintf(fp, "HOLD_GE_%zuMS: %zu\n", (size_t)1 << (i - 1), st.hold[i]);
+  if (fclose(fp) == EOF) {
+    goto out;
+  }
+  ret = rename(GB_METALOCK_STATS_FILE ".tmp", GB_METALOCK_STATS_FILE);
 
-  while ((ret = glfs_read (tgmfd, line, sizeof(line), 0)) > 0) {
-    /* clip till current line */
-    h = line;
-    sep = strchr(h, '\n');
-    *sep = '\0';
-
-    count += strlen(h) + 1;
+ out:
+  if (ret) {
+    LOG("mgmt", GB_LOG_WARNING, "saving meta.lock stats to %s failed[%s]",
+        GB_METALOCK_STATS_FILE, strerror(errno));
+  }
+}
 
-    /* Part before ':' */
-    sep = strchr(h, ':');
-    *sep = '\0';
 
-    switch (blockMetaKeyEnumParse(h)) {
-    case GB_META_VOLUME:
-    case GB_META_GBID:
-    case GB_META_SIZE:
-    case GB_META_HA:
-    case GB_META_ENTRYCREATE:
-    case GB_META_PASSWD:
-      break;
-    default:
-      if (skiphost && !strcmp(h, skiphost)) {
-        break; /* switch case */
-      }
-      /* Part after ':' and before '\n' */
-      s = sep + 1;
-      while(*s == ' ') {
-        s++;
-      }
+/*
+ * Find who holds what we want; their record, else a guess from the type.
+ * Records are only left for one byte ranges, and one left behind by a
+ * crashed op names another pid than the current holder, so it is ignored.
+ */
+static void
+metaLockHolder(struct glfs_fd *lkfd, struct flock *want, char *holder,
+               size_t len)
+{
+  struct flock lock = *want;
+  char attr[64];
+  char *pid;
+  ssize_t ret;
 
-      if (!list) {
-        if (blockhostIsValid(s)) {
-          if (GB_ALLOC(list) < 0)
-            goto out;
-          if (GB_ALLOC(list->hosts) < 0)
-            goto out;
-          if (GB_STRDUP(list->hosts[0], h) < 0)
-            goto out;
 
-          list->nhosts = 1;
-        }
-      } else {
-        match = false;
-        for (i = 0; i < list->nhosts; i++) {
-          if (!strcmp(list->hosts[i], h)) {
-            match = true;
-            break; /* for loop */
-          }
-        }
-        if (!match && blockhostIsValid(s)){
-          if(GB_REALLOC_N(list->hosts, list->nhosts+1) < 0)
-            goto out;
-          if (GB_STRDUP(list->hosts[list->nhosts], h) < 0)
-            goto out;
+  snprintf(holder, len, "unknown");
+  if (glfs_posix_lock(lkfd, F_GETLK, &lock) || lock.l_type == F_UNLCK) {
+    return;
+  }
 
-          list->nhosts++;
-        }
+  if (lock.l_type == F_WRLCK && lock.l_len == 1) {
+    snprintf(attr, sizeof(attr), "%s.lockholder.%lld", GB_LB_ATTR_PREFIX,
+             (long long)lock.l_start);
+    ret = glfs_fgetxattr(lkfd, attr, holder, len - 1);
+    if (ret > 0) {
+      holder[ret] = '\0';
+      pid = strstr(holder, "[pid ");
+      if (pid && atoi(pid + 5) == lock.l_pid) {
+        return;
       }
-      break; /* switch case */
     }
-
-    glfs_lseek(tgmfd, count, SEEK_SET);
+    snprintf(holder, len, "unknown");
+  } else if (lock.l_type == F_RDLCK) {
+    snprintf(holder, len, "readers");
   }
+}
 
-  if (ret < 0 && errCode) { /*Failure from glfs_read*/
-    *errCode = errno;
-    goto out;
-  }
 
-  *savelist = list;
-  list = NULL;
-  ret = 0;
+/* leave a record on meta.lock of who has this exclusive range and why */
+static void
+metaLockAdvertise(struct glfs_fd *lkfd, off_t start, const char *block)
+{
+  MetaLockSession *s = &metaLockSession;
+  char attr[64];
+  char host[HOST_NAME_MAX + 1] = {0, };
+  char *rec = NULL;
+  int len;
 
- out:
-  if (tgmfd && glfs_close(tgmfd) != 0) {
-    LOG("gfapi", GB_LOG_ERROR, "glfs_close(%s): failed[%s]",
-        metafile, strerror(errno));
-  }
-  blockServerDefFree(list);
 
-  return ret;
+  if (s->nowned == GB_METALOCK_HOLDERS) {
+    return;
+  }
+  gethostname(host, sizeof(host) - 1);
+  snprintf(attr, sizeof(attr), "%s.lockholder.%lld", GB_LB_ATTR_PREFIX,
+           (long long)start);
+  len = GB_ASPRINTF(&rec, "%s%s%s@%s[pid %d, since %ld]", s->op,
+                    block ? ":" : "", block ? block : "", host, getpid(),
+                    (long)time(NULL));
+  if (len < 0) {
+    return;
+  }
+  if (glfs_fsetxattr(lkfd, attr, rec, len, 0)) {
+    LOG("gfapi", GB_LOG_DEBUG, "glfs_fsetxattr(%s) on volume %s failed[%s]",
+        attr, s->volume, strerror(errno));
+  } else {
+    s->owned[s->nowned++] = start;
+  }
+  GB_FREE(rec);
 }
 
 
+/*
+ * Takes a range of meta.lock for the running op. With GB_METALOCK_TIMEOUT
+ * set, gives up once it expires and fails with EBUSY naming the holder.
+ * Sets errMsg, unless the caller already has one, and errno on failure.
+ */
 int
-blockGetMetaInfo(struct glfs* glfs, char* metafile, MetaInfo *info,
-                 int *errCode)
+glusterBlockMetaLock(struct glfs_fd *lkfd, short type, off_t start, off_t len,
+                     char *volume, const char *block, char **errMsg)
 {
-  size_t count = 0;
-  struct glfs_fd *tgmfd = NULL;
-  char line[1024];
-  char fpath[PATH_MAX] = {0};
-  char *tmp;
+  MetaLockSession *s = &metaLockSession;
+  struct flock lock = {0, };
+  struct timespec t0;
+  char holder[256];
+  size_t timeout;
+  size_t delay = GB_METALOCK_POLL_MIN;
+  size_t waited;
   int ret;
+  int err = 0;
 
-  snprintf(fpath, sizeof fpath, "%s/%s", GB_METADIR, metafile);
-  tgmfd = glfs_open(glfs, fpath, O_RDONLY);
-  if (!tgmfd) {
-    if (errCode) {
-      *errCode = errno;
-    }
-    LOG("gfapi", GB_LOG_ERROR, "glfs_open(%s) failed[%s]", metafile,
-                               strerror(errno));
-    ret = -1;
-    goto out;
-  }
 
-  while ((ret = glfs_read (tgmfd, line, sizeof(line), 0)) > 0) {
-    tmp = strtok(line,"\n");
-    if (!tmp) {
+  lock.l_type = type;
+  lock.l_whence = SEEK_SET;
+  lock.l_start = start;
+  lock.l_len = len;
+
+  LOCK(gbConf->lock);
+  timeout = gbConf->metaLockTimeout * 1000;
+  UNLOCK(gbConf->lock);
+
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  if (!timeout) {
+    ret = glfs_posix_lock(lkfd, F_SETLKW, &lock);
+  } else {
+    while ((ret = glfs_posix_lock(lkfd, F_SETLK, &lock)) &&
+           (errno == EAGAIN || errno == EACCES)) {
+      waited = metaLockElapsed(&t0);
+      if (waited >= timeout) {
+        errno = EBUSY;
+        break;
+      }
+      if (delay > timeout - waited) {
+        delay = timeout - waited;
+      }
+      usleep(delay * 1000);
+      delay = delay * 2 > GB_METALOCK_POLL_MAX ? GB_METALOCK_POLL_MAX :
+                                                 delay * 2;
+    }
+  }
+  if (ret) {
+    err = errno;
+  }
+  waited = metaLockElapsed(&t0);
+
+  LOCK(meta_lock_stats_lock);
+  if (ret) {
+    if (err == EBUSY) {
+      metaLockStats.busy++;
+    }
+  } else {
+    metaLockStats.acquired++;
+    metaLockStats.wait[metaLockHistIndex(waited)]++;
+    if (waited > metaLockStats.waitMax) {
+      metaLockStats.waitMax = waited;
+    }
+  }
+  UNLOCK(meta_lock_stats_lock);
+
+  if (err == EBUSY) {
+    metaLockHolder(lkfd, &lock, holder, sizeof(holder));
+    LOG("mgmt", GB_LOG_ERROR,
+        "meta.lock on volume %s not granted in %zus, holder=%s",
+        volume, timeout / 1000, holder);
+    if (!*errMsg) {
+      GB_ASPRINTF(errMsg, "volume %s busy, holder=%s", volume, holder);
+    }
+    errno = err;
+    return -1;
+  } else if (ret) {
+    LOG("mgmt", GB_LOG_ERROR, "glfs_posix_lock() on volume %s failed[%s]",
+        volume, strerror(err));
+    if (!*errMsg) {
+      GB_ASPRINTF(errMsg, "Not able to acquire lock on %s[%s]", volume,
+                  strerror(err));
+    }
+    errno = err;
+    return -1;
+  }
+
+  if (!s->held) {
+    s->held = true;
+    clock_gettime(CLOCK_MONOTONIC, &s->since);
+    s->waited = 0;
+    s->nowned = 0;
+  }
+  s->waited += waited;
+  /* costs an xattr round trip each way, only worth it if we can time out */
+  if (timeout && type == F_WRLCK && len == 1) {
+    metaLockAdvertise(lkfd, start, block);
+  }
+
+  return 0;
+}
+
+
+/*
+ * Releases a range of meta.lock, len 0 meaning the whole file, which also
+ * ends the op's hold on it and accounts it.
+ */
+int
+glusterBlockMetaUnlock(struct glfs_fd *lkfd, off_t start, off_t len,
+                       char *volume)
+{
+  MetaLockSession *s = &metaLockSession;
+  struct flock lock = {0, };
+  char attr[64];
+  size_t held;
+  size_t i = 0;
+  bool save = false;
+  int ret;
+  int err = 0;
+
+
+  /* drop our records first, once unlocked they may be somebody else's */
+  while (i < s->nowned) {
+    if (s->owned[i] >= start && (!len || s->owned[i] < start + len)) {
+      snprintf(attr, sizeof(attr), "%s.lockholder.%lld", GB_LB_ATTR_PREFIX,
+               (long long)s->owned[i]);
+      glfs_fremovexattr(lkfd, attr);
+      s->owned[i] = s->owned[--s->nowned];
+    } else {
+      i++;
+    }
+  }
+
+  lock.l_type = F_UNLCK;
+  lock.l_whence = SEEK_SET;
+  lock.l_start = start;
+  lock.l_len = len;
+  ret = glfs_posix_lock(lkfd, F_SETLK, &lock);
+  if (ret) {
+    err = errno;
+  }
+
+  if (start || len || !s->held) {
+    errno = err;
+    return ret;
+  }
+
+  s->held = false;
+  held = metaLockElapsed(&s->since);
+
+  LOCK(meta_lock_stats_lock);
+  metaLockStats.hold[metaLockHistIndex(held)]++;
+  if (held > metaLockStats.holdMax) {
+    metaLockStats.holdMax = held;
+  }
+  if (metaLockStatsSaved != time(NULL)) {
+    metaLockStatsSaved = time(NULL);
+    save = true;
+  }
+  UNLOCK(meta_lock_stats_lock);
+
+  LOG("cmdlog", GB_LOG_INFO, "metalock volume=%s op=%s wait=%zums hold=%zums",
+      volume, s->op, s->waited, held);
+  if (save) {
+    metaLockSaveStats();
+  }
+
+  errno = err;
+  return ret;
+}
+
+
+int
+glusterBlockMetaFileAccess(struct glfs *glfs, char *blockname, int mode)
+{
+  char fpath[PATH_MAX] = {0};
+
+
+  snprintf(fpath, sizeof fpath, "%s/%s", GB_METADIR, blockname);
+  return glfs_access(glfs, fpath, mode);
+}
+
+
+/*
+ * Everything a MetaInfo points to (NodeInfo, st_journal arrays and their
+ * strings, the list array) is carved out of info->arena, a chain of chunks
+ * owned by the MetaInfo. Parsing a metafile thus costs a couple of mallocs,
+ * and freeing it one free per chunk. Arrays grow geometrically by moving to
+ * a bigger slot of the arena, the old one is just left behind.
+ */
+typedef struct MetaArena {
+  struct MetaArena *next;
+  size_t size;
+  size_t used;
+  char data[];
+} MetaArena;
+
+
+static MetaArena *
+metaArenaChunk(MetaInfo *info, size_t len)
+{
+  MetaArena *chunk;
+  size_t size = GB_META_ARENA_CHUNK;
+
+
+  if (info->arena) {
+    size = info->arena->size * 2;
+    if (size > GB_META_ARENA_CHUNK_MAX) {
+      size = GB_META_ARENA_CHUNK_MAX;
+    }
+  }
+  if (size < len) {
+    size = len;
+  }
+
+  chunk = malloc(sizeof(*chunk) + size);
+  if (!chunk) {
+    errno = ENOMEM;
+    return NULL;
+  }
+  chunk->size = size;
+  chunk->used = 0;
+  chunk->next = info->arena;
+  info->arena = chunk;
+
+  return chunk;
+}
+
+
+/* make sure the next len bytes come out of a single chunk */
+static int
+metaArenaReserve(MetaInfo *info, size_t len)
+{
+  if (info->arena && info->arena->size - info->arena->used >= len) {
+    return 0;
+  }
+
+  return metaArenaChunk(info, len) ? 0 : -1;
+}
+
+
+static void *
+metaArenaAlloc(MetaInfo *info, size_t len)
+{
+  MetaArena *chunk = info->arena;
+  void *ptr;
+
+
+  len = (len + GB_META_ARENA_ALIGN - 1) & ~(GB_META_ARENA_ALIGN - 1);
+  if (!chunk || chunk->size - chunk->used < len) {
+    chunk = metaArenaChunk(info, len);
+    if (!chunk) {
+      return NULL;
+    }
+  }
+
+  ptr = chunk->data + chunk->used;
+  chunk->used += len;
+
+  return ptr;
+}
+
+
+static char *
+metaArenaStrdup(MetaInfo *info, const char *str)
+{
+  size_t len = strlen(str) + 1;
+  char *dst;
+
+
+  dst = metaArenaAlloc(info, len);
+  if (dst) {
+    memcpy(dst, str, len);
+  }
+
+  return dst;
+}
+
+
+/* returns the array with room for at least one more element, or NULL */
+static void *
+metaArenaGrow(MetaInfo *info, void *array, size_t count, size_t *cap,
+              size_t elemsize)
+{
+  size_t newcap;
+  void *newarray;
+
+
+  if (count < *cap) {
+    return array;
+  }
+
+  newcap = *cap ? *cap * 2 : GB_META_ARRAY_MIN;
+  newarray = metaArenaAlloc(info, newcap * elemsize);
+  if (!newarray) {
+    return NULL;
+  }
+  if (count) {
+    memcpy(newarray, array, count * elemsize);
+  }
+  *cap = newcap;
+
+  return newarray;
+}
+
+
+void
+blockFreeMetaInfo(MetaInfo *info)
+{
+  MetaArena *chunk;
+
+
+  if (!info)
+    return;
+
+  while ((chunk = info->arena)) {
+    info->arena = chunk->next;
+    free(chunk);
+  }
+
+  GB_FREE(info);
+}
+
+
+static unsigned int
+blockMetaHostHash(const char *addr)
+{
+  unsigned int hash = 5381;
+
+
+  while (*addr) {
+    hash = ((hash << 5) + hash) + (unsigned char)*addr++;
+  }
+
+  return hash & (GB_META_HOST_HASH_SIZE - 1);
+}
+
+
+NodeInfo *
+blockMetaInfoGetNode(MetaInfo *info, const char *addr)
+{
+  NodeInfo *node;
+
+
+  if (!info || !addr) {
+    return NULL;
+  }
+
+  for (node = info->hosts[blockMetaHostHash(addr)]; node; node = node->hnext) {
+    if (!strcmp(node->addr, addr)) {
+      return node;
+    }
+  }
+
+  return NULL;
+}
+
+
+static void
+blockMetaInfoAddNode(MetaInfo *info, NodeInfo *node)
+{
+  unsigned int hash = blockMetaHostHash(node->addr);
+
+
+  node->hnext = info->hosts[hash];
+  info->hosts[hash] = node;
+}
+
+
+/*
+ * Split the RS size off the latest status and precompute what the
+ * per host lookups need, so they don't have to walk the journal again.
+ * Also (re)builds the host index, blockDupMetaInfo() relies on that.
+ */
+static void
+blockIndexMetaInfo(MetaInfo *info)
+{
+  NodeInfo *node;
+  size_t i, j;
+  char *s;
+
+
+  memset(info->hosts, 0, sizeof(info->hosts));
+  for (i = 0; i < info->nhosts; i++) {
+    node = info->list[i];
+    if ( (s = strchr(node->status, '-')) ) {
+      *s = '\0';
+      s++;
+      sscanf(s, "%zu", &node->size);
+    }
+    node->st = blockMetaStatusEnumParse(node->status);
+
+    node->rs_seen = false;
+    node->rs_size = -1;
+    for (j = node->nenties; j > 0; j--) {
+      if (!strstr(node->st_journal[j - 1], MetaStatusLookup[GB_RS_SUCCESS])) {
+        continue;
+      }
+      node->rs_seen = true;
+      if ( (s = strchr(node->st_journal[j - 1], '-')) ) {
+        sscanf(s + 1, "%zd", &node->rs_size);
+      }
+      break;
+    }
+
+    blockMetaInfoAddNode(info, node);
+  }
+}
+
+
+/* the host's node, added at the end of info->list on first sight */
+static NodeInfo *
+blockMetaInfoNode(MetaInfo *info, const char *addr)
+{
+  NodeInfo *node = blockMetaInfoGetNode(info, addr);
+  void *array;
+
+
+  if (node) {
+    return node;
+  }
+
+  array = metaArenaGrow(info, info->list, info->nhosts, &info->list_cap,
+                        sizeof(*info->list));
+  if (!array)
+    return NULL;
+  info->list = array;
+
+  node = metaArenaAlloc(info, sizeof(*node));
+  if (!node)
+    return NULL;
+  memset(node, 0, sizeof(*node));
+  GB_STRCPYSTATIC(node->addr, addr);
+  node->rs_size = -1;
+  info->list[info->nhosts++] = node;
+  blockMetaInfoAddNode(info, node);
+
+  return node;
+}
+
+
+/* appends entry, an arena string (NULL: allocation failed), to st_journal */
+static int
+blockMetaNodeLog(MetaInfo *info, NodeInfo *node, char *entry)
+{
+  void *array;
+
+
+  if (!entry)
+    return -1;
+
+  array = metaArenaGrow(info, node->st_journal, node->nenties,
+                        &node->journal_cap, sizeof(*node->st_journal));
+  if (!array)
+    return -1;
+  node->st_journal = array;
+  node->st_journal[node->nenties++] = entry;
+
+  return 0;
+}
+
+
+static int
+blockStuffMetaInfo(MetaInfo *info, char *line)
+{
+  char *opt = line + strspn(line, ":");
+  char *sep = NULL;
+  char *val;
+  NodeInfo *node = NULL;
+  int  ret = -1;
+
+
+  if (!*opt) {
+    goto out;
+  }
+
+  /* value starts after the first space, lines without one carry nothing */
+  val = strchr(line, ' ');
+  if (!val) {
+    return 0;
+  }
+  val++;
+
+  sep = strchr(opt, ':');
+  if (sep) {
+    *sep = '\0';
+  }
+
+  switch (blockMetaKeyEnumParse(opt)) {
+  case GB_META_VOLUME:
+    GB_STRCPYSTATIC(info->volume, val);
+    break;
+  case GB_META_GBID:
+     GB_STRCPYSTATIC(info->gbid, val);
+    break;
+  case GB_META_SIZE:
+    sscanf(val, "%zu", &info->size);
+    if (!info->initial_size)
+      info->initial_size = info->size;
+    break;
+  case GB_META_RINGBUFFER:
+    sscanf(val, "%zu", &info->rb_size);
+    break;
+  case GB_META_IO_TIMEOUT:
+    sscanf(val, "%lu", &info->io_timeout);
+    break;
+  case GB_META_BLKSIZE:
+    sscanf(val, "%zu", &info->blk_size);
+    break;
+  case GB_META_HA:
+    sscanf(val, "%zu", &info->mpath);
+    break;
+  case GB_META_ENTRYCREATE:
+    GB_STRCPYSTATIC(info->entry, val);
+    break;
+  case GB_META_PASSWD:
+    GB_STRCPYSTATIC(info->passwd, val);
+    break;
+  case GB_META_PRIOPATH:
+    GB_STRCPYSTATIC(info->prio_path, val);
+    break;
+
+  default:
+    node = blockMetaInfoNode(info, opt);
+    if (!node)
+      goto out;
+
+    GB_STRCPYSTATIC(node->status, val);
+    if (blockMetaNodeLog(info, node, metaArenaStrdup(info, val)))
+      goto out;
+    break;
+  }
+
+  ret = 0;
+
+ out:
+  if (sep) {
+    *sep = ':';
+  }
+
+  return ret;
+}
+
+
+/*
+ * Metafile v2: a MetaFileHeader, then a MetaRecord per line of the text
+ * format, followed by klen bytes of host address and vlen bytes of value.
+ * Numbers and host states are kept parsed, so a read is a walk over fixed
+ * size headers with no tokenizing, and a reader can skip a record without
+ * looking at it. All fields are little endian. Records have GB_METAV2_REC
+ * set in their first byte, which no text line has: what an older peer
+ * appends to a v2 metafile is still read, as text.
+ */
+typedef struct MetaFileHeader {
+  char magic[8];            /* GB_METAV2_MAGIC */
+  uint32_t version;         /* GB_METAFILE_V2 */
+  uint32_t size;            /* of the header, the first record starts here */
+} MetaFileHeader;
+
+typedef struct MetaRecord {
+  uint8_t key;              /* GB_METAV2_REC | Metakey, or GB_METAV2_HOST */
+  uint8_t st;               /* MetaStatus of a host, GB_METASTATUS_MAX: in value */
+  uint8_t flags;            /* GB_METAV2_NUM */
+  uint8_t klen;             /* host address */
+  uint32_t vlen;
+  uint64_t num;             /* value of numeric keys, size of a host's RS state */
+} MetaRecord;
+
+
+static bool
+metaFileIsV2(const char *data, size_t len)
+{
+  return len >= sizeof(MetaFileHeader) &&
+         !memcmp(data, GB_METAV2_MAGIC, sizeof(((MetaFileHeader *)0)->magic));
+}
+
+
+static bool
+metaKeyIsNumeric(int key)
+{
+  switch (key) {
+  case GB_META_SIZE:
+  case GB_META_HA:
+  case GB_META_RINGBUFFER:
+  case GB_META_BLKSIZE:
+  case GB_META_IO_TIMEOUT:
+    return true;
+  }
+
+  return false;
+}
+
+
+/* keys blockStuffMetaInfo() keeps in MetaInfo, the others are hosts */
+static int
+metaKeyLookup(const char *key, size_t len)
+{
+  int i;
+
+
+  for (i = 0; i < GB_METAKEY_MAX; i++) {
+    if (i != GB_META_ENTRYDELETE && !strncmp(key, MetakeyLookup[i], len) &&
+        !MetakeyLookup[i][len]) {
+      return i;
+    }
+  }
+
+  return GB_METAKEY_MAX;
+}
+
+
+static int
+metaBufAppend(char **buf, size_t *len, size_t *cap, const void *data,
+              size_t size)
+{
+  size_t newcap = *cap ? *cap : GB_META_JOURNAL_BUF;
+
+
+  while (newcap < *len + size + 1) {
+    newcap *= 2;
+  }
+  if (newcap != *cap) {
+    if (GB_REALLOC_N(*buf, newcap) < 0) {
+      errno = ENOMEM;
+      return -1;
+    }
+    *cap = newcap;
+  }
+  memcpy(*buf + *len, data, size);
+  *len += size;
+  (*buf)[*len] = '\0';
+
+  return 0;
+}
+
+
+/*
+ * Appends the v2 record of a text line, split the way blockStuffMetaInfo()
+ * does. Lines it would ignore are dropped, so are unparsable numbers.
+ */
+static int
+metaV2EncodeLine(const char *line, size_t len, char **out, size_t *olen,
+                 size_t *ocap)
+{
+  MetaRecord rec = {0, };
+  const char *opt = line + strspn(line, ":");
+  const char *val;
+  const char *dash;
+  char tmp[64];
+  size_t klen;
+  size_t vlen;
+  unsigned long long num;
+  int key;
+
+
+  if (opt >= line + len) {
+    errno = EINVAL;
+    return -1;
+  }
+  val = memchr(line, ' ', len);
+  if (!val) {
+    return 0;
+  }
+  val++;
+  vlen = line + len - val;
+
+  klen = strcspn(opt, ":\n");
+  if (opt + klen > line + len) {
+    klen = line + len - opt;
+  }
+
+  key = metaKeyLookup(opt, klen);
+  if (key != GB_METAKEY_MAX) {
+    rec.key = GB_METAV2_REC | key;
+    if (metaKeyIsNumeric(key)) {
+      snprintf(tmp, sizeof(tmp), "%.*s", (int)vlen, val);
+      if (sscanf(tmp, "%llu", &num) != 1) {
+        return 0;
+      }
+      rec.flags = GB_METAV2_NUM;
+      rec.num = htole64(num);
+      vlen = 0;
+    }
+  } else {
+    if (klen >= sizeof(((NodeInfo *)0)->addr)) {
+      errno = EINVAL;
+      return -1;
+    }
+    rec.key = GB_METAV2_HOST;
+    rec.klen = klen;
+    rec.st = GB_METASTATUS_MAX;
+
+    /* "<state>[-<size>]", anything else is kept as it is */
+    snprintf(tmp, sizeof(tmp), "%.*s", (int)vlen, val);
+    dash = strchr(tmp, '-');
+    if (dash) {
+      tmp[dash - tmp] = '\0';
+    }
+    rec.st = blockMetaStatusEnumParse(tmp);
+    if (rec.st != GB_METASTATUS_MAX && vlen < sizeof(tmp)) {
+      if (dash) {
+        if (sscanf(dash + 1, "%llu", &num) == 1) {
+          rec.flags = GB_METAV2_NUM;
+          rec.num = htole64(num);
+          vlen = 0;
+        } else {
+          rec.st = GB_METASTATUS_MAX;
+        }
+      } else {
+        vlen = 0;
+      }
+    } else {
+      rec.st = GB_METASTATUS_MAX;
+    }
+  }
+  rec.vlen = htole32(vlen);
+
+  if (metaBufAppend(out, olen, ocap, &rec, sizeof(rec)) ||
+      metaBufAppend(out, olen, ocap, opt, rec.klen) ||
+      metaBufAppend(out, olen, ocap, val, vlen)) {
+    return -1;
+  }
+
+  return 0;
+}
+
+
+/* text lines to v2 records, behind a MetaFileHeader if header is set */
+static int
+metaV2Encode(const char *text, size_t len, bool header, char **out,
+             size_t *olen)
+{
+  MetaFileHeader hdr = {GB_METAV2_MAGIC, 0, 0};
+  const char *end = text + len;
+  const char *nl;
+  char *buf = NULL;
+  size_t blen = 0;
+  size_t cap = 0;
+
+
+  if (header) {
+    hdr.version = htole32(GB_METAFILE_V2);
+    hdr.size = htole32(sizeof(hdr));
+    if (metaBufAppend(&buf, &blen, &cap, &hdr, sizeof(hdr))) {
+      goto fail;
+    }
+  }
+
+  for (; text < end; text = nl + 1) {
+    nl = memchr(text, '\n', end - text);
+    if (!nl) {
+      nl = end;
+    }
+    if (nl > text && metaV2EncodeLine(text, nl - text, &buf, &blen, &cap)) {
+      goto fail;
+    }
+  }
+
+  *out = buf;
+  *olen = blen;
+  return 0;
+
+ fail:
+  GB_FREE(buf);
+  return -1;
+}
+
+
+/*
+ * Walks a v2 metafile, calling fn() on each record with the address and
+ * value that follow it, and text() on each line of text. A truncated last
+ * record, of a write cut short, ends the walk like it does for text.
+ */
+static int
+metaV2Walk(char *data, size_t len, const char *metafile,
+           int (*fn)(void *, MetaRecord *, char *, char *),
+           int (*text)(void *, char *, size_t), void *arg)
+{
+  MetaFileHeader hdr;
+  MetaRecord rec;
+  size_t off;
+  char *nl;
+
+
+  memcpy(&hdr, data, sizeof(hdr));
+  off = le32toh(hdr.size);
+  if (le32toh(hdr.version) != GB_METAFILE_V2 || off < sizeof(hdr) ||
+      off > len) {
+    LOG("mgmt", GB_LOG_ERROR, "metafile %s has unknown format version %u",
+        metafile, le32toh(hdr.version));
+    errno = EPROTO;
+    return -1;
+  }
+
+  while (off < len) {
+    if (!(data[off] & GB_METAV2_REC)) {
+      nl = memchr(data + off, '\n', len - off);
+      if (!nl) {
+        nl = data + len;
+      }
+      if (nl > data + off && text(arg, data + off, nl - data - off)) {
+        return -1;
+      }
+      off = nl - data + 1;
+      continue;
+    }
+
+    if (len - off < sizeof(rec)) {
+      break;
+    }
+    memcpy(&rec, data + off, sizeof(rec));
+    rec.vlen = le32toh(rec.vlen);
+    rec.num = le64toh(rec.num);
+    if (len - off - sizeof(rec) < (size_t)rec.klen + rec.vlen) {
+      break;
+    }
+    off += sizeof(rec);
+    if (fn(arg, &rec, data + off, data + off + rec.klen)) {
+      return -1;
+    }
+    off += rec.klen + rec.vlen;
+  }
+
+  if (off < len) {
+    LOG("mgmt", GB_LOG_WARNING, "metafile %s ends with a partial record, "
+        "ignoring its last %zu bytes", metafile, len - off);
+  }
+
+  return 0;
+}
+
+
+typedef struct MetaV2Parse {
+  MetaInfo *info;
+  bool slow;                /* saw text or a raw state, see blockParseMetaV2 */
+} MetaV2Parse;
+
+
+static int
+metaV2ParseText(void *arg, char *line, size_t len)
+{
+  MetaV2Parse *p = arg;
+  NodeInfo *node;
+  char save = line[len];
+  char *key;
+  int ret;
+
+
+  line[len] = '\0';
+  ret = blockStuffMetaInfo(p->info, line);
+
+  /* as with text, a host's size is that of its latest state only */
+  key = line + strspn(line, ":");
+  key[strcspn(key, ":")] = '\0';
+  node = blockMetaInfoGetNode(p->info, key);
+  if (node) {
+    node->size = 0;
+  }
+  line[len] = save;
+  p->slow = true;
+
+  return ret;
+}
+
+
+static int
+metaV2ParseRecord(void *arg, MetaRecord *rec, char *key, char *val)
+{
+  MetaV2Parse *p = arg;
+  MetaInfo *info = p->info;
+  NodeInfo *node;
+  char addr[sizeof(node->addr)];
+  char *entry;
+  size_t n;
+
+
+# define  META_V2_COPY(dst)                                          \
+          do {                                                       \
+            n = rec->vlen < sizeof(dst) ? rec->vlen : sizeof(dst) - 1;\
+            memcpy(dst, val, n);                                     \
+            dst[n] = '\0';                                           \
+          } while (0)
+
+  if (rec->key != GB_METAV2_HOST) {
+    switch (rec->key & ~GB_METAV2_REC) {
+    case GB_META_VOLUME:
+      META_V2_COPY(info->volume);
+      break;
+    case GB_META_GBID:
+      META_V2_COPY(info->gbid);
+      break;
+    case GB_META_ENTRYCREATE:
+      META_V2_COPY(info->entry);
+      break;
+    case GB_META_PASSWD:
+      META_V2_COPY(info->passwd);
+      break;
+    case GB_META_PRIOPATH:
+      META_V2_COPY(info->prio_path);
+      break;
+    case GB_META_SIZE:
+      info->size = rec->num;
+      if (!info->initial_size)
+        info->initial_size = info->size;
+      break;
+    case GB_META_RINGBUFFER:
+      info->rb_size = rec->num;
+      break;
+    case GB_META_IO_TIMEOUT:
+      info->io_timeout = rec->num;
+      break;
+    case GB_META_BLKSIZE:
+      info->blk_size = rec->num;
+      break;
+    case GB_META_HA:
+      info->mpath = rec->num;
+      break;
+    }
+    return 0;
+  }
+
+  memcpy(addr, key, rec->klen);
+  addr[rec->klen] = '\0';
+  node = blockMetaInfoNode(info, addr);
+  if (!node) {
+    return -1;
+  }
+
+  if (rec->st >= GB_METASTATUS_MAX) {
+    entry = metaArenaAlloc(info, rec->vlen + 1);
+    if (!entry) {
+      return -1;
+    }
+    memcpy(entry, val, rec->vlen);
+    entry[rec->vlen] = '\0';
+    GB_STRCPYSTATIC(node->status, entry);
+    node->size = 0;
+    p->slow = true;
+    return blockMetaNodeLog(info, node, entry);
+  }
+
+  GB_STRCPYSTATIC(node->status, MetaStatusLookup[rec->st]);
+  node->st = rec->st;
+  node->size = 0;
+  if (rec->flags & GB_METAV2_NUM) {
+    node->size = rec->num;
+    entry = metaArenaAlloc(info, sizeof(node->status) + 24);
+    if (entry) {
+      sprintf(entry, "%s-%zu", node->status, (size_t)rec->num);
+    }
+  } else {
+    entry = metaArenaStrdup(info, node->status);
+  }
+  if (rec->st == GB_RS_SUCCESS) {
+    node->rs_seen = true;
+    node->rs_size = (rec->flags & GB_METAV2_NUM) ? (ssize_t)rec->num : -1;
+  }
+
+  return blockMetaNodeLog(info, node, entry);
+
+# undef   META_V2_COPY
+}
+
+
+/*
+ * Records carry what blockIndexMetaInfo() would otherwise have to dig out
+ * of the state strings, and build the host index as they go; only text or
+ * states that weren't known when they got written send us there.
+ */
+static int
+blockParseMetaV2(MetaInfo *info, char *data, size_t len, const char *metafile)
+{
+  MetaV2Parse p = {info, false};
+
+
+  if (metaV2Walk(data, len, metafile, metaV2ParseRecord, metaV2ParseText,
+                 &p)) {
+    return -1;
+  }
+  if (p.slow) {
+    blockIndexMetaInfo(info);
+  }
+
+  return 0;
+}
+
+
+typedef struct MetaV2Text {
+  char *buf;
+  size_t len;
+  size_t cap;
+  bool mixed;               /* had text lines among the records */
+} MetaV2Text;
+
+
+static int
+metaV2TextLine(void *arg, char *line, size_t len)
+{
+  MetaV2Text *t = arg;
+
+
+  t->mixed = true;
+  return metaBufAppend(&t->buf, &t->len, &t->cap, line, len) ||
+         metaBufAppend(&t->buf, &t->len, &t->cap, "\n", 1);
+}
+
+
+static int
+metaV2TextRecord(void *arg, MetaRecord *rec, char *key, char *val)
+{
+  MetaV2Text *t = arg;
+  char num[32];
+  const char *k = key;
+  size_t klen = rec->klen;
+
+
+  if (rec->key != GB_METAV2_HOST) {
+    k = MetakeyLookup[rec->key & ~GB_METAV2_REC];
+    klen = strlen(k);
+  }
+  if (metaBufAppend(&t->buf, &t->len, &t->cap, k, klen) ||
+      metaBufAppend(&t->buf, &t->len, &t->cap, ": ", 2)) {
+    return -1;
+  }
+
+  if (rec->key == GB_METAV2_HOST && rec->st < GB_METASTATUS_MAX) {
+    if (metaBufAppend(&t->buf, &t->len, &t->cap, MetaStatusLookup[rec->st],
+                      strlen(MetaStatusLookup[rec->st]))) {
+      return -1;
+    }
+    if (rec->flags & GB_METAV2_NUM) {
+      snprintf(num, sizeof(num), "-%llu", (unsigned long long)rec->num);
+      if (metaBufAppend(&t->buf, &t->len, &t->cap, num, strlen(num))) {
+        return -1;
+      }
+    }
+  } else if (rec->flags & GB_METAV2_NUM) {
+    snprintf(num, sizeof(num), "%llu", (unsigned long long)rec->num);
+    if (metaBufAppend(&t->buf, &t->len, &t->cap, num, strlen(num))) {
+      return -1;
+    }
+  } else if (metaBufAppend(&t->buf, &t->len, &t->cap, val, rec->vlen)) {
+    return -1;
+  }
+
+  return metaBufAppend(&t->buf, &t->len, &t->cap, "\n", 1);
+}
+
+
+/* a v2 metafile back to text, *mixed tells if it had text lines already */
+static int
+metaV2Decode(char *data, size_t len, const char *metafile, char **text,
+             size_t *tlen, bool *mixed)
+{
+  MetaV2Text t = {NULL, 0, 0, false};
+
+
+  if (metaBufAppend(&t.buf, &t.len, &t.cap, "", 0) ||
+      metaV2Walk(data, len, metafile, metaV2TextRecord, metaV2TextLine, &t)) {
+    GB_FREE(t.buf);
+    return -1;
+  }
+
+  *text = t.buf;
+  *tlen = t.len;
+  if (mixed) {
+    *mixed = t.mixed;
+  }
+
+  return 0;
+}
+
+
+/*
+ * Read the whole metafile into a NUL terminated buffer, instead of a
+ * read + lseek round trip per line. Caller must free *data. v2 metafiles
+ * hold NULs, *dlen (if given) says how much was read.
+ */
+static int
+blockReadMetaFile(struct glfs *glfs, char *metafile, char **data,
+                  size_t *dlen, int *errCode)
+{
+  char fpath[PATH_MAX] = {0};
+  struct glfs_fd *tgmfd = NULL;
+  char *buf = NULL;
+  size_t size = GB_METAFILE_READ_SIZE;
+  size_t len = 0;
+  ssize_t ret;
+
+
+  snprintf(fpath, sizeof fpath, "%s/%s", GB_METADIR, metafile);
+  tgmfd = glfs_open(glfs, fpath, O_RDONLY);
+  if (!tgmfd) {
+    if (errCode) {
+      *errCode = errno;
+    }
+    LOG("gfapi", GB_LOG_ERROR, "glfs_open(%s) failed[%s]", metafile,
+                               strerror(errno));
+    return -1;
+  }
+
+  if (GB_ALLOC_N(buf, size) < 0) {
+    if (errCode) {
+      *errCode = ENOMEM;
+    }
+    ret = -1;
+    goto out;
+  }
+
+  /* a short read needn't mean EOF, only a read returning 0 does */
+  while ((ret = glfs_read(tgmfd, buf + len, size - len - 1, 0)) > 0) {
+    len += ret;
+    if (len < size - 1) {
+      continue;
+    }
+    size *= 2;
+    if (GB_REALLOC_N(buf, size) < 0) {
+      if (errCode) {
+        *errCode = ENOMEM;
+      }
+      ret = -1;
+      goto out;
+    }
+  }
+  if (ret < 0) { /* Failure from glfs_read */
+    if (errCode) {
+      *errCode = errno;
+    }
+    LOG("gfapi", GB_LOG_ERROR, "glfs_read(%s) failed[%s]", metafile,
+                               strerror(errno));
+    goto out;
+  }
+  buf[len] = '\0';
+
+  *data = buf;
+  buf = NULL;
+  if (dlen) {
+    *dlen = len;
+  }
+  ret = 0;
+
+ out:
+  if (glfs_close(tgmfd) != 0) {
+    LOG("gfapi", GB_LOG_ERROR, "glfs_close(%s): failed[%s]",
+        metafile, strerror(errno));
+  }
+  GB_FREE(buf);
+
+  return ret;
+}
+
+
+int
+blockGetMetaInfo(struct glfs* glfs, char* metafile, MetaInfo *info,
+                 int *errCode)
+{
+  char *data = NULL;
+  char *save = NULL;
+  char *line;
+  size_t len = 0;
+  int ret;
+
+
+  ret = blockReadMetaFile(glfs, metafile, &data, &len, errCode);
+  if (ret) {
+    goto out;
+  }
+
+  /* journal strings need at most the file size, nodes fit in the rest */
+  ret = metaArenaReserve(info, len + GB_META_ARENA_CHUNK);
+  if (ret) {
+    if (errCode) {
+      *errCode = ENOMEM;
+    }
+    goto out;
+  }
+
+  if (metaFileIsV2(data, len)) {
+    ret = blockParseMetaV2(info, data, len, metafile);
+    if (ret) {
+      if (errCode) {
+        *errCode = errno;
+      }
+      LOG("gfapi", GB_LOG_ERROR,
+          "blockParseMetaV2: on volume %s for block %s failed[%s]",
+          info->volume, metafile, strerror(errno));
+    }
+    goto out;
+  }
+
+  for (line = strtok_r(data, "\n", &save); line;
+       line = strtok_r(NULL, "\n", &save)) {
+    ret = blockStuffMetaInfo(info, line);
+    if (ret) {
+      if (errCode) {
+        *errCode = errno;
+      }
+      LOG("gfapi", GB_LOG_ERROR,
+          "blockStuffMetaInfo: on volume %s for block %s failed[%s]",
+          info->volume, metafile, strerror(errno));
+      goto out;
+    }
+  }
+  blockIndexMetaInfo(info);
+
+ out:
+  GB_FREE(data);
+
+  return ret;
+}
+
+
+/*
+ * Writes buf to <block>.compact and renames that over the metafile, so a
+ * crash leaves either file whole. The caller must hold the block's
+ * meta.lock range exclusively, so no other appender can be in flight.
+ */
+static int
+metaFileReplace(struct glfs *glfs, char *volume, char *blockname,
+                char *buf, size_t len)
+{
+  char fpath[PATH_MAX] = {0};
+  char tpath[PATH_MAX] = {0};
+  struct glfs_fd *tgfd = NULL;
+  int err = 0;
+  int ret = -1;
+
+
+  snprintf(fpath, sizeof fpath, "%s/%s", GB_METADIR, blockname);
+  snprintf(tpath, sizeof tpath, "%s/%s%s", GB_METADIR, blockname,
+           GB_META_COMPACT_SUFFIX);
+  tgfd = glfs_creat(glfs, tpath, O_WRONLY | O_TRUNC | O_SYNC,
+                    S_IRUSR | S_IWUSR);
+  if (!tgfd) {
+    err = errno;
+    goto out;
+  }
+  if (glfs_write(tgfd, buf, len, 0) != (ssize_t)len) {
+    err = errno ? errno : EIO;
+    goto out;
+  }
+  ret = glfs_close(tgfd);
+  tgfd = NULL;
+  if (ret) {
+    err = errno;
+    goto out;
+  }
+
+  ret = glfs_rename(glfs, tpath, fpath);
+  if (ret) {
+    err = errno;
+    goto out;
+  }
+  blockMetaCacheInvalidate(volume, blockname);
+  blockMetaJournalInvalidate(glfs, volume, blockname);
+
+ out:
+  if (tgfd) {
+    glfs_close(tgfd);
+  }
+  if (ret) {
+    glfs_unlink(glfs, tpath);
+    errno = err;
+  }
+
+  return ret;
+}
+
+
+/*
+ * A metafile line is only worth keeping if a parse of the file would miss
+ * it, per key that is: the first one (it orders info->list, and is the
+ * initial SIZE), the last one (current value or status), and for hosts the
+ * last valid and the last RSSUCCESS status, which st_journal is searched
+ * for by blockMetaInfoToValidServers() and blockInfoGetCurrentSizeOfNode().
+ */
+typedef struct MetaCompactKey {
+  char *key;
+  size_t len;
+  size_t first;
+  size_t last;
+  ssize_t valid;    /* last line with a valid status, -1 if none */
+  ssize_t rs;       /* last RSSUCCESS line, -1 if none */
+} MetaCompactKey;
+
+
+/*
+ * Folds the history of a metafile to the lines above, through
+ * metaFileReplace(); v2 metafiles are folded as text and stay v2. With
+ * info given, only does it once the state journal grew past
+ * GB_META_COMPACT_ENTRIES.
+ */
+int
+glusterBlockCompactMetaFile(struct glfs *glfs, char *volume, char *blockname,
+                            MetaInfo *info)
+{
+  MetaCompactKey *keys = NULL;
+  char **lines = NULL;
+  bool *keep = NULL;
+  char *data = NULL;
+  char *save = NULL;
+  char *buf = NULL;
+  char *out = NULL;
+  char *line;
+  char *opt;
+  char *val;
+  bool v2 = false;
+  size_t entries = 0;
+  size_t nkeys = 0;
+  size_t nlines = 0;
+  size_t kept = 0;
+  size_t len = 0;
+  size_t i, k;
+  int err = 0;
+  int ret = -1;
+
+
+  if (info) {
+    for (i = 0; i < info->nhosts; i++) {
+      entries += info->list[i]->nenties;
+    }
+    if (entries <= GB_META_COMPACT_ENTRIES +
+                   GB_META_COMPACT_KEEP * info->nhosts) {
+      return 0;
+    }
+  }
+
+  if (blockReadMetaFile(glfs, blockname, &data, &len, &err)) {
+    goto out;
+  }
+  if (metaFileIsV2(data, len)) {
+    v2 = true;
+    buf = data;
+    data = NULL;
+    if (metaV2Decode(buf, len, blockname, &data, &len, NULL)) {
+      err = errno;
+      goto out;
+    }
+    GB_FREE(buf);
+  }
+
+  /* no more lines than newlines + 1 */
+  for (i = 0, k = 1; data[i]; i++) {
+    k += (data[i] == '\n');
+  }
+  if (GB_ALLOC_N(lines, k) < 0 || GB_ALLOC_N(keep, k) < 0 ||
+      GB_ALLOC_N(keys, k) < 0) {
+    err = ENOMEM;
+    goto out;
+  }
+
+  for (line = strtok_r(data, "\n", &save); line;
+       line = strtok_r(NULL, "\n", &save)) {
+    /* same key and value split as blockStuffMetaInfo() */
+    opt = line + strspn(line, ":");
+    if (!*opt) {
+      err = EINVAL;
+      goto out;
+    }
+    val = strchr(line, ' ');
+    if (!val) {
+      continue;
+    }
+    val++;
+
+    len = strcspn(opt, ":");
+    for (k = 0; k < nkeys; k++) {
+      if (keys[k].len == len && !strncmp(keys[k].key, opt, len)) {
+        break;
+      }
+    }
+    if (k == nkeys) {
+      keys[k].key = opt;
+      keys[k].len = len;
+      keys[k].first = nlines;
+      keys[k].valid = -1;
+      keys[k].rs = -1;
+      nkeys++;
+    }
+    keys[k].last = nlines;
+    if (blockhostIsValid(val)) {
+      keys[k].valid = nlines;
+    }
+    if (strstr(val, MetaStatusLookup[GB_RS_SUCCESS])) {
+      keys[k].rs = nlines;
+    }
+    lines[nlines++] = line;
+  }
+
+  for (k = 0; k < nkeys; k++) {
+    keep[keys[k].first] = true;
+    keep[keys[k].last] = true;
+    if (keys[k].valid >= 0) {
+      keep[keys[k].valid] = true;
+    }
+    if (keys[k].rs >= 0) {
+      keep[keys[k].rs] = true;
+    }
+  }
+
+  for (i = 0, len = 0; i < nlines; i++) {
+    if (keep[i]) {
+      kept++;
+      len += strlen(lines[i]) + 1;
+    }
+  }
+  if (kept == nlines) {
+    ret = 0;
+    goto out;
+  }
+
+  if (GB_ALLOC_N(buf, len + 1) < 0) {
+    err = ENOMEM;
+    goto out;
+  }
+  for (i = 0, len = 0; i < nlines; i++) {
+    if (keep[i]) {
+      len += sprintf(buf + len, "%s\n", lines[i]);
+    }
+  }
+
+  if (v2) {
+    if (metaV2Encode(buf, len, true, &out, &len)) {
+      err = errno;
+      goto out;
+    }
+  }
+
+  ret = metaFileReplace(glfs, volume, blockname, v2 ? out : buf, len);
+  if (ret) {
+    err = errno;
+    goto out;
+  }
+
+  LOG("mgmt", GB_LOG_INFO, "compacted metafile of block %s on volume %s "
+      "from %zu to %zu lines", blockname, volume, nlines, kept);
+
+ out:
+  if (ret) {
+    LOG("mgmt", GB_LOG_WARNING, "compacting metafile of block %s on volume %s "
+        "failed[%s]", blockname, volume, strerror(err));
+    errno = err;
+  }
+  GB_FREE(keys);
+  GB_FREE(keep);
+  GB_FREE(lines);
+  GB_FREE(out);
+  GB_FREE(buf);
+  GB_FREE(data);
+
+  return ret;
+}
+
+
+/*
+ * Format new metafiles of the volume are written in, an xattr of meta.lock.
+ * Metafiles already there keep theirs, appenders go by what they find.
+ */
+int
+glusterBlockGetMetaVersion(struct glfs *glfs, char *volume)
+{
+  char buf[16] = {'\0', };
+  int version = GB_METAFILE_V1;
+
+
+  if (glfs_getxattr(glfs, GB_METADIR "/" GB_TXLOCKFILE, GB_METAVERSION_ATTR,
+                    buf, sizeof(buf) - 1) < 0) {
+    if (errno != ENODATA) {
+      LOG("gfapi", GB_LOG_WARNING,
+          "glfs_getxattr(%s) on volume %s failed[%s], assuming v%d",
+          GB_METAVERSION_ATTR, volume, strerror(errno), GB_METAFILE_V1);
+    }
+    return GB_METAFILE_V1;
+  }
+  sscanf(buf, "%d", &version);
+
+  return (version == GB_METAFILE_V2) ? GB_METAFILE_V2 : GB_METAFILE_V1;
+}
+
+
+int
+glusterBlockSetMetaVersion(struct glfs *glfs, char *volume, int version)
+{
+  char buf[16] = {'\0', };
+
+
+  snprintf(buf, sizeof(buf), "%d", version);
+  if (glfs_setxattr(glfs, GB_METADIR "/" GB_TXLOCKFILE, GB_METAVERSION_ATTR,
+                    buf, strlen(buf) + 1, 0) < 0) {
+    LOG("gfapi", GB_LOG_ERROR, "glfs_setxattr(%s) on volume %s failed[%s]",
+        GB_METAVERSION_ATTR, volume, strerror(errno));
+    return -1;
+  }
+
+  return 0;
+}
+
+
+/*
+ * Rewrites the metafile in the given format through metaFileReplace(), the
+ * caller must hold the block's meta.lock range exclusively. A v2 metafile
+ * some text got appended to is rewritten even if v2 is asked for.
+ */
+int
+glusterBlockMigrateMetaFile(struct glfs *glfs, char *volume, char *blockname,
+                            int version, bool *migrated)
+{
+  char *data = NULL;
+  char *text = NULL;
+  char *out = NULL;
+  size_t len = 0;
+  bool mixed = false;
+  bool v2;
+  int err = 0;
+  int ret = -1;
+
+
+  *migrated = false;
+  if (blockReadMetaFile(glfs, blockname, &data, &len, &err)) {
+    goto out;
+  }
+
+  v2 = metaFileIsV2(data, len);
+  if (v2) {
+    if (metaV2Decode(data, len, blockname, &text, &len, &mixed)) {
+      err = errno;
+      goto out;
+    }
+  } else {
+    text = data;
+    data = NULL;
+  }
+
+  if ((version == GB_METAFILE_V1 && !v2) ||
+      (version == GB_METAFILE_V2 && v2 && !mixed)) {
+    ret = 0;
+    goto out;
+  }
+
+  if (version == GB_METAFILE_V2 &&
+      metaV2Encode(text, len, true, &out, &len)) {
+    err = errno;
+    goto out;
+  }
+
+  if (metaFileReplace(glfs, volume, blockname, out ? out : text, len)) {
+    err = errno;
+    goto out;
+  }
+  *migrated = true;
+  ret = 0;
+
+ out:
+  if (ret) {
+    LOG("mgmt", GB_LOG_ERROR, "migrating metafile of block %s on volume %s "
+        "to v%d failed[%s]", blockname, volume, version, strerror(err));
+    errno = err;
+  }
+  GB_FREE(out);
+  GB_FREE(text);
+  GB_FREE(data);
+
+  return ret;
+}
+
+
+static unsigned int
+metaCacheHash(const char *volume, const char *block)
+{
+  unsigned int hash = 5381;
+
+
+  while (*volume) {
+    hash = ((hash << 5) + hash) + (unsigned char)*volume++;
+  }
+  hash = ((hash << 5) + hash) + '/';
+  while (*block) {
+    hash = ((hash << 5) + hash) + (unsigned char)*block++;
+  }
+
+  return hash & (GB_META_CACHE_HASH_SIZE - 1);
+}
+
+
+/* called with meta_cache_lock held */
+static MetaCacheEntry *
+metaCacheLookup(const char *volume, const char *block, unsigned int hash)
+{
+  MetaCacheEntry *entry;
+
+
+  if (!metaCacheInit) {
+    return NULL;
+  }
+
+  list_for_each_entry(entry, &MetaCacheHash[hash], hnode) {
+    if (!strcmp(entry->volume, volume) && !strcmp(entry->block, block)) {
+      return entry;
+    }
+  }
+
+  return NULL;
+}
+
+
+/* called with meta_cache_lock held */
+static void
+metaCacheUnlink(MetaCacheEntry *entry)
+{
+  list_del(&entry->list);
+  list_del(&entry->hnode);
+  metaCacheCount--;
+}
+
+
+static void
+metaCacheEntryFree(MetaCacheEntry *entry)
+{
+  if (!entry) {
+    return;
+  }
+
+  blockFreeMetaInfo(entry->info);
+  GB_FREE(entry);
+}
+
+
+static bool
+metaCacheStatMatch(struct stat *a, struct stat *b)
+{
+  return a->st_ino == b->st_ino && a->st_size == b->st_size &&
+         a->st_mtim.tv_sec == b->st_mtim.tv_sec &&
+         a->st_mtim.tv_nsec == b->st_mtim.tv_nsec &&
+         a->st_ctim.tv_sec == b->st_ctim.tv_sec &&
+         a->st_ctim.tv_nsec == b->st_ctim.tv_nsec;
+}
+
+
+static MetaInfo *
+blockDupMetaInfo(MetaInfo *src)
+{
+  MetaInfo *info;
+  NodeInfo *node;
+  size_t len;
+  size_t i, j;
+
+
+  if (GB_ALLOC(info) < 0) {
+    return NULL;
+  }
+  *info = *src;
+  info->arena = NULL;
+  info->list = NULL;
+  info->list_cap = 0;
+
+  if (!src->nhosts) {
+    return info;
+  }
+
+  /* size it all up front, so the copy lands in a single chunk */
+  len = src->nhosts * (sizeof(*info->list) + sizeof(*node) +
+                       2 * GB_META_ARENA_ALIGN);
+  for (i = 0; i < src->nhosts; i++) {
+    len += src->list[i]->nenties * sizeof(*node->st_journal) +
+           GB_META_ARENA_ALIGN;
+    for (j = 0; j < src->list[i]->nenties; j++) {
+      len += strlen(src->list[i]->st_journal[j]) + GB_META_ARENA_ALIGN;
+    }
+  }
+  if (metaArenaReserve(info, len) < 0) {
+    goto out;
+  }
+
+  info->list = metaArenaAlloc(info, src->nhosts * sizeof(*info->list));
+  if (!info->list) {
+    goto out;
+  }
+  info->list_cap = src->nhosts;
+
+  for (i = 0; i < src->nhosts; i++) {
+    node = metaArenaAlloc(info, sizeof(*node));
+    if (!node) {
+      goto out;
+    }
+    *node = *src->list[i];
+    node->st_journal = metaArenaAlloc(info, node->nenties *
+                                      sizeof(*node->st_journal));
+    if (node->nenties && !node->st_journal) {
+      goto out;
+    }
+    node->journal_cap = node->nenties;
+    for (j = 0; j < node->nenties; j++) {
+      node->st_journal[j] = metaArenaStrdup(info, src->list[i]->st_journal[j]);
+      if (!node->st_journal[j]) {
+        goto out;
+      }
+    }
+    info->list[i] = node;
+  }
+  blockIndexMetaInfo(info);
+
+  return info;
+
+ out:
+  blockFreeMetaInfo(info);
+  return NULL;
+}
+
+
+/*
+ * Same as blockGetMetaInfo(), but served from the MetaInfo cache when the
+ * metafile didn't change since it was last parsed, which costs a single
+ * glfs_stat() instead of open + read + close. info must be freshly
+ * allocated, like for blockGetMetaInfo().
+ */
+int
+blockGetMetaInfoCached(struct glfs* glfs, char *volume, char* metafile,
+                       MetaInfo *info, int *errCode)
+{
+  char fpath[PATH_MAX] = {0};
+  MetaCacheEntry *entry = NULL;
+  MetaCacheEntry *stale = NULL;
+  MetaInfo *dup = NULL;
+  struct stat st;
+  unsigned int hash;
+  size_t i;
+  int ret;
+
+
+  hash = metaCacheHash(volume, metafile);
+  snprintf(fpath, sizeof fpath, "%s/%s", GB_METADIR, metafile);
+  if (glfs_stat(glfs, fpath, &st)) {
+    /* let blockGetMetaInfo() report it */
+    blockMetaCacheInvalidate(volume, metafile);
+    return blockGetMetaInfo(glfs, metafile, info, errCode);
+  }
+
+  LOCK(meta_cache_lock);
+  entry = metaCacheLookup(volume, metafile, hash);
+  if (entry && metaCacheStatMatch(&entry->st, &st)) {
+    list_move(&entry->list, &MetaCache);
+    dup = blockDupMetaInfo(entry->info);
+  }
+  UNLOCK(meta_cache_lock);
+
+  if (dup) {
+    *info = *dup;
+    GB_FREE(dup);
+    return 0;
+  }
+
+  ret = blockGetMetaInfo(glfs, metafile, info, errCode);
+  if (ret) {
+    blockMetaCacheInvalidate(volume, metafile);
+    return ret;
+  }
+
+  if (GB_ALLOC(entry) < 0) {
+    return 0;
+  }
+  entry->info = blockDupMetaInfo(info);
+  if (!entry->info) {
+    GB_FREE(entry);
+    return 0;
+  }
+  GB_STRCPYSTATIC(entry->volume, volume);
+  GB_STRCPYSTATIC(entry->block, metafile);
+  entry->hash = hash;
+  entry->st = st;
+
+  LOCK(meta_cache_lock);
+  if (!metaCacheInit) {
+    for (i = 0; i < GB_META_CACHE_HASH_SIZE; i++) {
+      INIT_LIST_HEAD(&MetaCacheHash[i]);
+    }
+    metaCacheInit = true;
+  }
+  stale = metaCacheLookup(volume, metafile, hash);
+  if (stale) {
+    metaCacheUnlink(stale);
+  }
+  list_add(&entry->list, &MetaCache);
+  list_add(&entry->hnode, &MetaCacheHash[hash]);
+  metaCacheCount++;
+  if (metaCacheCount > GB_META_CACHE_MAX) {
+    entry = list_entry(MetaCache.prev, MetaCacheEntry, list);
+    metaCacheUnlink(entry);
+  } else {
+    entry = NULL;
+  }
+  UNLOCK(meta_cache_lock);
+
+  metaCacheEntryFree(stale);
+  metaCacheEntryFree(entry);
+
+  return 0;
+}
+
+
+void
+blockMetaCacheInvalidate(char *volume, char *metafile)
+{
+  MetaCacheEntry *entry;
+
+
+  LOCK(meta_cache_lock);
+  entry = metaCacheLookup(volume, metafile, metaCacheHash(volume, metafile));
+  if (entry) {
+    metaCacheUnlink(entry);
+  }
+  UNLOCK(meta_cache_lock);
+
+  metaCacheEntryFree(entry);
+}
+
+
+static unsigned int
+metaJournalHash(char *volume, char *metafile)
+{
+  return metaCacheHash(volume, metafile) & (GB_META_JOURNAL_HASH_SIZE - 1);
+}
+
+
+/* called with meta_journal_lock[hash] held */
+static MetaJournal *
+metaJournalLookup(struct glfs *glfs, char *volume, char *metafile,
+                  unsigned int hash)
+{
+  MetaJournal *journal;
+
+
+  if (!MetaJournalHash[hash].next) {
+    INIT_LIST_HEAD(&MetaJournalHash[hash]);
+  }
+
+  list_for_each_entry(journal, &MetaJournalHash[hash], hnode) {
+    if (journal->glfs == glfs && !strcmp(journal->block, metafile) &&
+        !strcmp(journal->volume, volume)) {
+      return journal;
+    }
+  }
+
+  return NULL;
+}
+
+
+/* called with meta_journal_lock[hash] held, returns a referenced journal */
+static MetaJournal *
+metaJournalGet(struct glfs *glfs, char *volume, char *metafile,
+               unsigned int hash)
+{
+  MetaJournal *journal;
+
+
+  journal = metaJournalLookup(glfs, volume, metafile, hash);
+  if (journal) {
+    journal->refs++;
+    return journal;
+  }
+
+  if (GB_ALLOC(journal) < 0) {
+    return NULL;
+  }
+  journal->glfs = glfs;
+  GB_STRCPYSTATIC(journal->volume, volume);
+  GB_STRCPYSTATIC(journal->block, metafile);
+  journal->hash = hash;
+  journal->refs = 1;
+  INIT_LIST_HEAD(&journal->waiters);
+  pthread_cond_init(&journal->cond, NULL);
+  list_add(&journal->hnode, &MetaJournalHash[hash]);
+
+  return journal;
+}
+
+
+static void
+metaJournalPut(MetaJournal *journal)
+{
+  LOCK(meta_journal_lock[journal->hash]);
+  if (--journal->refs) {
+    UNLOCK(meta_journal_lock[journal->hash]);
+    return;
+  }
+  list_del(&journal->hnode);
+  UNLOCK(meta_journal_lock[journal->hash]);
+
+  /* no appender left, hence nothing pending and nobody flushing */
+  if (journal->fd && glfs_close(journal->fd) != 0) {
+    LOG("mgmt", GB_LOG_ERROR, "glfs_close(%s): on volume %s failed[%s]",
+        journal->block, journal->volume, strerror(errno));
+  }
+  pthread_cond_destroy(&journal->cond);
+  GB_FREE(journal->pending);
+  GB_FREE(journal);
+}
+
+
+/* learns the format of the metafile just opened, the volume's if it's new */
+static int
+metaJournalProbe(MetaJournal *journal)
+{
+  char magic[sizeof(((MetaFileHeader *)0)->magic)];
+  ssize_t ret;
+
+
+  ret = glfs_read(journal->fd, magic, sizeof(magic), 0);
+  if (ret < 0) {
+    LOG("mgmt", GB_LOG_ERROR, "glfs_read(%s): on volume %s failed[%s]",
+        journal->block, journal->volume, strerror(errno));
+    return errno;
+  }
+
+  journal->fresh = !ret;
+  if (journal->fresh) {
+    journal->version = glusterBlockGetMetaVersion(journal->glfs,
+                                                  journal->volume);
+  } else if (ret == sizeof(magic) && !memcmp(magic, GB_METAV2_MAGIC, ret)) {
+    journal->version = GB_METAFILE_V2;
+  } else {
+    journal->version = GB_METAFILE_V1;
+  }
+
+  return 0;
+}
+
+
+/* the leader's part, runs unlocked; returns an errno */
+static int
+metaJournalFlush(MetaJournal *journal, bool reopen, char *buf, size_t len)
+{
+  char fpath[PATH_MAX] = {0};
+  char *rec = NULL;
+  ssize_t ret;
+  int err;
+
+
+  if (reopen && journal->fd) {
+    glfs_close(journal->fd);
+    journal->fd = NULL;
+  }
+
+  if (!journal->fd) {
+    snprintf(fpath, sizeof fpath, "%s/%s", GB_METADIR, journal->block);
+    journal->fd = glfs_creat(journal->glfs, fpath,
+                             O_RDWR | O_APPEND | O_SYNC, S_IRUSR | S_IWUSR);
+    if (!journal->fd) {
+      err = errno;
+      LOG("mgmt", GB_LOG_ERROR, "glfs_creat(%s): on volume %s failed[%s]",
+          journal->block, journal->volume, strerror(err));
+      return err;
+    }
+    err = metaJournalProbe(journal);
+    if (err) {
+      goto fail;
+    }
+  }
+
+  /* records are queued as text whatever the format, the batch is encoded */
+  if (journal->version == GB_METAFILE_V2) {
+    if (metaV2Encode(buf, len, journal->fresh, &rec, &len)) {
+      return errno;
+    }
+    buf = rec;
+  }
+
+  ret = glfs_write(journal->fd, buf, len, 0);
+  GB_FREE(rec);
+  if (ret != (ssize_t)len) {
+    err = (ret < 0) ? errno : EIO;
+    LOG("mgmt", GB_LOG_ERROR, "glfs_write(%s): on volume %s failed[%s]",
+        journal->block, journal->volume, strerror(err));
+    goto fail;
+  }
+  journal->fresh = false;
+
+  return 0;
+
+ fail:
+  /* start over with a fresh fd on the next flush */
+  glfs_close(journal->fd);
+  journal->fd = NULL;
+  return err;
+}
+
+
+struct MetaJournal *
+blockMetaJournalHold(struct glfs *glfs, char *volume, char *metafile)
+{
+  MetaJournal *journal;
+  unsigned int hash = metaJournalHash(volume, metafile);
+
+
+  LOCK(meta_journal_lock[hash]);
+  journal = metaJournalGet(glfs, volume, metafile, hash);
+  UNLOCK(meta_journal_lock[hash]);
+
+  return journal;
+}
+
+
+void
+blockMetaJournalRelease(struct MetaJournal *journal)
+{
+  if (journal) {
+    metaJournalPut(journal);
+  }
+}
+
+
+int
+blockMetaJournalAppend(struct glfs *glfs, char *volume, char *metafile,
+                       char *data)
+{
+  MetaJournal *journal;
+  MetaJournalWaiter self = {0, };
+  MetaJournalWaiter *waiter, *tmp;
+  LIST_HEAD(batch);
+  unsigned int hash = metaJournalHash(volume, metafile);
+  pthread_mutex_t *lk = &meta_journal_lock[hash];
+  size_t len = strlen(data);
+  size_t cap;
+  char *buf;
+  size_t blen;
+  bool reopen;
+  int err;
+
+
+  LOCK(*lk);
+  journal = metaJournalGet(glfs, volume, metafile, hash);
+  if (!journal) {
+    UNLOCK(*lk);
+    errno = ENOMEM;
+    return -1;
+  }
+
+  if (journal->plen + len > journal->pcap) {
+    cap = journal->pcap ? journal->pcap : GB_META_JOURNAL_BUF;
+    while (cap < journal->plen + len) {
+      cap *= 2;
+    }
+    if (GB_REALLOC_N(journal->pending, cap) < 0) {
+      UNLOCK(*lk);
+      metaJournalPut(journal);
+      errno = ENOMEM;
+      return -1;
+    }
+    journal->pcap = cap;
+  }
+  memcpy(journal->pending + journal->plen, data, len);
+  journal->plen += len;
+  journal->dirty = true;
+  list_add_tail(&self.list, &journal->waiters);
+
+  while (!self.done) {
+    if (journal->flushing) {
+      pthread_cond_wait(&journal->cond, lk);
+      continue;
+    }
+
+    /* lead: take all that is queued, our own record included */
+    journal->flushing = true;
+    buf = journal->pending;
+    blen = journal->plen;
+    journal->pending = NULL;
+    journal->plen = journal->pcap = 0;
+    list_splice_init(&journal->waiters, &batch);
+    reopen = journal->stale;
+    journal->stale = false;
+    UNLOCK(*lk);
+
+    err = metaJournalFlush(journal, reopen, buf, blen);
+    GB_FREE(buf);
+
+    LOCK(*lk);
+    list_for_each_entry_safe(waiter, tmp, &batch, list) {
+      list_del(&waiter->list);
+      waiter->err = err;
+      waiter->done = true;
+    }
+    journal->flushing = false;
+    pthread_cond_broadcast(&journal->cond);
+  }
+  UNLOCK(*lk);
+
+  blockMetaCacheInvalidate(volume, metafile);
+  metaJournalPut(journal);
+
+  if (self.err) {
+    errno = self.err;
+    return -1;
+  }
+
+  return 0;
+}
+
+
+/* the metafile is gone, a held journal must not keep writing to it */
+void
+blockMetaJournalInvalidate(struct glfs *glfs, char *volume, char *metafile)
+{
+  MetaJournal *journal;
+  unsigned int hash = metaJournalHash(volume, metafile);
+
+
+  LOCK(meta_journal_lock[hash]);
+  journal = metaJournalLookup(glfs, volume, metafile, hash);
+  if (journal) {
+    journal->stale = true;
+  }
+  UNLOCK(meta_journal_lock[hash]);
+}
+
+
+static unsigned int
+blockIndexHash(const char *name)
+{
+  unsigned int hash = 5381;
+
+
+  while (*name) {
+    hash = ((hash << 5) + hash) + (unsigned char)*name++;
+  }
+
+  return hash & (GB_INDEX_HASH_SIZE - 1);
+}
+
+
+BlockIndexEntry *
+blockIndexLookup(BlockIndex *index, const char *name)
+{
+  BlockIndexEntry *e;
+
+
+  for (e = index->hash[blockIndexHash(name)]; e; e = e->hnext) {
+    if (!strcmp(e->name, name)) {
+      return e;
+    }
+  }
+
+  return NULL;
+}
+
+
+static BlockIndexEntry *
+blockIndexAdd(BlockIndex *index, const char *name)
+{
+  BlockIndexEntry *e = blockIndexLookup(index, name);
+  unsigned int hash;
+  size_t cap;
+
+
+  if (e) {
+    return e;
+  }
+
+  if (index->nblocks == index->cap) {
+    cap = index->cap ? index->cap * 2 : GB_META_ARRAY_MIN;
+    if (GB_REALLOC_N(index->blocks, cap) < 0) {
+      return NULL;
+    }
+    index->cap = cap;
+  }
+  if (GB_ALLOC(e) < 0) {
+    return NULL;
+  }
+  GB_STRCPYSTATIC(e->name, name);
+  hash = blockIndexHash(name);
+  e->hnext = index->hash[hash];
+  index->hash[hash] = e;
+  index->blocks[index->nblocks++] = e;
+
+  return e;
+}
+
+
+static void
+blockIndexDrop(BlockIndex *index, const char *name)
+{
+  BlockIndexEntry **pp = &index->hash[blockIndexHash(name)];
+  BlockIndexEntry *e;
+  size_t i;
+
+
+  for (; *pp; pp = &(*pp)->hnext) {
+    if (!strcmp((*pp)->name, name)) {
+      break;
+    }
+  }
+  if (!*pp) {
+    return;
+  }
+  e = *pp;
+  *pp = e->hnext;
+
+  for (i = 0; i < index->nblocks; i++) {
+    if (index->blocks[i] == e) {
+      memmove(&index->blocks[i], &index->blocks[i + 1],
+              (index->nblocks - i - 1) * sizeof(e));
+      index->nblocks--;
+      break;
+    }
+  }
+  GB_FREE(e->hosts);
+  GB_FREE(e);
+}
+
+
+void
+blockIndexFree(BlockIndex *index)
+{
+  size_t i;
+
+
+  if (!index) {
+    return;
+  }
+
+  for (i = 0; i < index->nblocks; i++) {
+    GB_FREE(index->blocks[i]->hosts);
+    GB_FREE(index->blocks[i]);
+  }
+  GB_FREE(index->blocks);
+  GB_FREE(index);
+}
+
+
+/* info NULL keeps just the name, for blocks whose metafile can't be read */
+static int
+blockIndexFill(BlockIndexEntry *e, MetaInfo *info)
+{
+  char *hosts = NULL;
+  char *tmp;
+  size_t i;
+
+
+  for (i = 0; info && i < info->nhosts; i++) {
+    if (!blockhostIsValid(info->list[i]->status)) {
+      continue;
+    }
+    tmp = hosts;
+    if (GB_ASPRINTF(&hosts, "%s%s%s", tmp ? tmp : "", tmp ? "," : "",
+                    info->list[i]->addr) < 0) {
+      GB_FREE(tmp);
+      return -1;
+    }
+    GB_FREE(tmp);
+  }
+
+  GB_FREE(e->hosts);
+  e->hosts = hosts;
+  if (info) {
+    GB_STRCPYSTATIC(e->gbid, info->gbid);
+    GB_STRCPYSTATIC(e->prio_path, info->prio_path);
+    GB_STRCPYSTATIC(e->entry, info->entry);
+    e->size = info->size;
+    e->mpath = info->mpath;
+  } else {
+    e->gbid[0] = e->prio_path[0] = e->entry[0] = '\0';
+    e->size = e->mpath = 0;
+  }
+
+  return 0;
+}
+
+
+/* the record is left unstamped, for blockIndexLoad to read again */
+int
+blockIndexSet(BlockIndex *index, const char *name, MetaInfo *info)
+{
+  BlockIndexEntry *e = blockIndexAdd(index, name);
+
+
+  if (!e) {
+    return -1;
+  }
+  e->mino = e->mlen = 0;
+
+  return blockIndexFill(e, info);
+}
+
+
+/* st must be taken before the metafile is read for the record */
+static void
+blockIndexStamp(BlockIndexEntry *e, struct stat *st)
+{
+  e->mino = st->st_ino;
+  e->mlen = st->st_size;
+}
+
+
+/*
+ * Metafiles only grow until they are replaced by a rename, so one with the
+ * same inode and length still holds what the record was taken from.
+ */
+static bool
+blockIndexFresh(BlockIndexEntry *e, struct stat *st)
+{
+  return e->mino && e->mino == (uint64_t)st->st_ino &&
+         e->mlen == (uint64_t)st->st_size;
+}
+
+
+bool
+blockIndexHasHost(BlockIndexEntry *e, const char *addr)
+{
+  size_t len = strlen(addr);
+  char *s = e->hosts;
+
+
+  while (s && (s = strstr(s, addr))) {
+    if ((s == e->hosts || s[-1] == ',') && (!s[len] || s[len] == ',')) {
+      return true;
+    }
+    s += len;
+  }
+
+  return false;
+}
+
+
+/* empty fields are written as "-", to keep them space separated */
+static const char *
+blockIndexField(const char *s)
+{
+  return (s && s[0]) ? s : "-";
+}
+
+
+static int
+blockIndexFormat(char **rec, BlockIndexEntry *e)
+{
+  return GB_ASPRINTF(rec, "%s: %s %zu %zu %s %s %s %" PRIu64 ":%" PRIu64 "\n",
+                     e->name, blockIndexField(e->gbid), e->size, e->mpath,
+                     blockIndexField(e->prio_path), blockIndexField(e->entry),
+                     blockIndexField(e->hosts), e->mino, e->mlen);
+}
+
+
+/*
+ * "<name>: <gbid> <size> <ha> <prio> <entry> <hosts> <ino>:<len>", or
+ * "<name>: -". Records without the stamp are taken as unstamped.
+ */
+static int
+blockIndexParseLine(BlockIndex *index, char *line)
+{
+  BlockIndexEntry *e;
+  char *field[6];
+  char *save = NULL;
+  char *val;
+  size_t i;
+
+
+  val = strstr(line, ": ");
+  if (!val || val == line) {
+    return -1;
+  }
+  *val = '\0';
+  val += 2;
+
+  index->records++;
+  if (!strcmp(val, "-")) {
+    blockIndexDrop(index, line);
+    return 0;
+  }
+
+  for (i = 0; i < 6; i++) {
+    field[i] = strtok_r(i ? NULL : val, " ", &save);
+    if (!field[i]) {
+      return -1;
+    }
+    if (!strcmp(field[i], "-")) {
+      field[i] = "";
+    }
+  }
+
+  e = blockIndexAdd(index, line);
+  if (!e) {
+    return -1;
+  }
+  GB_STRCPYSTATIC(e->gbid, field[0]);
+  sscanf(field[1], "%zu", &e->size);
+  sscanf(field[2], "%zu", &e->mpath);
+  GB_STRCPYSTATIC(e->prio_path, field[3]);
+  GB_STRCPYSTATIC(e->entry, field[4]);
+  GB_FREE(e->hosts);
+  if (field[5][0] && GB_STRDUP(e->hosts, field[5]) < 0) {
+    return -1;
+  }
+  e->mino = e->mlen = 0;
+  val = strtok_r(NULL, " ", &save);
+  if (val && sscanf(val, "%" SCNu64 ":%" SCNu64, &e->mino, &e->mlen) != 2) {
+    e->mino = e->mlen = 0;
+  }
+
+  return 0;
+}
+
+
+/*
+ * Loads GB_INDEXFILE, later records of a block superseding earlier ones.
+ * Fails with ENOENT if the volume has no index yet.
+ */
+int
+blockIndexRead(struct glfs *glfs, char *volume, BlockIndex **index,
+               int *errCode)
+{
+  BlockIndex *tmp = NULL;
+  char *data = NULL;
+  char *save = NULL;
+  char *line;
+  int ret = -1;
+
+
+  *index = NULL;
+  if (blockReadMetaFile(glfs, GB_INDEXFILE, &data, NULL, errCode)) {
+    goto out;
+  }
+
+  if (GB_ALLOC(tmp) < 0) {
+    *errCode = ENOMEM;
+    goto out;
+  }
+
+  for (line = strtok_r(data, "\n", &save); line;
+       line = strtok_r(NULL, "\n", &save)) {
+    if (blockIndexParseLine(tmp, line)) {
+      *errCode = EINVAL;
+      LOG("mgmt", GB_LOG_WARNING, "index of volume %s is corrupt, rebuild it "
+          "with 'gluster-block reindex %s'", volume, volume);
+      goto out;
+    }
+  }
+
+  *index = tmp;
+  tmp = NULL;
+  ret = 0;
+
+ out:
+  blockIndexFree(tmp);
+  GB_FREE(data);
+
+  return ret;
+}
+
+
+/* more than this many superseded records and the index gets rewritten */
+bool
+blockIndexNeedsRewrite(BlockIndex *index)
+{
+  return index->records > 2 * index->nblocks + GB_INDEX_SLACK;
+}
+
+
+/*
+ * Checks index against GB_METADIR, which has the final say on what blocks
+ * there are: records of blocks without a metafile are dropped, and blocks
+ * whose metafile changed since their record was taken (replace-node.sh
+ * and older peers don't commit to the index, nor does a failed
+ * blockIndexCommit) are read again, as are those without a record.
+ */
+static int
+blockIndexRefresh(struct glfs *glfs, char *volume, BlockIndex *index,
+                  bool *dirty, int *errCode)
+{
+  struct glfs_fd *tgmdfd = NULL;
+  struct dirent *entry;
+  struct stat st;
+  BlockIndexEntry *e;
+  MetaInfo *info = NULL;
+  size_t i;
+  int ret = -1;
+
+
+  for (i = 0; i < index->nblocks; i++) {
+    index->blocks[i]->seen = false;
+  }
+
+  tgmdfd = glfs_opendir(glfs, GB_METADIR);
+  if (!tgmdfd) {
+    *errCode = errno;
+    LOG("mgmt", GB_LOG_ERROR, "glfs_opendir(%s): on volume %s failed[%s]",
+        GB_METADIR, volume, strerror(*errCode));
+    goto out;
+  }
+
+  while ((entry = glfs_readdirplus(tgmdfd, &st))) {
+    if (strchr(entry->d_name, '.')) {
       continue;
     }
-    count += strlen(tmp) + 1;
-    ret = blockStuffMetaInfo(info, tmp);
-    if (ret) {
-      if (errCode) {
-        *errCode = errno;
+
+    e = blockIndexLookup(index, entry->d_name);
+    if (!e || !blockIndexFresh(e, &st)) {
+      if (GB_ALLOC(info) < 0) {
+        *errCode = ENOMEM;
+        goto out;
+      }
+      if (blockGetMetaInfoCached(glfs, volume, entry->d_name, info, NULL)) {
+        LOG("mgmt", GB_LOG_WARNING, "indexing block %s of volume %s without "
+            "its metadata", entry->d_name, volume);
+        blockFreeMetaInfo(info);
+        info = NULL;
+      }
+      /* a block that still can't be read keeps its bare record as is */
+      if (info || !e || e->mino || e->gbid[0]) {
+        *dirty = true;
+      }
+      e = blockIndexAdd(index, entry->d_name);
+      if (!e || blockIndexFill(e, info)) {
+        *errCode = ENOMEM;
+        goto out;
+      }
+      e->mino = e->mlen = 0;
+      if (info) {
+        blockIndexStamp(e, &st);
+      }
+      blockFreeMetaInfo(info);
+      info = NULL;
+    }
+    e->seen = true;
+  }
+
+  for (i = index->nblocks; i-- > 0;) {
+    if (!index->blocks[i]->seen) {
+      blockIndexDrop(index, index->blocks[i]->name);
+      *dirty = true;
+    }
+  }
+
+  ret = 0;
+
+ out:
+  if (tgmdfd && glfs_closedir(tgmdfd) != 0) {
+    LOG("mgmt", GB_LOG_ERROR, "glfs_closedir(%s): on volume %s failed[%s]",
+        GB_METADIR, volume, strerror(errno));
+  }
+  blockFreeMetaInfo(info);
+
+  return ret;
+}
+
+
+/*
+ * Loads the index of the volume checked against its metafiles, see
+ * blockIndexRefresh; without a usable GB_INDEXFILE every metafile is read.
+ * *dirty tells whether it differs from what GB_INDEXFILE holds, for callers
+ * holding the namespace lock exclusively to blockIndexWrite it back.
+ */
+int
+blockIndexLoad(struct glfs *glfs, char *volume, BlockIndex **index,
+               bool *dirty, int *errCode)
+{
+  BlockIndex *tmp = NULL;
+  int err = 0;
+
+
+  *dirty = false;
+  if (blockIndexRead(glfs, volume, &tmp, &err)) {
+    if (err != ENOENT && err != EINVAL) {
+      *errCode = err;
+      return -1;
+    }
+    if (GB_ALLOC(tmp) < 0) {
+      *errCode = ENOMEM;
+      return -1;
+    }
+    *dirty = true;
+  }
+
+  if (blockIndexRefresh(glfs, volume, tmp, dirty, errCode)) {
+    blockIndexFree(tmp);
+    return -1;
+  }
+  *index = tmp;
+
+  return 0;
+}
+
+
+/*
+ * Replaces GB_INDEXFILE with one record per block of index, through a temp
+ * file and a rename. Caller must hold the namespace lock exclusively.
+ */
+int
+blockIndexWrite(struct glfs *glfs, char *volume, BlockIndex *index,
+                int *errCode)
+{
+  struct glfs_fd *tgfd = NULL;
+  char *buf = NULL;
+  char *rec = NULL;
+  size_t len = 0;
+  size_t cap = GB_META_JOURNAL_BUF;
+  size_t i;
+  int n;
+  int ret = -1;
+
+
+  if (GB_ALLOC_N(buf, cap) < 0) {
+    *errCode = ENOMEM;
+    goto out;
+  }
+  for (i = 0; i < index->nblocks; i++) {
+    n = blockIndexFormat(&rec, index->blocks[i]);
+    if (n < 0) {
+      *errCode = ENOMEM;
+      goto out;
+    }
+    while (len + n > cap) {
+      cap *= 2;
+      if (GB_REALLOC_N(buf, cap) < 0) {
+        *errCode = ENOMEM;
+        goto out;
       }
-      LOG("gfapi", GB_LOG_ERROR,
-          "blockStuffMetaInfo: on volume %s for block %s failed[%s]",
-          info->volume, metafile, strerror(errno));
-      goto out;
     }
-    glfs_lseek(tgmfd, count, SEEK_SET);
+    memcpy(buf + len, rec, n);
+    len += n;
+    GB_FREE(rec);
   }
-  if (ret < 0 && errCode) {/*Failure from glfs_read*/
+
+  tgfd = glfs_creat(glfs, GB_METADIR "/" GB_INDEXFILE ".tmp",
+                    O_WRONLY | O_TRUNC | O_SYNC, S_IRUSR | S_IWUSR);
+  if (!tgfd) {
+    *errCode = errno;
+    goto out;
+  }
+  if (glfs_write(tgfd, buf, len, 0) != (ssize_t)len) {
+    *errCode = errno ? errno : EIO;
+    goto out;
+  }
+  n = glfs_close(tgfd);
+  tgfd = NULL;
+  if (n) {
+    *errCode = errno;
+    goto out;
+  }
+  if (glfs_rename(glfs, GB_METADIR "/" GB_INDEXFILE ".tmp",
+                  GB_METADIR "/" GB_INDEXFILE)) {
     *errCode = errno;
     goto out;
   }
-  blockParseRSstatus(info);
+
+  index->records = index->nblocks;
+  ret = 0;
 
  out:
-  if (tgmfd && glfs_close(tgmfd) != 0) {
-    LOG("gfapi", GB_LOG_ERROR, "glfs_close(%s): on volume %s failed[%s]",
-        metafile, info->volume, strerror(errno));
+  if (tgfd) {
+    glfs_close(tgfd);
+  }
+  if (ret) {
+    LOG("mgmt", GB_LOG_ERROR, "writing index of volume %s failed[%s]",
+        volume, strerror(*errCode));
+  }
+  GB_FREE(rec);
+  GB_FREE(buf);
+
+  return ret;
+}
+
+
+/*
+ * Reads every metafile of the volume and writes a fresh index from them.
+ * Caller must hold the namespace lock exclusively.
+ */
+int
+glusterBlockRebuildIndex(struct glfs *glfs, char *volume, size_t *nblocks,
+                         int *errCode, char **errMsg)
+{
+  BlockIndex *index = NULL;
+  bool dirty;
+  int ret = -1;
+
+
+  if (GB_ALLOC(index) < 0) {
+    *errCode = ENOMEM;
+    goto out;
+  }
+
+  if (blockIndexRefresh(glfs, volume, index, &dirty, errCode) ||
+      blockIndexWrite(glfs, volume, index, errCode)) {
+    goto out;
   }
 
+  *nblocks = index->nblocks;
+  LOG("mgmt", GB_LOG_INFO, "rebuilt index of volume %s with %zu blocks",
+      volume, index->nblocks);
+  ret = 0;
+
+ out:
+  if (ret) {
+    GB_ASPRINTF(errMsg, "Not able to rebuild index of volume %s[%s]", volume,
+                strerror(*errCode));
+  }
+  blockIndexFree(index);
+
   return ret;
 }
 
 
+/*
+ * Appends the block's current record to the volume index, at the end of an
+ * op that logged to its metafile through journal (NULL: unconditionally).
+ * With lkfd, takes the namespace lock around the append; without, the
+ * caller holds it. Volumes without an index are left alone, and a failure
+ * only leaves the record stale, which blockIndexLoad catches by its stamp.
+ */
 void
-blockGetPrioPath(struct glfs* glfs, char *volume, blockServerDefPtr list,
-                 char *prio_path, size_t prio_len)
+blockIndexCommit(struct glfs *glfs, struct glfs_fd *lkfd, char *volume,
+                 char *block, struct MetaJournal *journal)
+{
+  BlockIndexEntry e = {{0, }, };
+  struct glfs_fd *ifd = NULL;
+  MetaInfo *info = NULL;
+  char fpath[PATH_MAX] = {0};
+  struct stat st;
+  char *rec = NULL;
+  char *errMsg = NULL;
+  bool dirty = true;
+  int err = 0;
+  int len = -1;
+
+
+  if (journal) {
+    LOCK(meta_journal_lock[journal->hash]);
+    dirty = journal->dirty;
+    journal->dirty = false;
+    UNLOCK(meta_journal_lock[journal->hash]);
+  }
+  if (!dirty) {
+    return;
+  }
+
+  if (GB_ALLOC(info) < 0) {
+    goto out;
+  }
+  GB_STRCPYSTATIC(e.name, block);
+  snprintf(fpath, sizeof fpath, "%s/%s", GB_METADIR, block);
+  if (glfs_stat(glfs, fpath, &st)) {
+    err = errno;
+  } else if (!blockGetMetaInfoCached(glfs, volume, block, info, &err)) {
+    if (blockIndexFill(&e, info)) {
+      goto out;
+    }
+    blockIndexStamp(&e, &st);
+    len = blockIndexFormat(&rec, &e);
+  }
+  if (!rec) {
+    if (err != ENOENT) {
+      goto out;
+    }
+    len = GB_ASPRINTF(&rec, "%s: -\n", block);
+  }
+  if (len < 0) {
+    goto out;
+  }
+
+  if (lkfd && glusterBlockMetaLock(lkfd, F_WRLCK, GB_METALOCK_NS_OFFSET, 1,
+                                   volume, NULL, &errMsg)) {
+    goto out;
+  }
+  ifd = glfs_open(glfs, GB_METADIR "/" GB_INDEXFILE,
+                  O_WRONLY | O_APPEND | O_SYNC);
+  if (ifd) {
+    if (glfs_write(ifd, rec, len, 0) != len) {
+      err = errno ? errno : EIO;
+    }
+    glfs_close(ifd);
+  } else if (errno != ENOENT) {
+    err = errno;
+  }
+  if (lkfd) {
+    glusterBlockMetaUnlock(lkfd, GB_METALOCK_NS_OFFSET, 1, volume);
+  }
+  if (!err) {
+    dirty = false;
+  }
+
+ out:
+  if (dirty) {
+    LOG("mgmt", GB_LOG_WARNING, "updating index of volume %s for block %s "
+        "failed, rebuild it with 'gluster-block reindex %s'", volume, block,
+        volume);
+  }
+  GB_FREE(errMsg);
+  GB_FREE(e.hosts);
+  GB_FREE(rec);
+  blockFreeMetaInfo(info);
+}
+
+
+/*
+ * prio.info accounts how many blocks have each host as PRIOPATH, for create
+ * to give a new block the least loaded one. The counts are kept together,
+ * one "<host> <count>" line each, in the GB_PRIO_TABLE_ATTR xattr: a single
+ * read gets all of them and a single write puts them back. Callers hold the
+ * namespace lock exclusively from read to write, which serializes updates
+ * across nodes. Changed counts are mirrored to the per host
+ * "user.block.<host>" xattrs older releases use, and a volume without a
+ * table is seeded from those.
+ */
+static BlockPrioCount *
+blockPrioTableFind(BlockPrioTable *t, const char *addr)
+{
+  size_t i;
+
+
+  for (i = 0; i < t->nhosts; i++) {
+    if (!strcmp(t->hosts[i].addr, addr)) {
+      return &t->hosts[i];
+    }
+  }
+
+  return NULL;
+}
+
+
+static BlockPrioCount *
+blockPrioTableAdd(BlockPrioTable *t, const char *addr, size_t count)
+{
+  BlockPrioCount *c;
+
+
+  if (strlen(addr) >= sizeof(c->addr) ||
+      GB_REALLOC_N(t->hosts, t->nhosts + 1) < 0) {
+    return NULL;
+  }
+
+  c = &t->hosts[t->nhosts++];
+  memset(c, 0, sizeof(*c));
+  GB_STRCPYSTATIC(c->addr, addr);
+  c->count = count;
+
+  return c;
+}
+
+
+int
+blockPrioTableRead(struct glfs *glfs, char *volume, BlockPrioTable *t)
 {
   struct glfs_fd *pfd = NULL;
-  char attr[256];
-  char buf[1024];
-  int index = 0;
-  size_t count = 0;
-  size_t min = 0;
-  bool flag = true;
-  int i;
+  char addr[255];
+  char *buf = NULL;
+  char *line;
+  char *next;
+  size_t size = GB_PRIO_TABLE_READ_SIZE;
+  size_t count;
+  ssize_t len;
   int ret = -1;
 
 
+  memset(t, 0, sizeof(*t));
+
   pfd = glfs_creat(glfs, GB_PRIO_FILE, O_RDONLY | O_CREAT | O_SYNC,
                    S_IRUSR | S_IWUSR);
   if (!pfd) {
     LOG("gfapi", GB_LOG_ERROR, "glfs_creat(%s) on volume %s failed[%s]",
         GB_PRIO_FILE, volume, strerror(errno));
-    return;
+    return -1;
   }
 
-  for (i = 0; i < list->nhosts; i++) {
-    memset(attr, '\0', sizeof(attr));
-    snprintf(attr, sizeof(attr), "%s.%s", GB_LB_ATTR_PREFIX, list->hosts[i]);
-
-    memset(buf, '\0', sizeof(buf));
-    if (glfs_fgetxattr(pfd, attr, buf, sizeof(buf)) < 0) {
-      if (errno != ENODATA) {
-        LOG("gfapi", GB_LOG_ERROR,
-            "glfs_fgetxattr(%s) on volume %s for prio file %s failed[%s]",
-            attr, volume, GB_PRIO_FILE, strerror(errno));
-        goto out;
-      } else {
-        index = i;
-        min = 0;
-        break;
+  while (true) {
+    if (GB_REALLOC_N(buf, size + 1) < 0) {
+      goto out;
+    }
+    len = glfs_fgetxattr(pfd, GB_PRIO_TABLE_ATTR, buf, size);
+    if (len >= 0) {
+      break;
+    }
+    if (errno == ENODATA) {
+      t->legacy = true;
+      ret = 0;
+      goto out;
+    }
+    if (errno == ERANGE) {
+      len = glfs_fgetxattr(pfd, GB_PRIO_TABLE_ATTR, NULL, 0);
+      if (len > 0) {
+        size = len;
+        continue;
       }
     }
+    LOG("gfapi", GB_LOG_ERROR,
+        "glfs_fgetxattr(%s) on volume %s for prio file %s failed[%s]",
+        GB_PRIO_TABLE_ATTR, volume, GB_PRIO_FILE, strerror(errno));
+    goto out;
+  }
+  buf[len] = '\0';
 
-    sscanf(buf, "%zu", &count);
-    if (flag || min > count) {
-      min = count;
-      index = i;
-      flag = false;
+  for (line = buf; line && *line; line = next) {
+    next = strchr(line, '\n');
+    if (next) {
+      *next++ = '\0';
+    }
+    if (sscanf(line, "%254s %zu", addr, &count) != 2) {
+      LOG("mgmt", GB_LOG_WARNING, "skipping bad entry '%s' in prio table of "
+          "volume %s", line, volume);
+      continue;
+    }
+    if (!blockPrioTableFind(t, addr) && !blockPrioTableAdd(t, addr, count)) {
+      goto out;
     }
   }
 
-  if (list->nhosts) {
-    ret = 0;
-  }
+  ret = 0;
 
  out:
-  if (pfd && glfs_close(pfd) != 0) {
+  if (ret) {
+    blockPrioTableFree(t);
+  }
+  if (glfs_close(pfd) != 0) {
     LOG("gfapi", GB_LOG_ERROR, "glfs_close(%s): on volume %s failed[%s]",
         GB_PRIO_FILE, volume, strerror(errno));
   }
+  GB_FREE(buf);
+
+  return ret;
+}
+
+
+/*
+ * Returns the count of addr, adding it if the table has none. Unless the
+ * table is a legacy one, a host missing from it has no blocks.
+ */
+BlockPrioCount *
+blockPrioTableGet(struct glfs *glfs, BlockPrioTable *t, const char *addr)
+{
+  BlockPrioCount *c = blockPrioTableFind(t, addr);
+  char attr[sizeof(GB_LB_ATTR_PREFIX) + sizeof(t->hosts->addr)];
+  char buf[32] = {'\0', };
+  size_t count = 0;
+
+
+  if (c) {
+    return c;
+  }
 
-  if (!ret) {
-    if (strlen(list->hosts[index]) < sizeof(attr) - strlen(GB_LB_ATTR_PREFIX)) {
-      GB_STRCPY(prio_path, list->hosts[index], prio_len);
+  if (t->legacy) {
+    snprintf(attr, sizeof(attr), "%s.%s", GB_LB_ATTR_PREFIX, addr);
+    if (glfs_getxattr(glfs, GB_PRIO_FILE, attr, buf, sizeof(buf) - 1) >= 0) {
+      sscanf(buf, "%zu", &count);
+    } else if (errno != ENODATA) {
+      LOG("gfapi", GB_LOG_WARNING,
+          "glfs_getxattr(%s) for prio file %s failed[%s]",
+          attr, GB_PRIO_FILE, strerror(errno));
     }
   }
 
-  return;
+  c = blockPrioTableAdd(t, addr, count);
+  if (c && t->legacy) {
+    c->dirty = true;
+  }
+
+  return c;
 }
 
 
-void
-blockIncPrioAttr(struct glfs* glfs, char *volume, char *addr)
+int
+blockPrioTableWrite(struct glfs *glfs, char *volume, BlockPrioTable *t)
 {
-  size_t count;
-  char buf[1024] = {'\0', };
-  char attr[256] = {'\0', };
+  char attr[sizeof(GB_LB_ATTR_PREFIX) + sizeof(t->hosts->addr)];  /* "<prefix>.<addr>" */
+  char val[32];
+  char *buf = NULL;
+  size_t len = 0;
+  size_t i;
+  int n;
+  int ret = -1;
 
 
-  snprintf(attr, sizeof(attr), "%s.%s", GB_LB_ATTR_PREFIX, addr);
-  if (glfs_getxattr(glfs, GB_PRIO_FILE, attr, buf, sizeof(buf)) < 0) {
-    if (errno != ENODATA) {
-      LOG("gfapi", GB_LOG_ERROR,
-          "glfs_getxattr(%s) on volume %s for prio file %s failed[%s]",
-          attr, volume, GB_PRIO_FILE, strerror(errno));
-      return;
-    } else {
-      count = 0;
-    }
-  } else {
-    sscanf(buf, "%zu", &count);
+  if (GB_ALLOC_N(buf, t->nhosts * (sizeof(t->hosts->addr) + 24) + 1) < 0) {
+    return -1;
+  }
+  for (i = 0; i < t->nhosts; i++) {
+    len += sprintf(buf + len, "%s %zu\n", t->hosts[i].addr,
+                   t->hosts[i].count);
   }
 
-  memset(buf, '\0', sizeof(buf));
-  snprintf(buf, sizeof(buf), "%zu", count + 1);
-  if (glfs_setxattr(glfs, GB_PRIO_FILE, attr, buf, sizeof(buf), 0) < 0) {
+  if (glfs_setxattr(glfs, GB_PRIO_FILE, GB_PRIO_TABLE_ATTR, buf, len, 0) < 0) {
     LOG("gfapi", GB_LOG_ERROR,
         "glfs_setxattr(%s) on volume %s for prio file %s failed[%s]",
-        attr, volume, GB_PRIO_FILE, strerror(errno));
+        GB_PRIO_TABLE_ATTR, volume, GB_PRIO_FILE, strerror(errno));
+    goto out;
+  }
+  t->legacy = false;
+
+  for (i = 0; i < t->nhosts; i++) {
+    if (!t->hosts[i].dirty) {
+      continue;
+    }
+    snprintf(attr, sizeof(attr), "%s.%s", GB_LB_ATTR_PREFIX,
+             t->hosts[i].addr);
+    n = snprintf(val, sizeof(val), "%zu", t->hosts[i].count);
+    if (glfs_setxattr(glfs, GB_PRIO_FILE, attr, val, n + 1, 0) < 0) {
+      LOG("gfapi", GB_LOG_WARNING,
+          "glfs_setxattr(%s) on volume %s for prio file %s failed[%s]",
+          attr, volume, GB_PRIO_FILE, strerror(errno));
+      continue;
+    }
+    t->hosts[i].dirty = false;
+  }
+
+  ret = 0;
+
+ out:
+  GB_FREE(buf);
+  return ret;
+}
+
+
+void
+blockPrioTableFree(BlockPrioTable *t)
+{
+  GB_FREE(t->hosts);
+  t->hosts = NULL;
+  t->nhosts = 0;
+}
+
+
+/*
+ * Picks the least loaded of list's hosts, the first one of them on a tie,
+ * and counts the block on it right away, so that concurrent creates don't
+ * all pick the same host. Called with the namespace lock held exclusively;
+ * a caller that ends up without a metafile carrying the PRIOPATH has to
+ * give it back with blockMovePrioCount(). prio_path stays empty on failure.
+ */
+void
+blockGetPrioPath(struct glfs* glfs, char *volume, blockServerDefPtr list,
+                 char *prio_path, size_t prio_len)
+{
+  BlockPrioTable t;
+  BlockPrioCount *c;
+  size_t min = 0;     /* index in t.hosts, which moves as it grows */
+  bool found = false;
+  size_t i;
+
+
+  if (blockPrioTableRead(glfs, volume, &t)) {
     return;
   }
 
-  return;
+  for (i = 0; i < list->nhosts; i++) {
+    c = blockPrioTableGet(glfs, &t, list->hosts[i]);
+    if (!c) {
+      goto out;
+    }
+    if (!found || t.hosts[min].count > c->count) {
+      min = c - t.hosts;
+      found = true;
+    }
+  }
+  if (!found) {
+    goto out;
+  }
+
+  t.hosts[min].count++;
+  t.hosts[min].dirty = true;
+  if (!blockPrioTableWrite(glfs, volume, &t)) {
+    GB_STRCPY(prio_path, t.hosts[min].addr, prio_len);
+  }
+
+ out:
+  blockPrioTableFree(&t);
 }
 
 
+/*
+ * Moves a block's count from one host to another, either may be NULL for a
+ * block that is gone or new. Called with the namespace lock held
+ * exclusively.
+ */
 void
-blockDecPrioAttr(struct glfs* glfs, char *volume, char *addr)
+blockMovePrioCount(struct glfs* glfs, char *volume, char *from, char *to)
 {
-  size_t count;
-  char buf[1024] = {'\0', };
-  char attr[256] = {'\0', };
+  BlockPrioTable t;
+  BlockPrioCount *c;
 
 
-  snprintf(attr, sizeof(attr), "%s.%s", GB_LB_ATTR_PREFIX, addr);
-  if (glfs_getxattr(glfs, GB_PRIO_FILE, attr, buf, sizeof(buf)) < 0) {
-    if (errno != ENODATA) {
-      LOG("gfapi", GB_LOG_ERROR,
-          "glfs_getxattr(%s) on volume %s for prio file %s failed[%s]",
-          attr, volume, GB_PRIO_FILE, strerror(errno));
-      return;
-    } else {
-      count = 0;
+  if (blockPrioTableRead(glfs, volume, &t)) {
+    return;
+  }
+
+  if (from && from[0]) {
+    c = blockPrioTableGet(glfs, &t, from);
+    if (!c) {
+      goto out;
+    }
+    if (c->count) {
+      c->count--;
+      c->dirty = true;
     }
-  } else {
-    sscanf(buf, "%zu", &count);
   }
 
-  if (count != 0) {
-    memset(buf, '\0', sizeof(buf));
-    snprintf(buf, sizeof(buf), "%zu", count - 1);
-    if (glfs_setxattr(glfs, GB_PRIO_FILE, attr, buf, sizeof(buf), 0) < 0) {
-      LOG("gfapi", GB_LOG_ERROR,
-          "glfs_setxattr(%s) on volume %s for prio file %s failed[%s]",
-          attr, volume, GB_PRIO_FILE, strerror(errno));
-      return;
+  if (to && to[0]) {
+    c = blockPrioTableGet(glfs, &t, to);
+    if (!c) {
+      goto out;
     }
+    c->count++;
+    c->dirty = true;
   }
 
-  return;
+  blockPrioTableWrite(glfs, volume, &t);
+
+ out:
+  blockPrioTableFree(&t);
 }
 
 
+/*
+ * Rebuilds the prio.info counts from the PRIOPATH of the blocks in the
+ * volume index, fixing what drifted (releases updating only their own
+ * xattrs, ops that died half way). Hosts no block uses anymore stay, with
+ * a count of 0. The caller holds the namespace lock exclusively, and gets
+ * the new table in t.
+ */
 int
-blockGetAddrStatusFromInfo(MetaInfo *info, char *addr)
+glusterBlockRecountPrio(struct glfs *glfs, char *volume, BlockPrioTable *t,
+                        int *errCode, char **errMsg)
 {
+  BlockIndex *index = NULL;
+  BlockPrioCount *c;
+  bool dirty;
   size_t i;
+  int err = 0;
+  int ret = -1;
 
 
-  if (!addr) {
+  if (blockIndexLoad(glfs, volume, &index, &dirty, errCode)) {
     goto out;
   }
+  if (dirty) {
+    blockIndexWrite(glfs, volume, index, &err);
+  }
 
-  for (i = 0; i < info->nhosts; i++) {
-    if (!strcmp(addr, info->list[i]->addr)) {
-      return blockMetaStatusEnumParse(info->list[i]->status);
+  if (blockPrioTableRead(glfs, volume, t)) {
+    *errCode = errno;
+    goto out;
+  }
+  for (i = 0; i < t->nhosts; i++) {
+    t->hosts[i].count = 0;
+    t->hosts[i].dirty = true;
+  }
+  t->legacy = false;
+
+  for (i = 0; i < index->nblocks; i++) {
+    if (!index->blocks[i]->prio_path[0]) {
+      continue;
     }
+    c = blockPrioTableGet(glfs, t, index->blocks[i]->prio_path);
+    if (!c) {
+      *errCode = ENOMEM;
+      goto out;
+    }
+    c->count++;
+    c->dirty = true;
+  }
+
+  if (blockPrioTableWrite(glfs, volume, t)) {
+    *errCode = errno;
+    goto out;
   }
 
+  LOG("mgmt", GB_LOG_INFO, "recounted prio paths of %zu blocks on %zu hosts "
+      "of volume %s", index->nblocks, t->nhosts, volume);
+  ret = 0;
+
  out:
-  return GB_METASTATUS_MAX;
+  if (ret) {
+    GB_ASPRINTF(errMsg, "Not able to recount prio paths of volume %s[%s]",
+                volume, strerror(*errCode));
+    blockPrioTableFree(t);
+  }
+  blockIndexFree(index);
+
+  return ret;
+}
+
+
+int
+blockGetAddrStatusFromInfo(MetaInfo *info, char *addr)
+{
+  NodeInfo *node = blockMetaInfoGetNode(info, addr);
+
+
+  return node ? node->st : GB_METASTATUS_MAX;
 }
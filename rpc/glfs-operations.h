@@ -21,15 +21,42 @@
 # include  "block.h"
 
 
+# define   GB_META_HOST_HASH_SIZE  64  /* must be power of 2 */
+
+# define   GB_INDEX_HASH_SIZE      4096  /* must be power of 2 */
+
+# define   GB_METAFILE_V1          1  /* "KEY: value" lines */
+# define   GB_METAFILE_V2          2  /* binary records, needs metafile_v2 */
+
+# define   GB_METALOCK_HIST_SIZE   20  /* log2 ms buckets, last is open ended */
+# define   GB_METALOCK_STATS_FILE  GB_INFODIR "/gluster-blockd-metalock.stats"
+
 
 typedef struct NodeInfo {
   char addr[255];
   size_t nenties;
+  size_t journal_cap;  /* allocated slots in st_journal */
   char **st_journal;   /* maintain state journal per node */
   char status[32];
   ssize_t size;
+  int st;              /* status parsed to MetaStatus */
+  bool rs_seen;        /* journal has an RSSUCCESS entry */
+  ssize_t rs_size;     /* size of the latest one, -1 if it carries none */
+  struct NodeInfo *hnext;  /* chain in MetaInfo->hosts */
 } NodeInfo;
 
+struct MetaArena;
+struct MetaJournal;
+
+typedef struct gbMetaLockStats {
+  size_t acquired;
+  size_t busy;         /* given up after GB_METALOCK_TIMEOUT */
+  size_t waitMax;      /* ms */
+  size_t holdMax;      /* ms */
+  size_t wait[GB_METALOCK_HIST_SIZE];  /* waits per log2 ms bucket */
+  size_t hold[GB_METALOCK_HIST_SIZE];  /* ops' hold times, same buckets */
+} gbMetaLockStats;
+
 typedef struct MetaInfo {
   char   volume[255];
   char   gbid[38];
@@ -44,13 +71,66 @@ typedef struct MetaInfo {
   char   passwd[38];
 
   size_t nhosts;
+  size_t list_cap;     /* allocated slots in list */
   NodeInfo **list;
+  NodeInfo *hosts[GB_META_HOST_HASH_SIZE];  /* addr -> node, see blockMetaInfoGetNode */
+
+  /* nodes, journals and the arrays above live here, see blockFreeMetaInfo */
+  struct MetaArena *arena;
 } MetaInfo;
 
+/*
+ * What list and genconfig need to know of a block without opening its
+ * metafile, one "<name>: <record>" line per update in GB_INDEXFILE.
+ */
+typedef struct BlockIndexEntry {
+  char name[255];
+  char gbid[38];
+  size_t size;
+  size_t mpath;
+  char prio_path[255];
+  char entry[16];      /* ENTRYCREATE status */
+  char *hosts;         /* hosts with a valid status, comma separated */
+  uint64_t mino;       /* inode and length of the metafile the record */
+  uint64_t mlen;       /* was taken from, 0 if unknown */
+  bool seen;           /* found in GB_METADIR by blockIndexRefresh */
+  struct BlockIndexEntry *hnext;  /* chain in BlockIndex->hash */
+} BlockIndexEntry;
+
+typedef struct BlockIndex {
+  size_t nblocks;
+  size_t cap;          /* allocated slots in blocks */
+  BlockIndexEntry **blocks;
+  size_t records;      /* lines read, superseded ones included */
+  BlockIndexEntry *hash[GB_INDEX_HASH_SIZE];
+} BlockIndex;
+
+/*
+ * Number of blocks having each host as PRIOPATH, as kept on prio.info, see
+ * blockPrioTableRead().
+ */
+typedef struct BlockPrioCount {
+  char addr[255];
+  size_t count;
+  bool dirty;          /* changed since read, mirrored on write */
+} BlockPrioCount;
+
+typedef struct BlockPrioTable {
+  size_t nhosts;
+  BlockPrioCount *hosts;
+  bool legacy;         /* no table on prio.info yet, only per host xattrs */
+} BlockPrioTable;
+
 
 struct glfs *
 glusterBlockVolumeInit(char *volume, int *errCode, char **errMsg);
 
+void
+glusterBlockVolumeRelease(struct glfs *glfs);
+
+void
+glusterBlockPrewarmVolumes(const char *volumes);
+
 int
 glusterBlockCreateEntry(struct glfs *glfs, blockCreateCli *blk, char *gbid,
                         int *errCode, char **errMsg);
@@ -63,34 +143,132 @@ int
 glusterBlockDeleteEntry(struct glfs *glfs, char *volume, char *gbid);
 
 struct glfs_fd *
-glusterBlockCreateMetaLockFile(struct glfs *glfs, char *volume, int *errCode,
-                               char **errMsg);
+glusterBlockCreateMetaLockFile(struct glfs *glfs, char *volume,
+                               const char *op, int *errCode, char **errMsg);
 
 int
 glusterBlockDeleteMetaFile(struct glfs *glfs, char *volume, char *blockname);
 
+int
+glusterBlockMetaFileAccess(struct glfs *glfs, char *blockname, int mode);
+
+off_t
+glusterBlockMetaLockOffset(const char *blockname);
+
+int
+glusterBlockMetaLock(struct glfs_fd *lkfd, short type, off_t start, off_t len,
+                     char *volume, const char *block, char **errMsg);
+
+int
+glusterBlockMetaUnlock(struct glfs_fd *lkfd, off_t start, off_t len,
+                       char *volume);
+
+void
+glusterBlockMetaLockStats(gbMetaLockStats *st);
+
 int
 blockGetMetaInfo(struct glfs* glfs, char* metafile, MetaInfo *info,
                  int *errCode);
 
+int
+blockGetMetaInfoCached(struct glfs* glfs, char *volume, char* metafile,
+                       MetaInfo *info, int *errCode);
+
+int
+glusterBlockCompactMetaFile(struct glfs *glfs, char *volume, char *blockname,
+                            MetaInfo *info);
+
+int
+glusterBlockGetMetaVersion(struct glfs *glfs, char *volume);
+
+int
+glusterBlockSetMetaVersion(struct glfs *glfs, char *volume, int version);
+
+int
+glusterBlockMigrateMetaFile(struct glfs *glfs, char *volume, char *blockname,
+                            int version, bool *migrated);
+
+void
+blockMetaCacheInvalidate(char *volume, char *metafile);
+
+struct MetaJournal *
+blockMetaJournalHold(struct glfs *glfs, char *volume, char *metafile);
+
+void
+blockMetaJournalRelease(struct MetaJournal *journal);
+
+int
+blockMetaJournalAppend(struct glfs *glfs, char *volume, char *metafile,
+                       char *data);
+
+void
+blockMetaJournalInvalidate(struct glfs *glfs, char *volume, char *metafile);
+
+int
+blockIndexRead(struct glfs *glfs, char *volume, BlockIndex **index,
+               int *errCode);
+
+int
+blockIndexWrite(struct glfs *glfs, char *volume, BlockIndex *index,
+                int *errCode);
+
+bool
+blockIndexNeedsRewrite(BlockIndex *index);
+
+int
+blockIndexLoad(struct glfs *glfs, char *volume, BlockIndex **index,
+               bool *dirty, int *errCode);
+
+BlockIndexEntry *
+blockIndexLookup(BlockIndex *index, const char *name);
+
+int
+blockIndexSet(BlockIndex *index, const char *name, MetaInfo *info);
+
+bool
+blockIndexHasHost(BlockIndexEntry *e, const char *addr);
+
+void
+blockIndexFree(BlockIndex *index);
+
+void
+blockIndexCommit(struct glfs *glfs, struct glfs_fd *lkfd, char *volume,
+                 char *block, struct MetaJournal *journal);
+
+int
+glusterBlockRebuildIndex(struct glfs *glfs, char *volume, size_t *nblocks,
+                         int *errCode, char **errMsg);
+
 void
 blockFreeMetaInfo(MetaInfo *info);
 
 int
-blockParseValidServers(struct glfs* glfs, char *metafile, int *errCode,
-                       blockServerDefPtr *savelist, char *skiphost);
+blockPrioTableRead(struct glfs *glfs, char *volume, BlockPrioTable *t);
+
+BlockPrioCount *
+blockPrioTableGet(struct glfs *glfs, BlockPrioTable *t, const char *addr);
+
+int
+blockPrioTableWrite(struct glfs *glfs, char *volume, BlockPrioTable *t);
+
+void
+blockPrioTableFree(BlockPrioTable *t);
 
 void
 blockGetPrioPath(struct glfs* glfs, char *volume,
                  blockServerDefPtr list, char *prio_path, size_t prio_len);
 
 void
-blockIncPrioAttr(struct glfs* glfs, char *volume, char *addr);
+blockMovePrioCount(struct glfs* glfs, char *volume, char *from, char *to);
 
-void
-blockDecPrioAttr(struct glfs* glfs, char *volume, char *addr);
+int
+glusterBlockRecountPrio(struct glfs *glfs, char *volume, BlockPrioTable *t,
+                        int *errCode, char **errMsg);
 
 int
 blockGetAddrStatusFromInfo(MetaInfo *info, char *addr);
 
+NodeInfo *
+blockMetaInfoGetNode(MetaInfo *info, const char *addr);
+
 #endif /* _GLFS_OPERATIONS_H */
@@ -62,6 +62,14 @@ struct blockReplace {
   char      ripaddr[255];
 };
 
+struct blockRebalance {
+  char      volume[255];
+  char      block_name[255];
+  char      gbid[127];
+  char      old_prio[255];               /* portal leaving the AO group */
+  char      prio_path[255];              /* portal joining it */
+};
+
 struct blockCreateCli {
   char      volume[255];
   u_quad_t  size;
@@ -150,10 +158,28 @@ struct blockGenConfigCli {
   enum JsonResponseFormat     json_resp;
 };
 
+struct blockReindexCli {
+  char      volume[255];
+  enum JsonResponseFormat     json_resp;
+};
+
+struct blockMigrateCli {
+  char      volume[255];
+  u_int     meta_version;
+  string    cmd<>;
+  enum JsonResponseFormat     json_resp;
+};
+
+struct blockRebalanceCli {
+  char      volume[255];
+  string    cmd<>;
+  enum JsonResponseFormat     json_resp;
+};
+
 struct blockResponse {
   int       exit;       /* exit code of the command */
   string    out<>;      /* output; TODO: return respective objects */
-  u_quad_t  offset;     /* dentry d_name offset */
+  u_quad_t  offset;     /* dentry d_name offset, daemon boot epoch to peers */
   opaque    xdata<>;    /* future reserve */
 };
 
@@ -168,6 +194,7 @@ program GLUSTER_BLOCK {
 
     blockResponse BLOCK_CREATE_V2(blockCreate2) = 7;
     blockResponse BLOCK_RELOAD(blockReload) = 8;
+    blockResponse BLOCK_REBALANCE(blockRebalance) = 9;
   } = 1;
 } = 21215311; /* B2 L12 O15 C3 K11 */
 
@@ -182,5 +209,8 @@ program GLUSTER_BLOCK_CLI {
     blockResponse BLOCK_MODIFY_SIZE_CLI(blockModifySizeCli) = 7;
     blockResponse BLOCK_GEN_CONFIG_CLI(blockGenConfigCli) = 8;
     blockResponse BLOCK_RELOAD_CLI(blockReloadCli) = 9;
+    blockResponse BLOCK_REINDEX_CLI(blockReindexCli) = 10;
+    blockResponse BLOCK_MIGRATE_CLI(blockMigrateCli) = 11;
+    blockResponse BLOCK_REBALANCE_CLI(blockRebalanceCli) = 12;
   } = 1;
 } = 212153113; /* B2 L12 O15 C3 K11 C3 */
@@ -175,6 +175,17 @@ done
 
 # Disable 'auth'
 TEST gluster-block modify ${VOLNAME}/${BLKNAME} auth disable
+
+# Grow the metafile past the compaction limit, the block must stay the same
+INFO=`eval gluster-block info ${VOLNAME}/${BLKNAME} | grep -e '^GBID:' -e '^SIZE:' -e '^HA:' -e '^EXPORTED ON:'`
+n=1
+while [ $n -le 20 ]
+do
+    TEST gluster-block modify ${VOLNAME}/${BLKNAME} auth enable
+    TEST gluster-block modify ${VOLNAME}/${BLKNAME} auth disable
+    (( n++ ))
+done
+TEST '[ "$(gluster-block info ${VOLNAME}/${BLKNAME} | grep -e "^GBID:" -e "^SIZE:" -e "^HA:" -e "^EXPORTED ON:")" == "${INFO}" ]'
 ##### End #####
 
 
@@ -182,6 +193,20 @@ TEST gluster-block modify ${VOLNAME}/${BLKNAME} auth disable
 # List blocks
 TEST gluster-block list ${VOLNAME}
 
+# Rebuild the block index, the block must still be listed
+TEST gluster-block reindex ${VOLNAME}
+TEST "gluster-block list ${VOLNAME} | grep -qx ${BLKNAME}"
+
+# Switch the metadata to v2 and back, the block must stay the same
+INFO=`eval gluster-block info ${VOLNAME}/${BLKNAME} | grep -e '^GBID:' -e '^SIZE:'`
+TEST gluster-block migrate ${VOLNAME} v2
+TEST '[ "$(gluster-block info ${VOLNAME}/${BLKNAME} | grep -e "^GBID:" -e "^SIZE:")" == "${INFO}" ]'
+TEST gluster-block migrate ${VOLNAME} v1
+TEST '[ "$(gluster-block info ${VOLNAME}/${BLKNAME} | grep -e "^GBID:" -e "^SIZE:")" == "${INFO}" ]'
+
+# Spread the prio paths over the nodes
+TEST "gluster-block rebalance ${VOLNAME} | grep -q 'RESULT: SUCCESS'"
+
 # Block info
 TEST gluster-block info ${VOLNAME}/${BLKNAME}
 ##### End #####
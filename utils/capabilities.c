@@ -14,6 +14,7 @@
 
 
 gbCapObj *globalCapabilities;
+uint64_t gbBootEpoch;
 
 
 int
@@ -114,6 +115,7 @@ gbSetCapabilties(void)
   gbCapObj *caps = NULL;
   char *p, *sep;
   bool free_caps = true;
+  struct timespec now;
 
   fp = fopen(GB_CAPS_FILE, "r");
   if (fp == NULL) {
@@ -212,6 +214,10 @@ gbSetCapabilties(void)
   globalCapabilities = caps;
   free_caps = false;
 
+  /* tells peers caching our capabilities that this is a new daemon */
+  clock_gettime(CLOCK_REALTIME, &now);
+  gbBootEpoch = (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+
  out:
   if (free_caps) {
     GB_FREE(caps);
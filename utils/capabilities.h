@@ -52,6 +52,10 @@ enum gbCapabilities {
 
   GB_CREATE_IO_TIMEOUT_CAP,
 
+  GB_METAFILE_V2_CAP,
+
+  GB_REBALANCE_CAP,
+
   GB_CAP_MAX
 };
 
@@ -79,11 +83,16 @@ static const char *const gbCapabilitiesLookup[] = {
 
   [GB_RELOAD_CAP]              = "reload",
 
+  [GB_METAFILE_V2_CAP]         = "metafile_v2",
+
+  [GB_REBALANCE_CAP]           = "rebalance",
+
   [GB_CAP_MAX]                 = NULL
 };
 
 
 extern gbCapObj *globalCapabilities;
+extern uint64_t gbBootEpoch;   /* set along with globalCapabilities */
 
 
 int gbCapabilitiesEnumParse(const char *cap);
@@ -248,6 +248,8 @@ getCharArrayFromDelimitedStr(char *str, char delim)
   char *tmp;
   char *tok;
   char *base;
+  char *saveptr = NULL;
+  char delims[2] = {delim, '\0'};
   size_t i = 0;
 
   if (!str) {
@@ -278,12 +280,12 @@ getCharArrayFromDelimitedStr(char *str, char delim)
     goto out;
   }
 
-  tok = strtok(tmp, &delim);
+  tok = strtok_r(tmp, delims, &saveptr);
   for (i = 0; tok != NULL; i++) {
     if (GB_STRDUP(arr->data[i], tok) < 0) {
       goto out;
     }
-    tok = strtok(NULL, &delim);
+    tok = strtok_r(NULL, delims, &saveptr);
   }
 
   GB_FREE(base);
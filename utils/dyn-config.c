@@ -194,6 +194,23 @@ glusterBlockConfSetOptions(gbConfig *cfg, bool getLogDir)
     if (cfg->GB_GLFS_LRU_COUNT) {
       glusterBlockSetLruCount(cfg->GB_GLFS_LRU_COUNT);
     }
+
+    /* volumes to pre-warm, consumed by the daemon at startup */
+    GB_PARSE_CFG_STR(cfg, GB_GLFS_PREWARM_VOLUMES, "");
+
+    /* 0 is valid for both, it disables the policy */
+    GB_PARSE_CFG_INT(cfg, GB_GLFS_LRU_IDLE_TIMEOUT, 0);
+    glusterBlockSetLruIdleTimeout(cfg->GB_GLFS_LRU_IDLE_TIMEOUT);
+
+    GB_PARSE_CFG_INT(cfg, GB_GLFS_LRU_MEM_BUDGET, 0);
+    glusterBlockSetLruMemBudget(cfg->GB_GLFS_LRU_MEM_BUDGET);
+
+    /* 0 keeps waiting on a contended meta.lock for as long as it takes */
+    GB_PARSE_CFG_INT(cfg, GB_METALOCK_TIMEOUT, 0);
+    glusterBlockSetMetaLockTimeout(cfg->GB_METALOCK_TIMEOUT);
+
+    /* threads serving rpc requests, consumed by the daemon at startup */
+    GB_PARSE_CFG_INT(cfg, GB_RPC_WORKERS, 0);
   }
 
   GB_PARSE_CFG_INT(cfg, GB_CLI_TIMEOUT, CLI_TIMEOUT_DEF);
@@ -218,6 +235,7 @@ glusterBlockConfFreeStrKeys(gbConfig *cfg)
    */
    GB_FREE_CFG_STR_KEY(cfg, GB_LOG_DIR);
    GB_FREE_CFG_STR_KEY(cfg, GB_LOG_LEVEL);
+   GB_FREE_CFG_STR_KEY(cfg, GB_GLFS_PREWARM_VOLUMES);
 }
 
 static bool
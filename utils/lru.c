@@ -16,18 +16,183 @@
 # include "utils.h"
 
 
+/*
+ * Cache is the recency list (head is the warmest entry, tail the coldest) and
+ * CacheHash indexes the same entries by volume name, so lookup, promotion and
+ * eviction never have to walk the whole list.
+ *
+ * Every handle handed out by queryCache()/appendNewEntry() carries a
+ * reference that must be dropped with releaseCacheEntry(). Eviction only
+ * unlinks an entry from Cache and CacheHash; the glfs_fini() is deferred
+ * until the last reference goes away. CacheFsHash indexes all live entries,
+ * including the evicted ones still in use, by their glfs_t pointer.
+ *
+ * A cache miss leaves a GB_LRU_ENTRY_INIT placeholder in CacheHash, owned by
+ * the caller that has to run glfs_init(). Everybody else asking for the same
+ * volume waits on lru_cond until the owner completes it with appendNewEntry()
+ * or failNewEntry(). A failed entry stays in CacheHash for
+ * LRU_INIT_FAIL_CACHE_SECS, so a burst of requests for a broken volume gets
+ * the same error back instead of remounting it each time.
+ *
+ * Besides the glfsLruCount capacity, the cache reaper thread evicts
+ * unreferenced entries that stayed idle for glfsLruIdleTimeout seconds, and
+ * the coldest unreferenced entries while the estimated memory of the cached
+ * handles is over glfsLruMemBudget.
+ */
 static LIST_HEAD(Cache);
+static struct list_head CacheHash[LRU_HASH_SIZE];
+static struct list_head CacheFsHash[LRU_HASH_SIZE];
 static int lruCount;
 static pthread_mutex_t lru_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t lru_cond = PTHREAD_COND_INITIALIZER;
+static pthread_mutex_t lru_save_lock = PTHREAD_MUTEX_INITIALIZER;
+static gbLruStats lruStats;  /* protected by lru_lock */
+
+typedef enum EntryState {
+  GB_LRU_ENTRY_INIT   = 0,  /* glfs_init() in flight, glfs is not valid */
+  GB_LRU_ENTRY_READY  = 1,  /* linked on Cache, CacheHash and CacheFsHash */
+  GB_LRU_ENTRY_FAILED = 2,  /* negative entry, linked on CacheHash only */
+} EntryState;
 
 typedef struct Entry {
   char volume[255];
   glfs_t *glfs;
-
-  struct list_head list;
+  unsigned int hash;
+  unsigned int refs;
+  bool cached;              /* linked on Cache and CacheHash */
+  EntryState state;
+  int errCode;              /* GB_LRU_ENTRY_FAILED only */
+  char *errMsg;             /* GB_LRU_ENTRY_FAILED only */
+  time_t expiry;            /* GB_LRU_ENTRY_FAILED only */
+  time_t lastUsed;
+  size_t memCost;           /* bytes, approximate */
+  struct timespec initStart;
+  size_t initRss;
+
+
+  struct list_head list;    /* recency list, linked on Cache */
+  struct list_head hnode;   /* hash chain, linked on CacheHash[hash] */
+  struct list_head fsnode;  /* hash chain, linked on CacheFsHash[] */
 } Entry;
 
 
+static time_t
+lruTimeNow(void)
+{
+  struct timespec ts;
+
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec;
+}
+
+
+static size_t
+lruElapsedMs(const struct timespec *start)
+{
+  struct timespec ts;
+
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (ts.tv_sec - start->tv_sec) * 1000 +
+         (ts.tv_nsec - start->tv_nsec) / 1000000;
+}
+
+
+/* resident set size of the process in bytes, 0 if unknown */
+static size_t
+lruResidentBytes(void)
+{
+  unsigned long size, resident;
+  FILE *fp;
+  int ret;
+
+
+  fp = fopen("/proc/self/statm", "r");
+  if (!fp) {
+    return 0;
+  }
+  ret = fscanf(fp, "%lu %lu", &size, &resident);
+  fclose(fp);
+  if (ret != 2) {
+    return 0;
+  }
+
+  return resident * sysconf(_SC_PAGESIZE);
+}
+
+
+static unsigned int
+lruHashVolume(const char *volname)
+{
+  unsigned int hash = 5381;
+
+
+  while (*volname) {
+    hash = ((hash << 5) + hash) + (unsigned char)*volname++;
+  }
+
+  return hash & (LRU_HASH_SIZE - 1);
+}
+
+
+static unsigned int
+lruHashFs(const glfs_t *fs)
+{
+  uintptr_t key = (uintptr_t)fs;
+
+
+  return (unsigned int)((key >> 4) ^ (key >> 16)) & (LRU_HASH_SIZE - 1);
+}
+
+
+/* must be called with lru_lock held */
+static Entry *
+lookupEntry(const char *volname, unsigned int hash)
+{
+  Entry *tmp;
+
+
+  list_for_each_entry(tmp, &CacheHash[hash], hnode) {
+    if (!strcmp(tmp->volume, volname)) {
+      return tmp;
+    }
+  }
+
+  return NULL;
+}
+
+
+/* must be called with lru_lock held */
+static Entry *
+lookupEntryByFs(const glfs_t *fs)
+{
+  Entry *tmp;
+
+
+  list_for_each_entry(tmp, &CacheFsHash[lruHashFs(fs)], fsnode) {
+    if (tmp->glfs == fs) {
+      return tmp;
+    }
+  }
+
+  return NULL;
+}
+
+
+static void
+destroyEntry(Entry *tmp)
+{
+  if (tmp->glfs) {
+    glfs_fini(tmp->glfs);
+  }
+  GB_FREE(tmp->errMsg);
+  GB_FREE(tmp);
+}
+
+
 void
 glusterBlockUpdateLruLogdir(const char *logPath)
 {
@@ -96,99 +261,543 @@ glusterBlockSetLruCount(const size_t lruCount)
 }
 
 
-static void
+void
+glusterBlockSetLruIdleTimeout(const size_t idleTimeout)
+{
+  LOCK(gbConf->lock);
+  if (gbConf->glfsLruIdleTimeout == idleTimeout) {
+    UNLOCK(gbConf->lock);
+    return;
+  }
+  gbConf->glfsLruIdleTimeout = idleTimeout;
+  UNLOCK(gbConf->lock);
+
+  LOG("mgmt", GB_LOG_CRIT,
+      "glfsLruIdleTimeout now is %lu seconds", idleTimeout);
+}
+
+
+void
+glusterBlockSetLruMemBudget(const size_t memBudget)
+{
+  LOCK(gbConf->lock);
+  if (gbConf->glfsLruMemBudget == memBudget) {
+    UNLOCK(gbConf->lock);
+    return;
+  }
+  gbConf->glfsLruMemBudget = memBudget;
+  UNLOCK(gbConf->lock);
+
+  LOG("mgmt", GB_LOG_CRIT,
+      "glfsLruMemBudget now is %lu MiB", memBudget);
+}
+
+
+/*
+ * must be called with lru_lock held, returns the evicted entry if nobody
+ * holds a reference on it, so the caller can destroy it after unlocking
+ */
+static Entry *
+evictEntry(Entry *tmp)
+{
+  list_del_init(&tmp->list);
+  list_del_init(&tmp->hnode);
+  tmp->cached = false;
+  lruCount--;
+  lruStats.evictions++;
+  lruStats.residentMem -= tmp->memCost;
+
+  if (tmp->refs) {
+    /* still in use, the last releaseCacheEntry() will fini it */
+    return NULL;
+  }
+  list_del(&tmp->fsnode);
+
+  return tmp;
+}
+
+
+/* must be called with lru_lock held, see evictEntry() */
+static Entry *
 releaseColdEntry(void)
+{
+  if (list_empty(&Cache)) {
+    return NULL;
+  }
+
+  return evictEntry(list_entry(Cache.prev, Entry, list));
+}
+
+
+/*
+ * Remember the cached volumes, warmest first, so the next daemon start can
+ * pre-warm them. Written to a temp file and renamed, so a crash never leaves
+ * a truncated list behind.
+ */
+static void
+saveCacheVolumes(void)
 {
   Entry *tmp;
-  struct list_head *pos, *q = &Cache;
+  char *volumes = NULL;
+  char *save = NULL;
+  FILE *fp;
+  int ret = -1;
+
 
+  LOCK(lru_save_lock);
 
   LOCK(lru_lock);
-  list_for_each_prev(pos, q) {
-    tmp = list_entry(pos, Entry, list);
-    list_del(pos);
+  list_for_each_entry(tmp, &Cache, list) {
+    save = volumes;
+    if (GB_ASPRINTF(&volumes, "%s%s\n", save ? save : "", tmp->volume) == -1) {
+      volumes = save;
+      UNLOCK(lru_lock);
+      goto out;
+    }
+    GB_FREE(save);
+  }
+  UNLOCK(lru_lock);
 
-    glfs_fini(tmp->glfs);
-    GB_FREE(tmp);
-    lruCount--;
+  fp = fopen(GB_LRU_SAVE_FILE ".tmp", "w");
+  if (!fp) {
+    goto out;
+  }
+  if (volumes && fputs(volumes, fp) == EOF) {
+    fclose(fp);
+    goto out;
+  }
+  if (fclose(fp) == EOF) {
+    goto out;
+  }
+  ret = rename(GB_LRU_SAVE_FILE ".tmp", GB_LRU_SAVE_FILE);
 
-    break;
+ out:
+  UNLOCK(lru_save_lock);
+  if (ret) {
+    LOG("mgmt", GB_LOG_WARNING, "saving cached volume list to %s failed[%s]",
+        GB_LRU_SAVE_FILE, strerror(errno));
   }
-  UNLOCK(lru_lock);
+  GB_FREE(volumes);
 }
 
 
+/*
+ * Returns the comma separated volume list saved by the previous run, warmest
+ * first, or NULL if there is none. Caller must free it.
+ */
+char *
+getCacheSavedVolumes(void)
+{
+  char *line = NULL;
+  char *volumes = NULL;
+  char *save;
+  size_t n = 0;
+  ssize_t len;
+  FILE *fp;
+
+
+  fp = fopen(GB_LRU_SAVE_FILE, "r");
+  if (!fp) {
+    return NULL;
+  }
+
+  while ((len = getline(&line, &n, fp)) != -1) {
+    if (len && line[len - 1] == '\n') {
+      line[--len] = '\0';
+    }
+    if (!len) {
+      continue;
+    }
+    save = volumes;
+    if (GB_ASPRINTF(&volumes, "%s%s%s", save ? save : "", save ? "," : "",
+                    line) == -1) {
+      volumes = save;
+      break;
+    }
+    GB_FREE(save);
+  }
+
+  GB_FREE(line);
+  fclose(fp);
+
+  return volumes;
+}
+
+
+/*
+ * Completes the GB_LRU_ENTRY_INIT placeholder that queryCache() handed to
+ * the caller, and wakes up everybody waiting on it. The caller keeps its
+ * reference on the new handle.
+ */
 int
 appendNewEntry(const char *volname, glfs_t *fs)
 {
   Entry *tmp;
+  Entry *cold, *next;
+  LIST_HEAD(reap);
+  size_t count;
+  size_t rss;
+  size_t initMs;
+  unsigned int hash = lruHashVolume(volname);
 
 
   LOCK(gbConf->lock);
-  if (lruCount == gbConf->glfsLruCount) {
-    releaseColdEntry();
-  }
+  count = gbConf->glfsLruCount;
+  UNLOCK(gbConf->lock);
 
-  if (GB_ALLOC(tmp) < 0) {
-    UNLOCK(gbConf->lock);
-    return -1;
+  rss = lruResidentBytes();
+
+  LOCK(lru_lock);
+  tmp = lookupEntry(volname, hash);
+  if (!tmp || tmp->state != GB_LRU_ENTRY_INIT) {
+    /* not claimed through queryCache(), track it all the same */
+    if (GB_ALLOC(tmp) < 0) {
+      UNLOCK(lru_lock);
+      return -1;
+    }
+    GB_STRCPYSTATIC(tmp->volume, volname);
+    tmp->hash = hash;
+    tmp->memCost = LRU_ENTRY_MEM_DEF;
+  } else {
+    list_del(&tmp->hnode);
+    initMs = lruElapsedMs(&tmp->initStart);
+    lruStats.inits++;
+    lruStats.initTimeTotal += initMs;
+    if (initMs > lruStats.initTimeMax) {
+      lruStats.initTimeMax = initMs;
+    }
+    /* concurrent inits or frees can skew this, fall back to the default */
+    if (rss && tmp->initRss && rss > tmp->initRss) {
+      tmp->memCost = rss - tmp->initRss;
+    } else {
+      tmp->memCost = LRU_ENTRY_MEM_DEF;
+    }
   }
-  GB_STRCPYSTATIC(tmp->volume, volname);
   tmp->glfs = fs;
+  tmp->refs = 1;  /* the caller's reference */
+  tmp->cached = true;
+  tmp->state = GB_LRU_ENTRY_READY;
+  tmp->lastUsed = lruTimeNow();
+
+  /* glfsLruCount can shrink at runtime, trim down to it */
+  while (lruCount && lruCount >= count) {
+    cold = releaseColdEntry();
+    if (cold) {
+      list_add(&cold->list, &reap);
+    }
+  }
 
-  LOCK(lru_lock);
-  list_add(&(tmp->list), &Cache);
+  list_add(&tmp->list, &Cache);
+  list_add(&tmp->hnode, &CacheHash[tmp->hash]);
+  list_add(&tmp->fsnode, &CacheFsHash[lruHashFs(fs)]);
+  lruCount++;
+  lruStats.residentMem += tmp->memCost;
+  pthread_cond_broadcast(&lru_cond);
   UNLOCK(lru_lock);
 
-  lruCount++;
-  UNLOCK(gbConf->lock);
+  /* glfs_fini() can take a while, don't hold lru_lock across it */
+  list_for_each_entry_safe(cold, next, &reap, list) {
+    list_del(&cold->list);
+    destroyEntry(cold);
+  }
+
+  saveCacheVolumes();
 
   return 0;
 }
 
 
-static void
-boostEntryWarmness(const char *volname)
+/*
+ * Completes the GB_LRU_ENTRY_INIT placeholder that queryCache() handed to
+ * the caller with a failure, which is then served to other callers for
+ * LRU_INIT_FAIL_CACHE_SECS.
+ */
+void
+failNewEntry(const char *volname, int errCode, const char *errMsg)
 {
   Entry *tmp;
-  struct list_head *pos, *q;
 
 
-  list_for_each_safe(pos, q, &Cache){
-    tmp = list_entry(pos, Entry, list);
-    if (!strcmp(tmp->volume, volname)) {
-      list_del(pos);
-      list_add(&(tmp->list), &Cache);
-      break;
+  LOCK(lru_lock);
+  tmp = lookupEntry(volname, lruHashVolume(volname));
+  if (tmp && tmp->state == GB_LRU_ENTRY_INIT) {
+    tmp->state = GB_LRU_ENTRY_FAILED;
+    tmp->errCode = errCode;
+    GB_STRDUP(tmp->errMsg, errMsg);
+    tmp->expiry = lruTimeNow() + LRU_INIT_FAIL_CACHE_SECS;
+    lruStats.initFailures++;
+    pthread_cond_broadcast(&lru_cond);
+  }
+  UNLOCK(lru_lock);
+}
+
+
+void
+releaseCacheEntry(glfs_t *fs)
+{
+  Entry *tmp;
+  bool found = false;
+
+
+  if (!fs) {
+    return;
+  }
+
+  LOCK(lru_lock);
+  tmp = lookupEntryByFs(fs);
+  if (tmp) {
+    found = true;
+    if (tmp->refs) {
+      tmp->refs--;
     }
+    tmp->lastUsed = lruTimeNow();
+    if (!tmp->refs && !tmp->cached) {
+      list_del(&tmp->fsnode);
+    } else {
+      tmp = NULL;
+    }
+  }
+  UNLOCK(lru_lock);
+
+  if (!found) {
+    LOG("mgmt", GB_LOG_WARNING,
+        "releaseCacheEntry(%p): handle is not tracked by the cache", fs);
+    return;
+  }
+
+  if (tmp) {
+    destroyEntry(tmp);
   }
 }
 
 
+/*
+ * Returns a referenced handle for volname. Otherwise returns NULL, and either
+ * sets *owner, in which case the caller must run glfs_init() and complete
+ * the entry with appendNewEntry() or failNewEntry(), or fills errCode and
+ * errMsg with the result of an initialization that failed a moment ago.
+ */
 glfs_t *
-queryCache(const char *volname)
+queryCache(const char *volname, bool *owner, int *errCode, char **errMsg)
+{
+  Entry *tmp;
+  glfs_t *glfs = NULL;
+  unsigned int hash = lruHashVolume(volname);
+
+
+  *owner = false;
+
+  LOCK(lru_lock);
+  while ((tmp = lookupEntry(volname, hash))) {
+    if (tmp->state != GB_LRU_ENTRY_INIT) {
+      break;
+    }
+    /* somebody is already initializing it, wait for the outcome */
+    lruStats.waits++;
+    pthread_cond_wait(&lru_cond, &lru_lock);
+  }
+
+  if (tmp && tmp->state == GB_LRU_ENTRY_READY) {
+    /* boost warmness */
+    list_move(&tmp->list, &Cache);
+    tmp->refs++;
+    tmp->lastUsed = lruTimeNow();
+    glfs = tmp->glfs;
+    lruStats.hits++;
+  } else if (tmp && lruTimeNow() < tmp->expiry) {
+    *errCode = tmp->errCode;
+    GB_STRDUP(*errMsg, tmp->errMsg);
+    lruStats.negHits++;
+  } else {
+    lruStats.misses++;
+    if (tmp) {
+      /* negative entry expired, recycle it as the placeholder */
+      tmp->state = GB_LRU_ENTRY_INIT;
+      tmp->errCode = 0;
+      GB_FREE(tmp->errMsg);
+      *owner = true;
+    } else if (GB_ALLOC(tmp) < 0) {
+      *errCode = ENOMEM;
+    } else {
+      GB_STRCPYSTATIC(tmp->volume, volname);
+      tmp->hash = hash;
+      tmp->state = GB_LRU_ENTRY_INIT;
+      list_add(&tmp->hnode, &CacheHash[hash]);
+      *owner = true;
+    }
+  }
+  UNLOCK(lru_lock);
+
+  if (*owner) {
+    /* the placeholder is ours until completed, no need for lru_lock */
+    clock_gettime(CLOCK_MONOTONIC, &tmp->initStart);
+    tmp->initRss = lruResidentBytes();
+  }
+
+  return glfs;
+}
+
+
+void
+getCacheStats(gbLruStats *stats)
+{
+  LOCK(lru_lock);
+  *stats = lruStats;
+  stats->resident = lruCount;
+  UNLOCK(lru_lock);
+}
+
+
+static void
+saveCacheStats(void)
+{
+  gbLruStats st;
+  FILE *fp;
+  int ret = -1;
+
+
+  getCacheStats(&st);
+
+  LOG("mgmt", GB_LOG_DEBUG,
+      "glfs cache: resident=%zu (%zu MiB) hits=%zu misses=%zu waits=%zu "
+      "neghits=%zu evictions=%zu (idle=%zu mem=%zu) inits=%zu failed=%zu "
+      "init avg=%zums max=%zums", st.resident, st.residentMem >> 20, st.hits,
+      st.misses, st.waits, st.negHits, st.evictions, st.idleEvictions,
+      st.memEvictions, st.inits, st.initFailures,
+      st.inits ? st.initTimeTotal / st.inits : 0, st.initTimeMax);
+
+  fp = fopen(GB_LRU_STATS_FILE ".tmp", "w");
+  if (!fp) {
+    goto out;
+  }
+  fprintf(fp, "RESIDENT: %zu\nRESIDENTMEM: %zu\nHITS: %zu\nMISSES: %zu\n"
+          "WAITS: %zu\nNEGHITS: %zu\nEVICTIONS: %zu\nIDLEEVICTIONS: %zu\n"
+          "MEMEVICTIONS: %zu\nINITS: %zu\nINITFAILURES: %zu\n"
+          "INITTIMETOTAL: %zu\nINITTIMEMAX: %zu\n", st.resident,
+          st.residentMem, st.hits, st.misses, st.waits, st.negHits,
+          st.evictions, st.idleEvictions, st.memEvictions, st.inits,
+          st.initFailures, st.initTimeTotal, st.initTimeMax);
+  if (fclose(fp) == EOF) {
+    goto out;
+  }
+  ret = rename(GB_LRU_STATS_FILE ".tmp", GB_LRU_STATS_FILE);
+
+ out:
+  if (ret) {
+    LOG("mgmt", GB_LOG_WARNING, "saving glfs cache stats to %s failed[%s]",
+        GB_LRU_STATS_FILE, strerror(errno));
+  }
+}
+
+
+/* evict idle entries and trim the cache down to the memory budget */
+static void
+reapCache(void)
 {
   Entry *tmp;
-  struct list_head *pos, *q, *r = &Cache;
+  Entry *cold, *next;
+  struct list_head *pos, *prev;
+  LIST_HEAD(reap);
+  size_t idleTimeout;
+  size_t memBudget;
+  time_t now = lruTimeNow();
+  size_t i;
+  bool evicted = false;
 
 
+  LOCK(gbConf->lock);
+  idleTimeout = gbConf->glfsLruIdleTimeout;
+  memBudget = gbConf->glfsLruMemBudget << 20;
+  UNLOCK(gbConf->lock);
+
   LOCK(lru_lock);
-  list_for_each_safe(pos, q, r){
+  /* coldest first */
+  for (pos = Cache.prev; pos != &Cache; pos = prev) {
+    prev = pos->prev;
     tmp = list_entry(pos, Entry, list);
-    if (!strcmp(tmp->volume, volname)) {
-      boostEntryWarmness(volname);
-      UNLOCK(lru_lock);
-      return tmp->glfs;
+    if (tmp->refs) {
+      continue;
+    }
+
+    if (idleTimeout && (now - tmp->lastUsed) >= idleTimeout) {
+      lruStats.idleEvictions++;
+    } else if (memBudget && lruStats.residentMem > memBudget) {
+      lruStats.memEvictions++;
+    } else {
+      continue;
+    }
+
+    cold = evictEntry(tmp);
+    if (cold) {
+      list_add(&cold->list, &reap);
+    }
+    evicted = true;
+  }
+
+  /* drop expired negative entries nobody asked for again */
+  for (i = 0; i < LRU_HASH_SIZE; i++) {
+    list_for_each_entry_safe(cold, next, &CacheHash[i], hnode) {
+      if (cold->state == GB_LRU_ENTRY_FAILED && now >= cold->expiry) {
+        list_del(&cold->hnode);
+        list_add(&cold->list, &reap);
+      }
     }
   }
   UNLOCK(lru_lock);
 
+  list_for_each_entry_safe(cold, next, &reap, list) {
+    list_del(&cold->list);
+    destroyEntry(cold);
+  }
+
+  if (evicted) {
+    saveCacheVolumes();
+  }
+}
+
+
+static void *
+cacheReaper(void *arg)
+{
+  while (1) {
+    sleep(LRU_REAP_INTERVAL);
+
+    reapCache();
+    saveCacheStats();
+  }
+
   return NULL;
 }
 
 
+int
+startCacheReaper(void)
+{
+  pthread_t tid;
+  int ret;
+
+
+  ret = pthread_create(&tid, NULL, cacheReaper, NULL);
+  if (ret) {
+    LOG("mgmt", GB_LOG_ERROR, "failed to start glfs cache reaper[%s]",
+        strerror(ret));
+    return -1;
+  }
+  pthread_detach(tid);
+
+  return 0;
+}
+
+
 void
 initCache(void)
 {
+  size_t i;
+
+
   INIT_LIST_HEAD(&Cache);
+  for (i = 0; i < LRU_HASH_SIZE; i++) {
+    INIT_LIST_HEAD(&CacheHash[i]);
+    INIT_LIST_HEAD(&CacheFsHash[i]);
+  }
 }
@@ -19,16 +19,63 @@
 
 # define   LRU_COUNT_MAX   512
 # define   LRU_COUNT_DEF   5
+# define   LRU_HASH_SIZE   1024  /* power of 2, at least 2 * LRU_COUNT_MAX */
+
+# define   LRU_INIT_FAIL_CACHE_SECS  5  /* how long a failed glfs_init() is reused */
+
+# define   GB_LRU_SAVE_FILE  CONFDIR "/glfs-lru-volumes.info"  /* for pre-warming */
+# define   GB_LRU_STATS_FILE GB_INFODIR "/gluster-blockd-lru.stats"
+
+# define   LRU_REAP_INTERVAL  30        /* seconds */
+# define   LRU_ENTRY_MEM_DEF  33554432  /* 32 MiB, if a handle can't be measured */
+
+
+typedef struct gbLruStats {
+  size_t hits;           /* served from the cache */
+  size_t misses;         /* had to run glfs_init() */
+  size_t waits;          /* waited on somebody else's glfs_init() */
+  size_t negHits;        /* served a recently failed glfs_init() */
+  size_t evictions;      /* all evictions, including the below */
+  size_t idleEvictions;
+  size_t memEvictions;
+  size_t inits;          /* successful glfs_init() */
+  size_t initFailures;
+  size_t initTimeTotal;  /* ms */
+  size_t initTimeMax;    /* ms */
+  size_t resident;       /* handles in the cache */
+  size_t residentMem;    /* bytes, approximate */
+} gbLruStats;
 
 void
 initCache(void);
 
 glfs_t *
-queryCache(const char *volname);
+queryCache(const char *volname, bool *owner, int *errCode, char **errMsg);
 
 int
 appendNewEntry(const char *volname, glfs_t *glfs);
 
+void
+failNewEntry(const char *volname, int errCode, const char *errMsg);
+
+char *
+getCacheSavedVolumes(void);
+
+void
+getCacheStats(gbLruStats *stats);
+
+int
+startCacheReaper(void);
+
+void
+glusterBlockSetLruIdleTimeout(const size_t idleTimeout);
+
+void
+glusterBlockSetLruMemBudget(const size_t memBudget);
+
+void
+releaseCacheEntry(glfs_t *glfs);
+
 int
 glusterBlockSetLruCount(const size_t lruCount);
 
@@ -124,6 +124,21 @@ glusterBlockSetLogLevel(unsigned int logLevel)
 }
 
 
+void
+glusterBlockSetMetaLockTimeout(size_t timeout)
+{
+  LOCK(gbConf->lock);
+  if (gbConf->metaLockTimeout == timeout) {
+    UNLOCK(gbConf->lock);
+    return;
+  }
+  gbConf->metaLockTimeout = timeout;
+  UNLOCK(gbConf->lock);
+
+  LOG("mgmt", GB_LOG_CRIT, "metaLockTimeout now is %zu seconds", timeout);
+}
+
+
 /* TODO: use gbConf in cli too, for logLevel/LogDir and other future options
 int
 glusterBlockSetCliTimeout(size_t timeout)
@@ -355,6 +370,7 @@ gbDependencyVersionCompare(int dependencyName, char *version)
   char *verStr;
   int i = 0, j;
   char *token, *tmp;
+  char *saveptr = NULL;
   bool done = false;
   bool ret = false;
 
@@ -365,7 +381,7 @@ gbDependencyVersionCompare(int dependencyName, char *version)
     return ret;
   }
 
-  token = strtok(verStr, ".-");
+  token = strtok_r(verStr, ".-", &saveptr);
   while( token != NULL ) {
     done = false;
     for (j = 0; j < strlen(token); j++) { /* say if version is 2.1.fb49, parse fb49 */
@@ -385,7 +401,7 @@ gbDependencyVersionCompare(int dependencyName, char *version)
         break;
       }
     }
-    token = strtok(NULL, ".-");
+    token = strtok_r(NULL, ".-", &saveptr);
     i++;
   }
 
@@ -686,6 +702,7 @@ gbClipoffSensitiveDetailsAtExec(char **data)
   char *tmp = NULL;
   char *ptr = NULL;
   char *ptr2 = NULL;
+  char *saveptr = NULL;
 
 
   if (!cmd) {
@@ -697,7 +714,7 @@ gbClipoffSensitiveDetailsAtExec(char **data)
    * 2. Output from targetcli
    */
   if (strstr(cmd, "password=") || strstr(cmd, "Parameter password is now")) {
-    line = strtok(cmd, "\n");
+    line = strtok_r(cmd, "\n", &saveptr);
     while (line) {
       ptr = strstr(line, "password=");
       if (!ptr) {
@@ -725,7 +742,7 @@ gbClipoffSensitiveDetailsAtExec(char **data)
         GB_FREE(tmp);
         tmp = res;
       }
-      line = strtok(NULL, "\n");
+      line = strtok_r(NULL, "\n", &saveptr);
     }
     GB_FREE(*data);
     *data = res;
@@ -53,8 +53,10 @@
 # define  GB_METADIR             "/block-meta"
 # define  GB_STOREDIR            "/block-store"
 # define  GB_TXLOCKFILE          "meta.lock"
+# define  GB_METALOCK_NS_OFFSET  0  /* block ranges start right after */
 # define  GB_PRIO_FILENAME       "prio.info"
 # define  GB_PRIO_FILE           GB_METADIR "/" GB_PRIO_FILENAME
+# define  GB_INDEXFILE           "blocks.index"
 
 # define  GB_MAX_LOGFILENAME     64  /* max strlen of file name */
 
@@ -115,6 +117,10 @@
 
 /* Config generate */
 # define  FAILED_GENCONFIG          "failed in generation of config"
+# define  FAILED_REINDEX            "failed in rebuilding index"
+# define  FAILED_MIGRATE            "failed in migrating metadata"
+# define  FAILED_REBALANCE          "failed in rebalancing prio paths"
+# define  FAILED_REMOTE_REBALANCE   "failed in remote prio path change"
 
 # define  FAILED_DEPENDENCY         "failed dependency, check if you have targetcli and tcmu-runner installed"
 
@@ -154,6 +160,9 @@
 
 struct gbConf {
   size_t glfsLruCount;
+  size_t glfsLruIdleTimeout;  /* seconds, 0 to disable */
+  size_t glfsLruMemBudget;    /* MiB, 0 to disable */
+  size_t metaLockTimeout;     /* seconds, 0 waits for meta.lock forever */
   unsigned int logLevel;
   size_t cliTimeout;
   char logDir[PATH_MAX];
@@ -237,77 +246,88 @@ extern struct gbConf *gbConf;
             GB_FREE(_tmp_);                                            \
           } while (0)
 
+/*
+ * meta.lock is locked by byte ranges: GB_METALOCK_NS_OFFSET guards the
+ * volume namespace (block names, prio.info accounting) and every block has
+ * its own byte at glusterBlockMetaLockOffset(), held for the whole op on it.
+ * Always take the block lock before the namespace lock. Whole file locks
+ * cover both, so they still exclude everybody. See glusterBlockMetaLock()
+ * for the GB_METALOCK_TIMEOUT deadline and the wait/hold accounting.
+ */
+# define  GB_METALOCK_RANGE_OR_GOTO(lkfd, type, start, len, volume,  \
+                                    block, errCode, errMsg, label)   \
+          do {                                                       \
+            if (glusterBlockMetaLock(lkfd, type, start, len, volume, \
+                                     block, &errMsg)) {              \
+              errCode = errno;                                       \
+              goto label;                                            \
+            }                                                        \
+          } while (0)
+
 # define  GB_METALOCK_OR_GOTO(lkfd, volume, errCode, errMsg, label)  \
+          GB_METALOCK_RANGE_OR_GOTO(lkfd, F_WRLCK, 0, 0, volume,     \
+                                    NULL, errCode, errMsg, label)
+
+# define  GB_METANSLOCK_OR_GOTO(lkfd, type, volume, errCode, errMsg, \
+                                label)                               \
+          GB_METALOCK_RANGE_OR_GOTO(lkfd, type, GB_METALOCK_NS_OFFSET,\
+                                    1, volume, NULL, errCode, errMsg, \
+                                    label)
+
+# define  GB_METABLKLOCK_OR_GOTO(lkfd, type, volume, block, errCode,  \
+                                 errMsg, label)                       \
+          GB_METALOCK_RANGE_OR_GOTO(lkfd, type,                       \
+                                    glusterBlockMetaLockOffset(block),\
+                                    1, volume, block, errCode, errMsg,\
+                                    label)
+
+# define  GB_METANSUNLOCK(lkfd, volume)                              \
+          do {                                                       \
+            if (glusterBlockMetaUnlock(lkfd, GB_METALOCK_NS_OFFSET,  \
+                                       1, volume)) {                 \
+              LOG("mgmt", GB_LOG_WARNING, "releasing namespace lock "\
+                  "on volume %s failed[%s]", volume, strerror(errno));\
+            }                                                        \
+          } while (0)
+
+/*
+ * Writers take their block lock exclusive to check and log the start of
+ * their transaction, then keep it shared for the long running part (storage
+ * allocation, remote calls). That still keeps other writers of the block
+ * out, as they can't get F_WRLCK over it, but lets info through. If the
+ * conversion fails the lock just stays exclusive.
+ */
+# define  GB_METALOCK_DOWNGRADE(lkfd, volume, block)                 \
           do {                                                       \
             struct flock _lock_ = {0, };                             \
-            _lock_.l_type = F_WRLCK;                                 \
-            if (glfs_posix_lock (lkfd, F_SETLKW, &_lock_)) {         \
-              LOG("mgmt", GB_LOG_ERROR, "glfs_posix_lock() on "      \
+            _lock_.l_type = F_RDLCK;                                 \
+            _lock_.l_start = glusterBlockMetaLockOffset(block);      \
+            _lock_.l_len = 1;                                        \
+            if (glfs_posix_lock (lkfd, F_SETLK, &_lock_)) {          \
+              LOG("mgmt", GB_LOG_WARNING, "downgrading lock on "     \
                   "volume %s failed[%s]", volume, strerror(errno));  \
-              errCode = errno;                                       \
-              if (!errMsg) {                                         \
-                    GB_ASPRINTF (&errMsg, "Not able to acquire "     \
-                        "lock on %s[%s]", volume, strerror(errCode));\
-              }                                                      \
-              goto label;                                            \
             }                                                        \
           } while (0)
 
-# define  GB_METAUPDATE_OR_GOTO(lock, glfs, fname,                      \
-                                volume, ret, errMsg, label,...)         \
+/*
+ * Appends a transaction record to the block's metafile through
+ * blockMetaJournalAppend(), which orders concurrent appenders by itself.
+ */
+# define  GB_METAUPDATE_OR_GOTO(glfs, fname, volume,                    \
+                                ret, errMsg, label,...)                 \
           do {                                                          \
             char *_write_;                                              \
-            struct glfs_fd *_tgmfd_;                                    \
-            LOCK(lock);                                                 \
-            ret = glfs_chdir (glfs, GB_METADIR);                        \
-            if (ret) {                                                  \
-              GB_ASPRINTF(&errMsg, "Failed to update transaction log "  \
-                "for %s/%s[%s]", volume, fname, strerror(errno));       \
-              LOG("gfapi", GB_LOG_ERROR, "glfs_chdir(%s) on "           \
-                  "volume %s failed[%s]", GB_METADIR, volume,           \
-                  strerror(errno));                                     \
-              UNLOCK(lock);                                             \
-              ret = -1;                                                 \
-              goto label;                                               \
-            }                                                           \
-            _tgmfd_ = glfs_creat(glfs, fname,                           \
-                               O_WRONLY | O_APPEND | O_SYNC,            \
-                               S_IRUSR | S_IWUSR);                      \
-            if (!_tgmfd_) {                                             \
-              GB_ASPRINTF(&errMsg, "Failed to update transaction log "  \
-                "for %s/%s[%s]", volume, fname, strerror(errno));       \
-              LOG("mgmt", GB_LOG_ERROR, "glfs_creat(%s): on "           \
-                  "volume %s failed[%s]", fname, volume,                \
-                  strerror(errno));                                     \
-              UNLOCK(lock);                                             \
-              ret = -1;                                                 \
-              goto label;                                               \
-            }                                                           \
             if (GB_ASPRINTF(&_write_, ##__VA_ARGS__) < 0) {             \
               ret = -1;                                                 \
+              goto label;                                               \
             }                                                           \
-            if (!ret) {                                                 \
-              if(glfs_write (_tgmfd_, _write_, strlen(_write_), 0) < 0){\
-                GB_ASPRINTF(&errMsg, "Failed to update transaction log "\
-                  "for %s/%s[%s]", volume, fname, strerror(errno));     \
-                LOG("mgmt", GB_LOG_ERROR, "glfs_write(%s): on "         \
-                    "volume %s failed[%s]", fname, volume,              \
-                    strerror(errno));                                   \
-                ret = -1;                                               \
-              }                                                         \
-              GB_FREE(_write_);                                         \
-            }                                                           \
-            if (_tgmfd_ && glfs_close(_tgmfd_) != 0) {                  \
+            ret = blockMetaJournalAppend(glfs, volume, fname, _write_); \
+            if (ret) {                                                  \
               GB_ASPRINTF(&errMsg, "Failed to update transaction log "  \
                 "for %s/%s[%s]", volume, fname, strerror(errno));       \
-              LOG("mgmt", GB_LOG_ERROR, "glfs_close(%s): on "           \
-                  "volume %s failed[%s]", fname, volume,                \
-                  strerror(errno));                                     \
-              UNLOCK(lock);                                             \
               ret = -1;                                                 \
-              goto label;                                               \
             }                                                           \
-            UNLOCK(lock);                                               \
+            GB_FREE(_write_);                                           \
             if (ret) {                                                  \
               goto label;                                               \
             }                                                           \
@@ -315,9 +335,7 @@ extern struct gbConf *gbConf;
 
 # define  GB_METAUNLOCK(lkfd, volume, ret, errMsg)                   \
           do {                                                       \
-            struct flock _lock_ = {0, };                             \
-            _lock_.l_type = F_UNLCK;                                 \
-            if (glfs_posix_lock(lkfd, F_SETLK, &_lock_)) {           \
+            if (glusterBlockMetaUnlock(lkfd, 0, 0, volume)) {        \
               if (!errMsg) {                                         \
                     GB_ASPRINTF (&errMsg, "Not able to acquire "     \
                         "lock on %s[%s]", volume, strerror(errno));  \
@@ -404,6 +422,9 @@ extern struct gbConf *gbConf;
         do {                                                        \
           blockResponse *resp = block_##op##_1_svc_st(blk, rqstp);  \
           if (resp) {                                               \
+            if (rqstp->rq_prog == GLUSTER_BLOCK) {                  \
+              resp->offset = gbBootEpoch;                           \
+            }                                                       \
             memcpy(reply, resp, sizeof(*reply));                    \
             GB_FREE(resp);                                          \
             ret = true;                                             \
@@ -461,6 +482,9 @@ typedef enum gbCliCmdlineOption {
   GB_CLI_REPLACE,
   GB_CLI_RELOAD,
   GB_CLI_GENCONFIG,
+  GB_CLI_REINDEX,
+  GB_CLI_MIGRATE,
+  GB_CLI_REBALANCE,
   GB_CLI_HELP,
   GB_CLI_HYPHEN_HELP,
   GB_CLI_VERSION,
@@ -482,6 +506,9 @@ static const char *const gbCliCmdlineOptLookup[] = {
   [GB_CLI_REPLACE]        = "replace",
   [GB_CLI_RELOAD]         = "reload",
   [GB_CLI_GENCONFIG]      = "genconfig",
+  [GB_CLI_REINDEX]        = "reindex",
+  [GB_CLI_MIGRATE]        = "migrate",
+  [GB_CLI_REBALANCE]      = "rebalance",
   [GB_CLI_HELP]           = "help",
   [GB_CLI_HYPHEN_HELP]    = "--help",
   [GB_CLI_VERSION]        = "version",
@@ -687,6 +714,11 @@ typedef struct gbConfig {
   char *GB_LOG_DIR;
   ssize_t GB_GLFS_LRU_COUNT;
   ssize_t GB_CLI_TIMEOUT;  /* seconds */
+  char *GB_GLFS_PREWARM_VOLUMES;  /* comma separated, read at start only */
+  ssize_t GB_GLFS_LRU_IDLE_TIMEOUT;  /* seconds */
+  ssize_t GB_GLFS_LRU_MEM_BUDGET;  /* MiB */
+  ssize_t GB_METALOCK_TIMEOUT;  /* seconds */
+  ssize_t GB_RPC_WORKERS;  /* per process, read at start only */
 } gbConfig;
 
 typedef enum gbDependencies {
@@ -705,6 +737,8 @@ void finiGbConfig(void);
 
 int glusterBlockSetLogLevel(unsigned int logLevel);
 
+void glusterBlockSetMetaLockTimeout(size_t timeout);
+
 //int glusterBlockSetCliTimeout(size_t timeout);
 
 int glusterBlockCLIOptEnumParse(const char *opt);
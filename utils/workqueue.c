@@ -0,0 +1,252 @@
+/*
+  Copyright (c) 2016 Red Hat, Inc. <http://www.redhat.com>
+  This file is part of gluster-block.
+
+  This file is licensed to you under your choice of the GNU Lesser
+  General Public License, version 3 or any later version (LGPLv3 or
+  later), or the GNU General Public License, version 2 (GPLv2), in all
+  cases as published by the Free Software Foundation.
+*/
+
+
+# include  <signal.h>
+
+# include  "workqueue.h"
+
+
+typedef enum gbWorkState {
+  GB_WORK_QUEUED,
+  GB_WORK_RUNNING,
+  GB_WORK_DONE
+} gbWorkState;
+
+struct gbWork {
+  gbWorkFn fn;
+  void *arg;
+  bool detached;            /* gbWorkQueueAdd(), the worker frees it */
+  gbWorkState state;
+  struct list_head list;    /* linked on gbWorkQueue->queue */
+};
+
+struct gbWorkQueue {
+  char name[32];
+  size_t nthreads;
+  pthread_t *threads;
+  struct list_head queue;   /* gbWork, run in order of arrival */
+  bool stopping;            /* no new work, exit once the queue is empty */
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  pthread_cond_t done;      /* a submitted work finished */
+};
+
+
+static void *
+gbWorkQueueWorker(void *data)
+{
+  gbWorkQueue *wq = data;
+  gbWork *work;
+
+
+  LOCK(wq->lock);
+  for (;;) {
+    while (list_empty(&wq->queue) && !wq->stopping) {
+      pthread_cond_wait(&wq->cond, &wq->lock);
+    }
+    if (list_empty(&wq->queue)) {
+      break;
+    }
+    work = list_entry(wq->queue.next, gbWork, list);
+    list_del(&work->list);
+    work->state = GB_WORK_RUNNING;
+    UNLOCK(wq->lock);
+
+    work->fn(work->arg);
+
+    LOCK(wq->lock);
+    if (work->detached) {
+      GB_FREE(work);
+    } else {
+      work->state = GB_WORK_DONE;
+      pthread_cond_broadcast(&wq->done);
+    }
+  }
+  UNLOCK(wq->lock);
+
+  return NULL;
+}
+
+
+/*
+ * Starts nthreads workers running whatever gets queued with
+ * gbWorkQueueAdd(). The workers block all signals, so that they keep
+ * being delivered to the thread that set up the handlers.
+ */
+gbWorkQueue *
+gbWorkQueueCreate(const char *name, size_t nthreads)
+{
+  gbWorkQueue *wq;
+  sigset_t all, old;
+  size_t i;
+  int ret;
+
+
+  if (!nthreads || nthreads > GB_WQ_THREADS_MAX ||
+      GB_ALLOC(wq) < 0) {
+    return NULL;
+  }
+  if (GB_ALLOC_N(wq->threads, nthreads) < 0) {
+    GB_FREE(wq);
+    return NULL;
+  }
+  GB_STRCPYSTATIC(wq->name, name);
+  INIT_LIST_HEAD(&wq->queue);
+  pthread_mutex_init(&wq->lock, NULL);
+  pthread_cond_init(&wq->cond, NULL);
+  pthread_cond_init(&wq->done, NULL);
+
+  sigfillset(&all);
+  pthread_sigmask(SIG_SETMASK, &all, &old);
+  for (i = 0; i < nthreads; i++) {
+    ret = pthread_create(&wq->threads[i], NULL, gbWorkQueueWorker, wq);
+    if (ret) {
+      LOG("mgmt", GB_LOG_WARNING, "%s: started %zu of %zu workers[%s]",
+          wq->name, i, nthreads, strerror(ret));
+      break;
+    }
+  }
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+  wq->nthreads = i;
+  if (!wq->nthreads) {
+    gbWorkQueueDestroy(wq);
+    return NULL;
+  }
+
+  return wq;
+}
+
+
+static gbWork *
+gbWorkQueueEnqueue(gbWorkQueue *wq, gbWorkFn fn, void *arg, bool detached)
+{
+  gbWork *work;
+
+
+  if (GB_ALLOC(work) < 0) {
+    return NULL;
+  }
+  work->fn = fn;
+  work->arg = arg;
+  work->detached = detached;
+  work->state = GB_WORK_QUEUED;
+
+  LOCK(wq->lock);
+  list_add_tail(&work->list, &wq->queue);
+  pthread_cond_signal(&wq->cond);
+  UNLOCK(wq->lock);
+
+  return work;
+}
+
+
+/* queue fn(arg) to run on one of the workers, fails only if out of memory */
+int
+gbWorkQueueAdd(gbWorkQueue *wq, gbWorkFn fn, void *arg)
+{
+  return gbWorkQueueEnqueue(wq, fn, arg, true) ? 0 : -1;
+}
+
+
+/*
+ * Like gbWorkQueueAdd(), but returns a handle to wait for fn(arg) with,
+ * NULL if out of memory. Every handle must be passed to gbWorkWait().
+ */
+gbWork *
+gbWorkQueueSubmit(gbWorkQueue *wq, gbWorkFn fn, void *arg)
+{
+  return gbWorkQueueEnqueue(wq, fn, arg, false);
+}
+
+
+/*
+ * Take a submitted work back from the queue if no worker has picked it up
+ * yet, freeing the handle; the caller is then to run fn(arg) itself.
+ * Returns false, leaving the handle for gbWorkWait(), if it was too late.
+ */
+bool
+gbWorkTake(gbWorkQueue *wq, gbWork *work)
+{
+  bool taken = false;
+
+
+  LOCK(wq->lock);
+  if (work->state == GB_WORK_QUEUED) {
+    list_del(&work->list);
+    taken = true;
+  }
+  UNLOCK(wq->lock);
+
+  if (taken) {
+    GB_FREE(work);
+  }
+
+  return taken;
+}
+
+
+/*
+ * Wait for a submitted work to finish and free it. A work no worker has
+ * picked up yet is run right here instead, so waiters never depend on a
+ * free worker and a busy queue can't deadlock them.
+ */
+void
+gbWorkWait(gbWorkQueue *wq, gbWork *work)
+{
+  bool runHere = false;
+
+
+  LOCK(wq->lock);
+  if (work->state == GB_WORK_QUEUED) {
+    list_del(&work->list);
+    work->state = GB_WORK_RUNNING;
+    runHere = true;
+  } else {
+    while (work->state != GB_WORK_DONE) {
+      pthread_cond_wait(&wq->done, &wq->lock);
+    }
+  }
+  UNLOCK(wq->lock);
+
+  if (runHere) {
+    work->fn(work->arg);
+  }
+  GB_FREE(work);
+}
+
+
+/* run what is queued already, then stop the workers and free the queue */
+void
+gbWorkQueueDestroy(gbWorkQueue *wq)
+{
+  size_t i;
+
+
+  if (!wq) {
+    return;
+  }
+
+  LOCK(wq->lock);
+  wq->stopping = true;
+  pthread_cond_broadcast(&wq->cond);
+  UNLOCK(wq->lock);
+
+  for (i = 0; i < wq->nthreads; i++) {
+    pthread_join(wq->threads[i], NULL);
+  }
+
+  pthread_mutex_destroy(&wq->lock);
+  pthread_cond_destroy(&wq->cond);
+  pthread_cond_destroy(&wq->done);
+  GB_FREE(wq->threads);
+  GB_FREE(wq);
+}
@@ -0,0 +1,45 @@
+/*
+  Copyright (c) 2016 Red Hat, Inc. <http://www.redhat.com>
+  This file is part of gluster-block.
+
+  This file is licensed to you under your choice of the GNU Lesser
+  General Public License, version 3 or any later version (LGPLv3 or
+  later), or the GNU General Public License, version 2 (GPLv2), in all
+  cases as published by the Free Software Foundation.
+*/
+
+
+# ifndef   _WORKQUEUE_H
+# define   _WORKQUEUE_H   1
+
+# include  "common.h"
+
+# define   GB_WQ_THREADS_MAX   64
+
+
+typedef void (*gbWorkFn)(void *arg);
+
+typedef struct gbWorkQueue gbWorkQueue;
+
+typedef struct gbWork gbWork;
+
+
+gbWorkQueue *
+gbWorkQueueCreate(const char *name, size_t nthreads);
+
+int
+gbWorkQueueAdd(gbWorkQueue *wq, gbWorkFn fn, void *arg);
+
+gbWork *
+gbWorkQueueSubmit(gbWorkQueue *wq, gbWorkFn fn, void *arg);
+
+bool
+gbWorkTake(gbWorkQueue *wq, gbWork *work);
+
+void
+gbWorkWait(gbWorkQueue *wq, gbWork *work);
+
+void
+gbWorkQueueDestroy(gbWorkQueue *wq);
+
+# endif /* _WORKQUEUE_H */